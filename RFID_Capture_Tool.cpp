@@ -0,0 +1,310 @@
+/**
+ * Replay and query tool for the binary capture files written by TCP_Server_Example --capture.
+ *
+ * The capture files (data_logs/client_data_log_<datetime>.rfidcap, see rfid/capture_file.h) are
+ * mapped with mmap, so opening even a day's capture is immediate, and a time range is found through
+ * the index blocks without reading the frames outside of it.
+ *
+ * Commands:
+ *      info <files...>                     Blocks, frames and time range of every file
+ *      replay [options] <files...>         Run every frame through the server's parse, checksum and
+ *                                          EPC_Tag_Counts logic and print the tag statistics
+ *          --paced                         Replay at the recorded rate instead of full speed
+ *          --speed X                       Paced replay X times faster than recorded
+ *          --top N                         Print the N most read tags (default 20)
+ *      export <files...>                   Print the frames in the csv layout of the data logs (blocks
+ *                                          that fail their checksum are reported on stderr and the
+ *                                          tool exits with -1)
+ *
+ *      Every command takes --from T and --to T to select a time range. T is a local date and time in
+ *      the file name format (2023-05-05_14-30-00) or seconds since the epoch.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread RFID_Capture_Tool.cpp -o RFID_Capture_Tool
+ * Execute: ./RFID_Capture_Tool replay data_logs/client_data_log_2023-05-05_14-30-00.rfidcap
+*/
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <climits>
+
+#include "rfid/capture_file.h"
+#include "rfid/frame_dispatch.h"
+#include "rfid/frame_parser.h"
+#include "rfid/tag_table.h"
+
+// Command line options
+struct ToolOptions {
+    std::string command;
+    std::vector<std::string> files;
+    int64_t fromNs = INT64_MIN;
+    int64_t toNs = INT64_MAX;
+    bool paced = false;
+    double speed = 1.0;
+    size_t top = 20;
+};
+
+// Function prototypes
+bool parseArguments(int argc, char* argv[], ToolOptions& options);
+bool parseTime(const char* text, int64_t& ns);
+std::string formatTime(int64_t ns);
+int infoCommand(const ToolOptions& options);
+int replayCommand(const ToolOptions& options);
+int exportCommand(const ToolOptions& options);
+
+// Main function
+int main(int argc, char* argv[]) {
+    ToolOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " info|replay|export [--from T] [--to T] [--paced] [--speed X]"
+                  << " [--top N] <capture files...>" << std::endl;
+        return -1;
+    }
+    // Files named after their creation time sort in time order
+    std::sort(options.files.begin(), options.files.end());
+
+    if (options.command == "info") {
+        return infoCommand(options);
+    } else if (options.command == "replay") {
+        return replayCommand(options);
+    } else if (options.command == "export") {
+        return exportCommand(options);
+    }
+    std::cerr << "Unknown command: " << options.command << std::endl;
+    return -1;
+}
+
+// Print the block index of every capture file
+int infoCommand(const ToolOptions& options) {
+    for (const std::string& file : options.files) {
+        CaptureReader reader;
+        if (!reader.open(file)) {
+            return -1;
+        }
+        const std::vector<CaptureIndexEntry>& blocks = reader.blocks();
+        std::cout << file << ": " << reader.fileSize() << " bytes, " << blocks.size() << " blocks, "
+                  << reader.recordCount() << " frames"
+                  << (reader.closedCleanly() ? "" : " (not closed cleanly, index rebuilt from the blocks)") << "\n";
+        if (!blocks.empty()) {
+            std::cout << "    " << formatTime(blocks.front().firstNs) << " to " << formatTime(blocks.back().lastNs) << "\n";
+        }
+    }
+    std::cout << std::flush;
+    return 0;
+}
+
+// Tag table and counters of a replay, handed to the frame handlers below
+struct ReplayState {
+    TagTable EPC_Tag_Counts;
+    int64_t receivedNs = 0;         // Receive time of the frame being handled
+    uint64_t connects = 0, tagReads = 0, heartbeats = 0, otherTypes = 0, unknownTypes = 0, malformed = 0;
+};
+
+static void replayConnect(ReplayState& state, const ConnectFrame&) {
+    state.connects++;
+}
+
+static void replayTagRead(ReplayState& state, const TagReadFrame& frame) {
+    state.tagReads++;
+    state.EPC_Tag_Counts.record(EpcKey::fromBytes(frame.epc), state.receivedNs);
+}
+
+static void replayHeartbeat(ReplayState& state, const HeartbeatFrame&) {
+    state.heartbeats++;
+}
+
+// Inventory end, antenna status and reader error frames
+template <typename Frame>
+static void replayOther(ReplayState& state, const Frame&) {
+    state.otherTypes++;
+}
+
+static void replayUnknown(ReplayState& state, const FrameView&) {
+    state.unknownTypes++;
+}
+
+static void replayMalformed(ReplayState& state, const FrameView&) {
+    state.malformed++;
+}
+
+// The frame types of the server (ReaderServer::FrameTypes) with the replay's handlers
+using ReplayFrameTypes = FrameDispatcher<ReplayState, replayUnknown, replayMalformed,
+                                         FrameHandler<ConnectFrame, replayConnect>,
+                                         FrameHandler<TagReadFrame, replayTagRead>,
+                                         FrameHandler<HeartbeatFrame, replayHeartbeat>,
+                                         FrameHandler<InventoryEndFrame, replayOther<InventoryEndFrame>>,
+                                         FrameHandler<AntennaStatusFrame, replayOther<AntennaStatusFrame>>,
+                                         FrameHandler<ReaderErrorFrame, replayOther<ReaderErrorFrame>>>;
+
+/* Replay every frame through the parse, checksum and tag counting logic of the server
+
+Full speed by default. With --paced the replay sleeps so the frames are handled at the rate (times
+--speed) they were received.
+*/
+int replayCommand(const ToolOptions& options) {
+    ReplayState state;
+    TagTable& EPC_Tag_Counts = state.EPC_Tag_Counts;
+    uint64_t frames = 0, bytes = 0, checksumErrors = 0;
+    bool blocksOk = true;
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t firstNs = INT64_MIN;
+
+    for (const std::string& file : options.files) {
+        CaptureReader reader;
+        if (!reader.open(file)) {
+            return -1;
+        }
+        blocksOk &= reader.forEachRecord(options.fromNs, options.toNs, [&](const CaptureRecord& record) {
+            if (options.paced) {
+                if (firstNs == INT64_MIN) {
+                    firstNs = record.receivedNs;
+                }
+                auto due = start + std::chrono::nanoseconds(
+                    static_cast<int64_t>((record.receivedNs - firstNs) / options.speed));
+                std::this_thread::sleep_until(due);
+            }
+
+            frames++;
+            bytes += record.size;
+            FrameView view;
+            if (!parseFrame(record.frame, record.size, view)) {
+                state.malformed++;
+                return;
+            }
+            if (frameChecksum(record.frame) != view.crc) {
+                checksumErrors++;
+                return;
+            }
+            state.receivedNs = record.receivedNs;
+            ReplayFrameTypes::dispatch(state, view);
+        });
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Replayed " << frames << " frames (" << bytes << " bytes) from " << options.files.size()
+              << " files in " << std::fixed << std::setprecision(3) << seconds << " s ("
+              << static_cast<uint64_t>(frames / std::max(seconds, 1e-9)) << " frames/s)\n";
+    std::cout << "Connect: " << state.connects << ", Tag reads: " << state.tagReads << ", Heartbeats: "
+              << state.heartbeats << ", Other types: " << state.otherTypes << ", Unknown types: " << state.unknownTypes
+              << ", Checksum errors: " << checksumErrors << ", Malformed: " << state.malformed << "\n";
+    if (!blocksOk) {
+        std::cout << "\033[31mSome blocks failed their checksum and were skipped\033[0m\n";
+    }
+
+    // Most read tags
+    std::vector<const TagEntry*> tags;
+    tags.reserve(EPC_Tag_Counts.size());
+    EPC_Tag_Counts.forEach([&tags](const TagEntry& entry) { tags.push_back(&entry); });
+    size_t top = std::min(options.top, tags.size());
+    std::partial_sort(tags.begin(), tags.begin() + top, tags.end(),
+                      [](const TagEntry* a, const TagEntry* b) { return a->count > b->count; });
+
+    std::cout << EPC_Tag_Counts.size() << " distinct tags, top " << top << ":\n";
+    for (size_t i = 0; i < top; i++) {
+        char epcTag[2 * EPC_LEN];
+        formatHex(epcTag, tags[i]->epc.bytes, EPC_LEN, 0);
+        std::cout << "EPC tag: ";
+        std::cout.write(epcTag, sizeof(epcTag)) << ", Frequency: " << tags[i]->count << ", First seen: "
+                  << formatTime(tags[i]->firstSeen) << ", Last seen: " << formatTime(tags[i]->lastSeen) << "\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
+
+// Print the frames of the time range in the csv layout (one row per frame, "bb,40,...,0a,")
+int exportCommand(const ToolOptions& options) {
+    std::vector<char> buffer(1 << 20);
+    size_t used = 0;
+    bool blocksOk = true;
+    for (const std::string& file : options.files) {
+        CaptureReader reader;
+        if (!reader.open(file)) {
+            return -1;
+        }
+        bool fileOk = reader.forEachRecord(options.fromNs, options.toNs, [&](const CaptureRecord& record) {
+            if (buffer.size() - used < 3 * MAX_FRAME_SIZE + 1) {
+                fwrite(buffer.data(), 1, used, stdout);
+                used = 0;
+            }
+            char* end = formatHex(buffer.data() + used, record.frame, record.size, ',');
+            *end++ = '\n';
+            used = end - buffer.data();
+        });
+        if (!fileOk) {
+            fwrite(buffer.data(), 1, used, stdout);
+            used = 0;
+            fflush(stdout);
+            std::cerr << file << ": some blocks failed their checksum and were skipped" << std::endl;
+            blocksOk = false;
+        }
+    }
+    fwrite(buffer.data(), 1, used, stdout);
+    fflush(stdout);
+    return blocksOk ? 0 : -1;
+}
+
+bool parseArguments(int argc, char* argv[], ToolOptions& options) {
+    if (argc < 3) {
+        return false;
+    }
+    options.command = argv[1];
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+            if (!parseTime(argv[++i], options.fromNs)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--to") == 0 && i + 1 < argc) {
+            if (!parseTime(argv[++i], options.toNs)) {
+                return false;
+            }
+        } else if (strcmp(argv[i], "--paced") == 0) {
+            options.paced = true;
+        } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            options.paced = true;
+            options.speed = std::max(std::atof(argv[++i]), 1e-6);
+        } else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+            options.top = std::atol(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            options.files.push_back(argv[i]);
+        }
+    }
+    return !options.files.empty();
+}
+
+// Local "YYYY-MM-DD_HH-MM-SS" (the file name format) or seconds since the epoch
+bool parseTime(const char* text, int64_t& ns) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(text, "%Y-%m-%d_%H-%M-%S", &tm);
+    if (end && *end == '\0') {
+        tm.tm_isdst = -1;
+        ns = static_cast<int64_t>(mktime(&tm)) * 1000000000LL;
+        return true;
+    }
+    char* numberEnd;
+    double seconds = strtod(text, &numberEnd);
+    if (*numberEnd != '\0') {
+        std::cerr << "Invalid time: " << text << std::endl;
+        return false;
+    }
+    ns = static_cast<int64_t>(seconds * 1e9);
+    return true;
+}
+
+// ns since the epoch as local "YYYY-MM-DD_HH-MM-SS.mmm"
+std::string formatTime(int64_t ns) {
+    std::time_t seconds = ns / 1000000000LL;
+    char text[64];
+    size_t length = strftime(text, sizeof(text), "%Y-%m-%d_%H-%M-%S", std::localtime(&seconds));
+    snprintf(text + length, sizeof(text) - length, ".%03d", static_cast<int>((ns / 1000000) % 1000));
+    return text;
+}
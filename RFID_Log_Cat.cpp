@@ -0,0 +1,124 @@
+/**
+ * Prints the data logs as csv, decompressing the ones written by TCP_Server_Example --log-compress.
+ *
+ * A compressed log (data_logs/client_data_log_<datetime>.csv.rlz, see rfid/log_compression.h) is a
+ * series of independently compressed blocks. Every block is decompressed and its checksum verified
+ * before its text is printed; a torn or corrupted block is reported on stderr and skipped, and the
+ * rest of the file is still printed. Whether a log is compressed is decided by its name (the .rlz
+ * extension), so a log whose first block is torn is still read block by block. Plain .csv logs are
+ * printed as they are, so a mix of old and new logs can be searched in one go:
+ *
+ *      ./RFID_Log_Cat data_logs/client_data_log_* | grep "bb,17,"
+ *
+ * Options:
+ *      --check             Print nothing but the blocks, sizes and compression ratio of every file
+ *                          (and whether all blocks are intact)
+ *
+ * Exits with -1 if a file could not be read or had a bad block.
+ *
+ * Compile: g++ -std=c++17 -O2 RFID_Log_Cat.cpp -o RFID_Log_Cat
+ * Execute: ./RFID_Log_Cat [--check] data_logs/client_data_log_2023-05-05_14-30-00.csv.rlz
+*/
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rfid/log_compression.h"
+
+// Function prototypes
+bool catFile(const std::string& file, bool check, std::vector<uint8_t>& scratch);
+
+// Main function
+int main(int argc, char* argv[]) {
+    bool check = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--check] <log files...>" << std::endl;
+        return -1;
+    }
+    // Files named after their creation time sort in time order
+    std::sort(files.begin(), files.end());
+
+    bool ok = true;
+    std::vector<uint8_t> scratch;
+    for (const std::string& file : files) {
+        ok = catFile(file, check, scratch) && ok;
+    }
+    fflush(stdout);
+    return ok ? 0 : -1;
+}
+
+// Print (or with check, verify) one log file. Returns false if it could not be read or had a bad block.
+bool catFile(const std::string& file, bool check, std::vector<uint8_t>& scratch) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        perror(("Log open failed: " + file).c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror("Log stat failed");
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror("Log mmap failed");
+        return false;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const uint8_t* data = static_cast<const uint8_t*>(mapped);
+
+    const size_t extension = strlen(LZ_LOG_EXTENSION);
+    bool compressed = file.size() >= extension && file.compare(file.size() - extension, extension, LZ_LOG_EXTENSION) == 0;
+    bool ok = true;
+    if (!compressed) {
+        // A plain csv log
+        if (check) {
+            std::cout << file << ": " << size << " bytes, not compressed" << std::endl;
+        } else {
+            fwrite(data, 1, size, stdout);
+        }
+    } else {
+        LzReadStats stats;
+        ok = readLzBlocks(data, size, scratch, stats, [check](const uint8_t* text, size_t length) {
+            if (!check) {
+                fwrite(text, 1, length, stdout);
+            }
+        });
+        if (!ok) {
+            fflush(stdout);
+            std::cerr << file << ": " << stats.badBlocks << " bad blocks, " << stats.skippedBytes
+                      << " bytes skipped" << std::endl;
+        }
+        if (check) {
+            std::cout << file << ": " << stats.blocks << " blocks, " << stats.rawBytes << " bytes of csv in "
+                      << stats.storedBytes << " (" << std::fixed << std::setprecision(2)
+                      << (stats.storedBytes ? static_cast<double>(stats.rawBytes) / stats.storedBytes : 0.0) << "x)"
+                      << std::defaultfloat << (ok ? ", all blocks intact" : "") << std::endl;
+        }
+    }
+    munmap(mapped, size);
+    return ok;
+}
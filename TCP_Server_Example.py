@@ -4,6 +4,14 @@
 # NOTE: sudo apt install socket
 
 import socket
+import sys
+
+# python3 TCP_Server_Example.py --native: parse the frames and count the tags in C++ with the extension
+# module (see rfid_native.cpp) and print the tag counts when a client disconnects, instead of printing
+# every received chunk
+rfid_native = None
+if "--native" in sys.argv[1:]:
+    import rfid_native
 
 # Create a stream based socket(i.e, a TCP socket)
 # operating on IPv4 addressing scheme
@@ -18,6 +26,19 @@ serverSocket.listen()
 while True:
     (clientConnected, clientAddress) = serverSocket.accept()
     print("Accepted a connection request from %s:%s" % (clientAddress[0], clientAddress[1]))
+    if rfid_native:
+        counter = rfid_native.TagCounter()
+        pending = bytearray()
+        while True:
+            dataFromClient = clientConnected.recv(65536)
+            if not dataFromClient:
+                break
+            pending += dataFromClient
+            del pending[:counter.feed(pending)]
+        print(counter.stats())
+        for epc, count in counter.top(10):
+            print("%s %d" % (epc.hex(), count))
+        continue
     while True:
         dataFromClient = clientConnected.recv(1024)
         if not dataFromClient:
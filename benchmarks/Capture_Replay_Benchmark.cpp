@@ -0,0 +1,172 @@
+/**
+ * Benchmark of rebuilding tag statistics from the binary capture versus from the csv logs.
+ *
+ * Writes the same synthetic traffic (tag reads from 20k tags with a heartbeat for every 20 frames, one
+ * frame every 100 ms per reader from 50 readers) to a csv log and to a capture file, then rebuilds the
+ * EPC_Tag_Counts table from each:
+ *      csv:        std::getline() per row, std::stoi() per hex cell, then parse and count
+ *      capture:    mmap, walk the index, parse and count (what RFID_Capture_Tool replay does)
+ *
+ * Reported: file sizes and the time and frames/sec of each rebuild.
+ *
+ * Check: a capture whose index has a corrupted block (bad checksum) or an entry pointing outside the
+ * file (checksum fixed up) must still be read in full, from the block headers.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Capture_Replay_Benchmark.cpp -o Capture_Replay_Benchmark
+ * Execute: ./Capture_Replay_Benchmark [frames] [folder]
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+
+#include "../rfid/capture_file.h"
+#include "../rfid/tag_table.h"
+#include "bench_util.h"
+
+static void countFrame(TagTable& table, const uint8_t* frame, size_t size, int64_t receivedNs, uint64_t& counted) {
+    FrameView view;
+    if (!parseFrame(frame, size, view) || frameChecksum(frame) != view.crc) {
+        return;
+    }
+    ByteSpan epc = frameEpc(view);
+    if (epc.size) {
+        table.record(EpcKey::fromBytes(epc.data), receivedNs);
+    }
+    counted++;
+}
+
+// Change one index entry of a closed capture, reopen it and count its records
+static bool checkCorruptIndex(const std::string& captureName, uint64_t expected, bool fixChecksum) {
+    uint64_t indexOffset;
+    CaptureBlockHeader index;
+    std::fstream file(captureName, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(offsetof(CaptureFileHeader, lastIndexOffset));
+    file.read(reinterpret_cast<char*>(&indexOffset), sizeof(indexOffset));
+    file.seekg(indexOffset);
+    file.read(reinterpret_cast<char*>(&index), sizeof(index));
+    std::vector<uint8_t> payload(index.payloadBytes);
+    file.read(reinterpret_cast<char*>(payload.data()), payload.size());
+
+    uint64_t badOffset = 1ULL << 40;
+    memcpy(&payload[sizeof(uint64_t) + offsetof(CaptureIndexEntry, offset)], &badOffset, sizeof(badOffset));
+    if (fixChecksum) {
+        index.checksum = captureChecksum(payload.data(), payload.size());
+    }
+    file.seekp(indexOffset);
+    file.write(reinterpret_cast<const char*>(&index), sizeof(index));
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    file.close();
+
+    CaptureReader reader;
+    uint64_t records = 0;
+    bool ok = reader.open(captureName) &&
+              reader.forEachRecord(INT64_MIN, INT64_MAX, [&records](const CaptureRecord&) { records++; });
+    return ok && !reader.closedCleanly() && records == expected;
+}
+
+int main(int argc, char* argv[]) {
+    size_t frames = argc > 1 ? std::atol(argv[1]) : 5000000;
+    std::string folder = argc > 2 ? argv[2] : "/tmp";
+    std::string csvName = folder + "/capture_benchmark.csv";
+    std::string captureName = folder + "/capture_benchmark" CAPTURE_EXTENSION;
+
+    // Write the same frames to both formats
+    {
+        std::mt19937_64 rng(1);
+        std::vector<uint8_t> tag = sampleFrames::tagRead();
+        std::vector<uint8_t> heartbeat = sampleFrames::heartbeat();
+        std::ofstream csv(csvName, std::ios::out | std::ios::trunc);
+        CaptureWriter capture;
+        int64_t now = 1683295200LL * 1000000000LL;
+        capture.open(captureName, now);
+        std::vector<char> row(3 * MAX_FRAME_SIZE + 1);
+
+        for (size_t i = 0; i < frames; i++) {
+            std::vector<uint8_t> data;
+            const std::vector<uint8_t>* frame = &heartbeat;
+            if (i % 20 != 0) {
+                std::vector<uint8_t> payload(tag.begin() + FRAME_HEADER_SIZE, tag.end() - 3);
+                uint32_t tagId = rng() % 20000;
+                memcpy(&payload[EPC_OFFSET + EPC_LEN - 4], &tagId, sizeof(tagId));
+                data = makeFrame(FRAME_TYPE_TAG_READ, payload);
+                frame = &data;
+            }
+            now += 2000000;     // 50 readers, one frame every 100 ms each
+            char* end = formatHex(row.data(), frame->data(), frame->size(), ',');
+            *end++ = '\n';
+            csv.write(row.data(), end - row.data());
+            capture.append(frame->data(), frame->size(), now, static_cast<uint32_t>(i % 50));
+            if (i % 500 == 499) {
+                capture.flush();    // One block per logger flush
+            }
+        }
+        capture.close();
+    }
+
+    // Rebuild from the csv log
+    double csvSeconds;
+    uint64_t csvCounted = 0;
+    size_t csvTags;
+    {
+        uint64_t start = nowNs();
+        TagTable EPC_Tag_Counts;
+        std::ifstream csv(csvName);
+        std::string line;
+        std::vector<uint8_t> frame;
+        while (std::getline(csv, line)) {
+            frame.clear();
+            std::stringstream cells(line);
+            std::string cell;
+            while (std::getline(cells, cell, ',')) {
+                frame.push_back(static_cast<uint8_t>(std::stoi(cell, nullptr, 16)));
+            }
+            countFrame(EPC_Tag_Counts, frame.data(), frame.size(), 0, csvCounted);
+        }
+        csvSeconds = (nowNs() - start) / 1e9;
+        csvTags = EPC_Tag_Counts.size();
+    }
+
+    // Rebuild from the capture
+    double captureSeconds;
+    uint64_t captureCounted = 0;
+    size_t captureTags;
+    uint64_t captureSize, csvSize;
+    {
+        uint64_t start = nowNs();
+        TagTable EPC_Tag_Counts;
+        CaptureReader reader;
+        if (!reader.open(captureName)) {
+            return -1;
+        }
+        reader.forEachRecord(INT64_MIN, INT64_MAX, [&](const CaptureRecord& record) {
+            countFrame(EPC_Tag_Counts, record.frame, record.size, record.receivedNs, captureCounted);
+        });
+        captureSeconds = (nowNs() - start) / 1e9;
+        captureTags = EPC_Tag_Counts.size();
+        captureSize = reader.fileSize();
+        std::ifstream csv(csvName, std::ios::ate | std::ios::binary);
+        csvSize = csv.tellg();
+    }
+
+    std::cout << frames << " frames" << std::endl;
+    std::cout << std::left << std::setw(10) << "format" << std::setw(14) << "MB" << std::setw(12) << "seconds"
+              << std::setw(14) << "frames/sec" << "tags" << std::endl;
+    std::cout << std::left << std::setw(10) << "csv" << std::setw(14) << std::fixed << std::setprecision(1)
+              << csvSize / 1e6 << std::setw(12) << std::setprecision(3) << csvSeconds << std::setw(14)
+              << static_cast<uint64_t>(csvCounted / csvSeconds) << csvTags << std::endl;
+    std::cout << std::left << std::setw(10) << "capture" << std::setw(14) << std::fixed << std::setprecision(1)
+              << captureSize / 1e6 << std::setw(12) << std::setprecision(3) << captureSeconds << std::setw(14)
+              << static_cast<uint64_t>(captureCounted / captureSeconds) << captureTags << std::endl;
+
+    bool corruptOk = checkCorruptIndex(captureName, frames, false) && checkCorruptIndex(captureName, frames, true);
+    std::cout << "Check: corrupted index read from the block headers: " << (corruptOk ? "ok" : "MISMATCH") << std::endl;
+
+    remove(csvName.c_str());
+    remove(captureName.c_str());
+    return csvCounted == captureCounted && corruptOk ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/**
+ * Check and benchmark of the batch checksum kernels against the scalar reference.
+ *
+ * Check: every kernel this CPU can run validates frames of every Len (0 to 255) at every offset
+ * within a 32 byte block, with correct and corrupted CRC bytes and the bytes after each frame filled
+ * with garbage. The result of every frame and the valid count must equal validateChecksumsScalar().
+ *
+ * Benchmark: frames/sec of each kernel over batches of FRAME_BATCH_SIZE frames packed back to back
+ * like a coalesced read, for tag reads (the common case, 21 summed bytes), a mix of the three frame
+ * types the reader sends, random Len from 0 to 64 and maximum length (Len 255) frames.
+ *
+ * Compile: g++ -std=c++17 -O2 benchmarks/Checksum_Benchmark.cpp -o Checksum_Benchmark
+ * Execute: ./Checksum_Benchmark [frames]
+*/
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include "../rfid/frame_checksum.h"
+#include "bench_util.h"
+
+// Frames packed back to back with CHECKSUM_READ_PADDING bytes of slack after the last one
+struct FrameBuffer {
+    std::vector<uint8_t> bytes;
+    std::vector<const uint8_t*> frames;
+};
+
+static FrameBuffer packFrames(const std::vector<std::vector<uint8_t>>& frames) {
+    FrameBuffer buffer;
+    for (const std::vector<uint8_t>& frame : frames) {
+        buffer.bytes.insert(buffer.bytes.end(), frame.begin(), frame.end());
+    }
+    buffer.bytes.resize(buffer.bytes.size() + CHECKSUM_READ_PADDING, 0xAA);
+    size_t offset = 0;
+    for (const std::vector<uint8_t>& frame : frames) {
+        buffer.frames.push_back(buffer.bytes.data() + offset);
+        offset += frame.size();
+    }
+    return buffer;
+}
+
+static std::vector<uint8_t> randomFrame(size_t len, std::mt19937& rng) {
+    std::vector<uint8_t> data(len);
+    for (uint8_t& byte : data) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    return makeFrame(static_cast<uint8_t>(rng()), data);
+}
+
+// Compare every kernel with the scalar reference. Returns false on any difference.
+static bool checkKernels(const std::vector<ChecksumKernel>& kernels) {
+    std::mt19937 rng(7);
+    std::vector<uint8_t> block(64 + MAX_FRAME_SIZE + CHECKSUM_READ_PADDING);
+    bool allOk = true;
+    for (const ChecksumKernel& kernel : kernels) {
+        size_t checked = 0, mismatches = 0;
+        for (size_t len = 0; len <= 255; len++) {
+            for (size_t align = 0; align < 32; align++) {
+                for (int corrupt = 0; corrupt < 2; corrupt++) {
+                    for (uint8_t& byte : block) {
+                        byte = static_cast<uint8_t>(rng());
+                    }
+                    std::vector<uint8_t> frame = randomFrame(len, rng);
+                    if (corrupt) {
+                        frame[frame.size() - 3] += 1 + rng() % 255;
+                    }
+                    memcpy(block.data() + align, frame.data(), frame.size());
+
+                    const uint8_t* frames[1] = {block.data() + align};
+                    bool expected, actual;
+                    size_t expectedValid = validateChecksumsScalar(frames, 1, &expected);
+                    size_t actualValid = kernel.validate(frames, 1, &actual);
+                    if (expected != actual || expectedValid != actualValid || expected == (corrupt != 0)) {
+                        mismatches++;
+                    }
+                    checked++;
+                }
+            }
+        }
+        std::cout << std::left << std::setw(8) << kernel.name << checked << " frames: "
+                  << (mismatches ? std::to_string(mismatches) + " MISMATCHES" : std::string("ok")) << std::endl;
+        allOk = allOk && mismatches == 0;
+    }
+    return allOk;
+}
+
+// Frames/sec of one kernel over the whole buffer, in batches of FRAME_BATCH_SIZE
+static double framesPerSec(const ChecksumKernel& kernel, const FrameBuffer& buffer, size_t total) {
+    bool ok[FRAME_BATCH_SIZE];
+    size_t valid = 0, done = 0;
+    uint64_t start = nowNs();
+    while (done < total) {
+        for (size_t i = 0; i + FRAME_BATCH_SIZE <= buffer.frames.size(); i += FRAME_BATCH_SIZE) {
+            valid += kernel.validate(buffer.frames.data() + i, FRAME_BATCH_SIZE, ok);
+        }
+        done += buffer.frames.size() / FRAME_BATCH_SIZE * FRAME_BATCH_SIZE;
+    }
+    uint64_t elapsed = nowNs() - start;
+    if (valid != done) {
+        std::cerr << kernel.name << ": " << done - valid << " frames failed validation" << std::endl;
+    }
+    return done * 1e9 / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t total = argc > 1 ? std::atol(argv[1]) : 50000000;
+    std::vector<ChecksumKernel> kernels = checksumKernels();
+    std::cout << "Selected kernel: " << checksumKernel().name << std::endl;
+    if (!checkKernels(kernels)) {
+        return -1;
+    }
+
+    // 4096 frames per workload: a few receive rings' worth, so the bytes stay in cache as in the server
+    std::mt19937 rng(1);
+    std::vector<std::pair<std::string, FrameBuffer>> workloads;
+    std::vector<std::vector<uint8_t>> tagReads, mixed, random, maximum;
+    for (size_t i = 0; i < 4096; i++) {
+        tagReads.push_back(sampleFrames::tagRead());
+        mixed.push_back(i % 8 == 0 ? sampleFrames::heartbeat() : i % 64 == 1 ? sampleFrames::connect()
+                                                                            : sampleFrames::tagRead());
+        random.push_back(randomFrame(rng() % 65, rng));
+        maximum.push_back(randomFrame(255, rng));
+    }
+    workloads.emplace_back("tag reads", packFrames(tagReads));
+    workloads.emplace_back("mixed", packFrames(mixed));
+    workloads.emplace_back("Len 0-64", packFrames(random));
+    workloads.emplace_back("Len 255", packFrames(maximum));
+
+    std::cout << std::endl << std::left << std::setw(12) << "frames";
+    for (const ChecksumKernel& kernel : kernels) {
+        std::cout << std::setw(16) << (std::string(kernel.name) + " (M/s)");
+    }
+    std::cout << "speedup" << std::endl;
+    for (const auto& workload : workloads) {
+        std::cout << std::left << std::setw(12) << workload.first;
+        double scalar = 0, best = 0;
+        for (const ChecksumKernel& kernel : kernels) {
+            size_t frames = workload.first == "Len 255" ? total / 8 : total;
+            double rate = framesPerSec(kernel, workload.second, frames);
+            scalar = scalar ? scalar : rate;
+            best = std::max(best, rate);
+            std::cout << std::setw(16) << std::fixed << std::setprecision(1) << rate / 1e6;
+        }
+        std::cout << std::setprecision(2) << best / scalar << "x" << std::endl;
+    }
+    return 0;
+}
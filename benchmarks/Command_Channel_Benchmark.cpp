@@ -0,0 +1,305 @@
+/**
+ * Command throughput of the pipelined command channel (rfid/command_channel.h).
+ *
+ * The server runs in-process on a loopback port. One client thread connects the readers and
+ * answers every command frame right away with a frame of the same TYPE, the answers of one read()
+ * in one write(). Each reader is first sent one command by the server itself when it connects
+ * (config.connectCommands), which tells the client that the server has accepted every reader. Then
+ * the benchmark submits 32 commands for every reader (submitCommand() with connectionId 0) at once
+ * and waits for all results, with 1 command (one at a time) and 8 commands in flight per reader.
+ *
+ * Reported per number of readers and window (median of the rounds):
+ *      commands/sec:       from the first submitCommand() to the last result
+ *      sendmsg/command:    sendmsg() calls of the server per command written (how many frames one
+ *                          vectored write carried)
+ *      p50, p99 us:        from a command being written to its answer being handled
+ *
+ * Check: every command must be answered. Then a reader answers a command only after its timeout,
+ * when the server has already sent the next command of the same TYPE: the late answer must not be
+ * taken for the next command's.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Command_Channel_Benchmark.cpp -o Command_Channel_Benchmark
+ * Execute: ./Command_Channel_Benchmark [commands_per_reader] [rounds]
+*/
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <cstdlib>
+#include <poll.h>
+
+#include "../rfid/reader_server.h"
+#include "bench_util.h"
+
+#define HELLO_COMMAND 0x21          // Sent by the server to every reader when it connects
+
+struct RunResult {
+    double commandsPerSecond = 0;
+    double writesPerCommand = 0;
+    double p50Us = 0;
+    double p99Us = 0;
+    bool ok = false;
+};
+
+static RunResult runOnce(int readers, int commandsPerReader, size_t window) {
+    ServerConfig config = quietConfig<ServerConfig>();
+    config.backlog = 1024;
+    config.commandWindow = window;
+    ReaderCommand hello;
+    hello.type = HELLO_COMMAND;
+    config.connectCommands.push_back(hello);
+
+    // Results arrive on the event loop thread
+    std::vector<uint64_t> latencies;
+    std::atomic<uint64_t> results{0};
+    uint64_t answered = 0;
+    uint64_t lastResultNs = 0;
+    ReaderServer server(config);
+    server.setCommandHandler([&](const CommandResult& result) {
+        latencies.push_back(result.latencyNs);
+        answered += result.status == CommandStatus::Answered;
+        lastResultNs = nowNs();
+        results.fetch_add(1, std::memory_order_release);
+    });
+    if (!server.start()) {
+        exit(-1);
+    }
+    ServerThread<ReaderServer> serverThread(server);
+
+    // The readers: answer every command as soon as it arrives
+    std::atomic<bool> ready{false}, done{false};
+    std::thread client([&]() {
+        std::vector<int> fds;
+        std::vector<std::unique_ptr<FrameReassembler>> received;
+        std::vector<struct pollfd> pollFds;
+        for (int r = 0; r < readers; r++) {
+            int fd = connectLoopback(server.boundPort(), true);
+            if (fd < 0) {
+                exit(-1);
+            }
+            fds.push_back(fd);
+            received.push_back(std::make_unique<FrameReassembler>());
+            received.back()->init(65536);
+            pollFds.push_back({fd, POLLIN, 0});
+        }
+        int helloes = 0;
+        std::vector<uint8_t> answers;
+        while (!done.load()) {
+            if (poll(pollFds.data(), pollFds.size(), 10) <= 0) {
+                continue;
+            }
+            for (int r = 0; r < readers; r++) {
+                if (!(pollFds[r].revents & POLLIN)) {
+                    continue;
+                }
+                FrameReassembler& reassembler = *received[r];
+                ssize_t n = read(fds[r], reassembler.writePtr(), reassembler.writable());
+                if (n <= 0) {
+                    continue;
+                }
+                reassembler.commit(n);
+                answers.clear();
+                FrameStats stats;
+                reassembler.drain(stats, [&](const uint8_t* frame, size_t, bool checksumOk) {
+                    if (!checksumOk) {
+                        return;
+                    }
+                    helloes += frame[1] == HELLO_COMMAND;
+                    std::vector<uint8_t> answer = makeFrame(frame[1], {0x00});
+                    answers.insert(answers.end(), answer.begin(), answer.end());
+                });
+                if (!answers.empty() && write(fds[r], answers.data(), answers.size()) < 0) {
+                    perror("Write failed");
+                }
+            }
+            if (helloes == readers) {
+                ready.store(true);
+            }
+        }
+        for (int fd : fds) {
+            close(fd);
+        }
+    });
+    while (!ready.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // The hello results were counted on the connections, not handed to the command handler
+
+    uint64_t total = static_cast<uint64_t>(readers) * commandsPerReader;
+    uint64_t start = nowNs();
+    for (int i = 0; i < commandsPerReader; i++) {
+        ReaderCommand command;
+        command.type = static_cast<uint8_t>(0x30 + i % 8);
+        command.len = 2;
+        command.data[0] = 0x0a;
+        command.data[1] = static_cast<uint8_t>(i);
+        command.tag = i;
+        while (!server.submitCommand(command)) {
+            std::this_thread::yield();
+        }
+    }
+    uint64_t deadline = nowNs() + 10000000000ULL;
+    while (results.load(std::memory_order_acquire) < total && nowNs() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    bool complete = results.load(std::memory_order_acquire) == total;
+    serverThread.stop();
+    done.store(true);
+    client.join();
+
+    RunResult result;
+    ConnectionCounters totals = server.totals();
+    result.ok = complete && answered == total;
+    if (complete) {
+        result.commandsPerSecond = total / ((lastResultNs - start) / 1e9);
+    }
+    result.writesPerCommand = static_cast<double>(totals.commandWrites) / std::max<uint64_t>(totals.commandsSent, 1);
+    result.p50Us = percentile(latencies, 50) / 1000.0;
+    result.p99Us = percentile(latencies, 99) / 1000.0;
+    server.shutdown();
+    return result;
+}
+
+/* One reader answers its first command late (after the timeout), the rest right away, in order
+
+The second command is submitted once the first timed out. Returns true if the first command timed
+out and the second got its own answer (the answers echo the command's second data byte).
+*/
+static bool checkLateAnswer() {
+    const int timeoutMs = 50;
+    ServerConfig config = quietConfig<ServerConfig>();
+    config.commandTimeoutMs = timeoutMs;
+    ReaderCommand hello;
+    hello.type = HELLO_COMMAND;
+    config.connectCommands.push_back(hello);
+
+    std::atomic<int> results{0};
+    CommandStatus status[2] = {CommandStatus::Rejected, CommandStatus::Rejected};
+    int response[2] = {-1, -1};
+    ReaderServer server(config);
+    server.setCommandHandler([&](const CommandResult& result) {
+        if (result.tag < 2) {
+            status[result.tag] = result.status;
+            response[result.tag] = result.response.size ? result.response.data[0] : -1;
+        }
+        results.fetch_add(1, std::memory_order_release);
+    });
+    if (!server.start()) {
+        exit(-1);
+    }
+    ServerThread<ReaderServer> serverThread(server);
+
+    std::atomic<bool> ready{false}, done{false};
+    std::thread client([&]() {
+        int fd = connectLoopback(server.boundPort(), true);
+        if (fd < 0) {
+            exit(-1);
+        }
+        FrameReassembler reassembler;
+        reassembler.init(65536);
+        std::deque<std::pair<uint64_t, std::vector<uint8_t>>> answers;    // Release time, answer
+        bool first = true;
+        while (!done.load()) {
+            struct pollfd pollFd = {fd, POLLIN, 0};
+            if (poll(&pollFd, 1, 1) > 0) {
+                ssize_t n = read(fd, reassembler.writePtr(), reassembler.writable());
+                if (n > 0) {
+                    reassembler.commit(n);
+                    FrameStats stats;
+                    reassembler.drain(stats, [&](const uint8_t* frame, size_t, bool checksumOk) {
+                        if (!checksumOk) {
+                            return;
+                        }
+                        uint64_t release = nowNs();
+                        if (frame[1] != HELLO_COMMAND && first) {
+                            release += timeoutMs * 3 / 2 * 1000000ULL;     // Between the timeout and the drop
+                            first = false;
+                        }
+                        if (!answers.empty()) {
+                            release = std::max(release, answers.back().first);  // Answers stay in order
+                        }
+                        answers.emplace_back(release, makeFrame(frame[1], {frame[2] > 1 ? frame[4] : uint8_t(0)}));
+                    });
+                }
+            }
+            while (!answers.empty() && answers.front().first <= nowNs()) {
+                if (write(fd, answers.front().second.data(), answers.front().second.size()) < 0) {
+                    perror("Write failed");
+                }
+                ready.store(ready.load() || answers.front().second[1] == HELLO_COMMAND);
+                answers.pop_front();
+            }
+        }
+        close(fd);
+    });
+    while (!ready.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    for (int i = 0; i < 2; i++) {
+        ReaderCommand command;
+        command.type = 0x30;
+        command.len = 2;
+        command.data[0] = 0x0a;
+        command.data[1] = static_cast<uint8_t>(i);
+        command.tag = i;
+        server.submitCommand(command);
+        uint64_t deadline = nowNs() + 10 * timeoutMs * 1000000ULL;
+        while (results.load(std::memory_order_acquire) <= i && nowNs() < deadline) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2 * timeoutMs));    // The late answer is handled
+    serverThread.stop();
+    done.store(true);
+    client.join();
+    server.shutdown();
+    return results.load() == 2 && status[0] == CommandStatus::TimedOut && status[1] == CommandStatus::Answered &&
+           response[1] == 1;
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    int commandsPerReader = argc > 1 ? std::atoi(argv[1]) : 32;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    struct Row {
+        std::string name;
+        std::vector<double> rate, writes, p50, p99;
+    };
+    std::vector<Row> rows;
+    bool ok = true;
+    for (int readers : {1, 16, 256}) {
+        for (size_t window : {1, 8}) {
+            Row row;
+            row.name = std::to_string(readers) + " readers, window " + std::to_string(window);
+            for (int round = 0; round < rounds; round++) {
+                RunResult result = runOnce(readers, commandsPerReader, window);
+                row.rate.push_back(result.commandsPerSecond);
+                row.writes.push_back(result.writesPerCommand);
+                row.p50.push_back(result.p50Us);
+                row.p99.push_back(result.p99Us);
+                ok = ok && result.ok;
+            }
+            rows.push_back(row);
+        }
+    }
+
+    std::cout << std::endl << "Check: every command answered: " << (ok ? "ok" : "MISMATCH") << std::endl;
+    bool lateOk = checkLateAnswer();
+    std::cout << "Check: late answer taken by the timed-out command: " << (lateOk ? "ok" : "MISMATCH") << std::endl;
+    ok = ok && lateOk;
+    std::cout << std::endl << std::left << std::setw(28) << "readers, window" << std::setw(16) << "commands/sec"
+              << std::setw(18) << "sendmsg/command" << std::setw(12) << "p50 us" << "p99 us" << std::endl;
+    for (const Row& row : rows) {
+        std::cout << std::left << std::setw(28) << row.name << std::fixed << std::setprecision(0) << std::setw(16)
+                  << median(row.rate) << std::setprecision(3) << std::setw(18) << median(row.writes)
+                  << std::setprecision(1) << std::setw(12) << median(row.p50) << median(row.p99) << std::endl;
+    }
+    return ok ? 0 : -1;
+}
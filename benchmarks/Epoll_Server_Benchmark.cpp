@@ -0,0 +1,76 @@
+/**
+ * Benchmark of the epoll reader server with a growing number of connected readers.
+ *
+ * The server runs on its own thread on a loopback port picked by the kernel. For every reader count
+ * (1, 2, 4, ... 256) the benchmark connects that many client sockets and streams heartbeat frames
+ * round-robin over all of them for a fixed time window. It reports the sustained frames/sec handled
+ * by the server and the p50/p99 time the server spent handling each received message.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Epoll_Server_Benchmark.cpp -o Epoll_Server_Benchmark
+ * Execute: ./Epoll_Server_Benchmark [window_ms]
+*/
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <cstdlib>
+
+#include "../rfid/reader_server.h"
+#include "bench_util.h"
+
+int main(int argc, char* argv[]) {
+    int windowMs = argc > 1 ? std::atoi(argv[1]) : 1000;
+    std::vector<uint8_t> frame = sampleFrames::heartbeat();
+
+    std::cout << std::left << std::setw(10) << "readers" << std::setw(14) << "frames/sec"
+              << std::setw(12) << "p50 (ns)" << std::setw(12) << "p99 (ns)" << std::endl;
+
+    for (int readers = 1; readers <= 256; readers *= 2) {
+        ServerConfig config = quietConfig<ServerConfig>();
+        config.backlog = 512;
+
+        std::vector<uint64_t> latencies;
+        latencies.reserve(1 << 22);
+        ReaderServer server(config);
+        server.setLatencySink(&latencies);
+        if (!server.start()) {
+            return -1;
+        }
+        ServerThread<ReaderServer> serverThread(server);
+
+        std::vector<int> clients;
+        for (int i = 0; i < readers; i++) {
+            int fd = connectLoopback(server.boundPort());
+            if (fd < 0) {
+                return -1;
+            }
+            clients.push_back(fd);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        // Stream frames round-robin over every reader for the time window
+        uint64_t start = nowNs();
+        uint64_t end = start + static_cast<uint64_t>(windowMs) * 1000000ULL;
+        while (nowNs() < end) {
+            for (int fd : clients) {
+                if (write(fd, frame.data(), frame.size()) < 0) {
+                    perror("Write failed");
+                    return -1;
+                }
+            }
+        }
+        uint64_t elapsed = nowNs() - start;
+
+        // Give the server time to drain the socket buffers before stopping it
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        serverThread.stop();
+        for (int fd : clients) {
+            close(fd);
+        }
+
+        double framesPerSec = server.totals().frames * 1e9 / elapsed;
+        std::cout << std::left << std::setw(10) << readers << std::setw(14) << static_cast<uint64_t>(framesPerSec)
+                  << std::setw(12) << percentile(latencies, 50) << std::setw(12) << percentile(latencies, 99)
+                  << std::endl;
+    }
+    return 0;
+}
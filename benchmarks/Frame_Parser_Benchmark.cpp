@@ -0,0 +1,263 @@
+/**
+ * Microbenchmark of the binary frame parser against the original hex-string path.
+ *
+ * The original receive loop formatted every byte into two std::stringstreams (one for the csv cell,
+ * one for the clientData vector of hex strings) and converted back with std::stoi() to read Type and
+ * Len and to compute the checksum. legacyHandle() below is that code with the console output removed.
+ * binaryHandle() does the same work with parseFrame(), frameChecksum() and formatHex().
+ *
+ * Both paths produce the csv row, validate the checksum and, for tag reads, build the EPC key.
+ * Reported in ns/frame for heartbeat (0x40), connect (0x3a) and tag-read (0x17) frames.
+ *
+ * Dispatch: a mixed stream of frames of all six types (mostly tag reads) is handed to handlers
+ * through a switch on TYPE and through the compile-time dispatch table (rfid/frame_dispatch.h).
+ * Both count the frames per type and sum the EPC bytes; the counts must match.
+ *
+ * Compile: g++ -std=c++17 -O2 benchmarks/Frame_Parser_Benchmark.cpp -o Frame_Parser_Benchmark
+ * Execute: ./Frame_Parser_Benchmark [iterations]
+*/
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "../rfid/frame_dispatch.h"
+#include "../rfid/frame_parser.h"
+#include "bench_util.h"
+
+static std::vector<std::string> clientData;     // Reused between frames like the original global
+static std::vector<std::string> EPC;
+static const int EPC_len = 12;
+
+static std::string createKey(const std::vector<std::string>& Data) {
+    std::string key;
+    for (const std::string& value : Data) {
+        key += value;
+    }
+    return key;
+}
+
+// The original per-byte hex-string path
+static bool legacyHandle(const uint8_t* buffer, size_t valRead, std::string& csvRow, std::string& key) {
+    for (size_t i = 0; i < valRead; i++) {
+        unsigned char value = buffer[i];
+
+        std::stringstream ss;
+        ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(value);
+        csvRow += ss.str();
+        csvRow += ",";
+
+        std::stringstream valueSS;
+        valueSS << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(value);
+        std::string formattedValue = valueSS.str();
+        clientData.push_back(formattedValue);
+    }
+
+    int TYPE;
+    std::stringstream cs(clientData[1]);
+    cs >> std::hex >> TYPE;
+    int Len_int = std::stoi(clientData[2], nullptr, 16);
+    std::vector<std::string> Data(clientData.begin() + 3, clientData.begin() + 3 + Len_int);
+    std::string CRC = clientData[Len_int + 3];
+
+    int crc_sum = 0;
+    for (int i = 1; i < Len_int + 3; i++) {
+        crc_sum += std::stoi(clientData[i], nullptr, 16);
+    }
+    int checksum_int = crc_sum & 0xFF;
+    std::stringstream crcSS;
+    crcSS << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(checksum_int);
+    std::string checksum = crcSS.str();
+    bool valid = checksum == CRC;
+
+    if (TYPE == 0x17) {
+        EPC.insert(EPC.begin(), Data.begin() + 2, Data.begin() + 2 + EPC_len);
+        key = createKey(EPC);
+        EPC.clear();
+    }
+    clientData.clear();
+    return valid;
+}
+
+// The binary path used by the server
+static bool binaryHandle(const uint8_t* frame, size_t size, char* csvRow, char* key) {
+    FrameView view;
+    if (!parseFrame(frame, size, view)) {
+        return false;
+    }
+    formatHex(csvRow, frame, size, ',');
+    bool valid = frameChecksum(frame) == view.crc;
+    ByteSpan epc = frameEpc(view);
+    if (epc.size) {
+        formatHex(key, epc.data, epc.size, 0);
+    }
+    return valid;
+}
+
+// Frame counts per type and a sum over the EPC bytes, filled by both dispatch paths
+struct DispatchCounts {
+    uint64_t types[8] = {};
+    uint64_t epcSum = 0;
+
+    bool operator==(const DispatchCounts& other) const {
+        return std::equal(types, types + 8, other.types) && epcSum == other.epcSum;
+    }
+};
+
+static void countTagRead(DispatchCounts& counts, const uint8_t* epc) {
+    counts.types[1]++;
+    for (int i = 0; i < EPC_LEN; i++) {
+        counts.epcSum += epc[i];
+    }
+}
+
+// The hard-coded switch the server used before the dispatch table
+static void switchDispatch(DispatchCounts& counts, const FrameView& view) {
+    switch (view.type) {
+        case FRAME_TYPE_CONNECT:
+            counts.types[0]++;
+            break;
+        case FRAME_TYPE_TAG_READ:
+            if (view.len < EPC_OFFSET + EPC_LEN) {
+                counts.types[7]++;
+                break;
+            }
+            countTagRead(counts, view.data.data + EPC_OFFSET);
+            break;
+        case FRAME_TYPE_HEARTBEAT:
+            counts.types[2]++;
+            break;
+        case FRAME_TYPE_INVENTORY_END:
+            counts.types[3]++;
+            break;
+        case FRAME_TYPE_ANTENNA_STATUS:
+            counts.types[4]++;
+            break;
+        case FRAME_TYPE_ERROR:
+            counts.types[5]++;
+            break;
+        default:
+            counts.types[6]++;
+            break;
+    }
+}
+
+template <typename Frame, int Index>
+static void countFrame(DispatchCounts& counts, const Frame&) {
+    counts.types[Index]++;
+}
+
+static void onTagRead(DispatchCounts& counts, const TagReadFrame& frame) {
+    countTagRead(counts, frame.epc);
+}
+
+static void onUnknown(DispatchCounts& counts, const FrameView&) {
+    counts.types[6]++;
+}
+
+static void onMalformed(DispatchCounts& counts, const FrameView&) {
+    counts.types[7]++;
+}
+
+using BenchmarkFrameTypes = FrameDispatcher<DispatchCounts, onUnknown, onMalformed,
+                                            FrameHandler<ConnectFrame, countFrame<ConnectFrame, 0>>,
+                                            FrameHandler<TagReadFrame, onTagRead>,
+                                            FrameHandler<HeartbeatFrame, countFrame<HeartbeatFrame, 2>>,
+                                            FrameHandler<InventoryEndFrame, countFrame<InventoryEndFrame, 3>>,
+                                            FrameHandler<AntennaStatusFrame, countFrame<AntennaStatusFrame, 4>>,
+                                            FrameHandler<ReaderErrorFrame, countFrame<ReaderErrorFrame, 5>>>;
+
+static bool dispatchBenchmark(long iterations) {
+    // 1024 frames: 90% tag reads with different EPCs, the rest spread over the other types
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<uint8_t> tagData(sampleFrames::tagRead().begin() + 3, sampleFrames::tagRead().end() - 3);
+    uint32_t state = 1;
+    for (int i = 0; i < 1024; i++) {
+        state = state * 1103515245 + 12345;
+        int pick = (state >> 16) % 100;
+        if (pick < 90) {
+            tagData[EPC_OFFSET + EPC_LEN - 1] = static_cast<uint8_t>(state >> 8);
+            frames.push_back(makeFrame(FRAME_TYPE_TAG_READ, tagData));
+        } else if (pick < 93) {
+            frames.push_back(sampleFrames::heartbeat());
+        } else if (pick < 94) {
+            frames.push_back(sampleFrames::connect());
+        } else if (pick < 96) {
+            frames.push_back(makeFrame(FRAME_TYPE_INVENTORY_END, {0x00, 0x2a}));
+        } else if (pick < 97) {
+            frames.push_back(makeFrame(FRAME_TYPE_ANTENNA_STATUS, {0x01, 0x00}));
+        } else if (pick < 98) {
+            frames.push_back(makeFrame(FRAME_TYPE_ERROR, {0x05}));
+        } else if (pick < 99) {
+            frames.push_back(makeFrame(0x22, {0x00}));                          // Unknown type
+        } else {
+            frames.push_back(makeFrame(FRAME_TYPE_TAG_READ, {0x30, 0x00, 0xe2}));  // Too short for an EPC
+        }
+    }
+    std::vector<FrameView> views(frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        parseFrame(frames[i].data(), frames[i].size(), views[i]);
+    }
+
+    long rounds = std::max(1L, iterations / 50);
+    DispatchCounts switched, table;
+    uint64_t start = nowNs();
+    for (long round = 0; round < rounds; round++) {
+        for (const FrameView& view : views) {
+            switchDispatch(switched, view);
+        }
+    }
+    double switchNs = double(nowNs() - start) / (rounds * views.size());
+    start = nowNs();
+    for (long round = 0; round < rounds; round++) {
+        for (const FrameView& view : views) {
+            BenchmarkFrameTypes::dispatch(table, view);
+        }
+    }
+    double tableNs = double(nowNs() - start) / (rounds * views.size());
+
+    std::cout << std::endl << "dispatch (mixed frames)  switch: " << std::fixed << std::setprecision(2) << switchNs
+              << " ns/frame, table: " << tableNs << " ns/frame, counts "
+              << (switched == table ? "match" : "MISMATCH") << std::endl;
+    return switched == table;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = argc > 1 ? std::atol(argv[1]) : 200000;
+    struct Case { const char* name; std::vector<uint8_t> frame; };
+    std::vector<Case> cases = {
+        {"heartbeat (0x40)", sampleFrames::heartbeat()},
+        {"connect (0x3a)", sampleFrames::connect()},
+        {"tag read (0x17)", sampleFrames::tagRead()},
+    };
+
+    std::cout << std::left << std::setw(20) << "frame" << std::setw(18) << "legacy ns/frame"
+              << std::setw(18) << "binary ns/frame" << "speedup" << std::endl;
+
+    volatile unsigned long sink = 0;
+    for (const Case& c : cases) {
+        std::string csvRow, key;
+        uint64_t start = nowNs();
+        for (long i = 0; i < iterations; i++) {
+            csvRow.clear();
+            sink += legacyHandle(c.frame.data(), c.frame.size(), csvRow, key);
+        }
+        double legacyNs = double(nowNs() - start) / iterations;
+
+        char row[3 * MAX_FRAME_SIZE];
+        char epcKey[2 * EPC_LEN];
+        start = nowNs();
+        for (long i = 0; i < iterations * 20; i++) {
+            sink += binaryHandle(c.frame.data(), c.frame.size(), row, epcKey);
+        }
+        double binaryNs = double(nowNs() - start) / (iterations * 20);
+
+        std::cout << std::left << std::setw(20) << c.name << std::setw(18) << std::fixed << std::setprecision(1)
+                  << legacyNs << std::setw(18) << binaryNs << std::setprecision(1) << legacyNs / binaryNs << "x"
+                  << std::endl;
+    }
+    bool ok = dispatchBenchmark(iterations);
+    return sink == 0 || !ok;
+}
@@ -0,0 +1,162 @@
+/**
+ * Receive path cost with epoll and read() against the io_uring backend (rfid/uring_receiver.h).
+ *
+ * The server runs in-process on a loopback port, once per backend and round (the backends
+ * alternate). 1, 16 and 64 readers send tag-read frames one frame per write(), the way a reader
+ * sends a tag as soon as it is read, under two loads:
+ *      paced:      200k frames/sec in total, spread over the readers. The loop keeps up, so a
+ *                  receive mostly carries the frames of one write() (the usual case).
+ *      flood:      as fast as the server takes them. Frames pile up in the socket buffers and
+ *                  one receive carries many of them.
+ *
+ * Reported per load, backend and number of readers (median of the rounds):
+ *      syscalls/frame:     epoll_wait(), read() and io_uring_enter() calls of the event loop per frame
+ *                          (ReaderServer::receiveSyscalls())
+ *      receives/frame:     read() calls or receive completions per frame (how many frames one
+ *                          receive carried)
+ *      CPU ns/frame:       CPU time of the event loop thread per frame (CLOCK_THREAD_CPUTIME_ID; the
+ *                          kernel's receive work for the ring runs in this thread as well)
+ *      frames/sec:         from the first connect to the last frame handled
+ *
+ * Check: every run must handle every frame that was sent.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Io_Uring_Benchmark.cpp -o Io_Uring_Benchmark
+ * Execute: ./Io_Uring_Benchmark [paced_frames] [flood_frames] [rounds]
+*/
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+
+#include "../rfid/reader_server.h"
+#include "bench_util.h"
+
+#define PACED_RATE 200000     // Frames/sec of all readers together under the paced load
+
+struct RunResult {
+    double syscallsPerFrame = 0;
+    double receivesPerFrame = 0;
+    double cpuNsPerFrame = 0;
+    double framesPerSecond = 0;
+    bool ioUring = false;
+    bool ok = false;
+};
+
+// One run: readers send frames in total (rate frames/sec, 0 = as fast as possible)
+static RunResult runOnce(bool ioUring, int readers, size_t frames, double rate) {
+    ServerConfig config = quietConfig<ServerConfig>();
+    config.backlog = 512;
+    config.ioUring = ioUring;
+
+    ReaderServer server(config);
+    if (!server.start()) {
+        exit(-1);
+    }
+    ServerThread<ReaderServer> serverThread(server);
+
+    size_t framesPerReader = frames / readers;
+    std::vector<uint8_t> frame = sampleFrames::tagRead();
+    uint64_t start = nowNs();
+    uint64_t intervalNs = rate > 0 ? static_cast<uint64_t>(1e9 * readers / rate) : 0;   // Per reader
+    std::vector<std::thread> senders;
+    for (int r = 0; r < readers; r++) {
+        senders.emplace_back([&, r]() {
+            int fd = connectLoopback(server.boundPort());
+            if (fd < 0) {
+                return;
+            }
+            std::vector<uint8_t> data(frame.begin() + 3, frame.end() - 3);
+            std::vector<std::vector<uint8_t>> writes(64);
+            for (size_t w = 0; w < writes.size(); w++) {
+                uint32_t tag = static_cast<uint32_t>(r * 64 + w) % 1000;
+                memcpy(&data[EPC_OFFSET + EPC_LEN - sizeof(tag)], &tag, sizeof(tag));
+                writes[w] = makeFrame(FRAME_TYPE_TAG_READ, data);
+            }
+            for (size_t sent = 0; sent < framesPerReader; sent++) {
+                uint64_t due = start + sent * intervalNs + r * intervalNs / readers;
+                if (intervalNs && nowNs() < due) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - nowNs()));
+                }
+                const std::vector<uint8_t>& bytes = writes[sent % writes.size()];
+                if (write(fd, bytes.data(), bytes.size()) < 0) {
+                    perror("Write failed");
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            close(fd);
+        });
+    }
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+    double seconds = (nowNs() - start - 300000000ULL) / 1e9;   // Without the senders' final wait
+    serverThread.stop();
+
+    RunResult result;
+    ConnectionCounters totals = server.totals();
+    uint64_t handled = totals.frames;
+    result.ok = handled == framesPerReader * readers && totals.checksumErrors == 0;
+    result.ioUring = server.usesIoUring();
+    if (handled) {
+        result.syscallsPerFrame = static_cast<double>(server.receiveSyscalls()) / handled;
+        result.receivesPerFrame = static_cast<double>(totals.reads) / handled;
+        result.cpuNsPerFrame = static_cast<double>(serverThread.cpuNs()) / handled;
+        result.framesPerSecond = seconds > 0 ? handled / seconds : 0;
+    }
+    server.shutdown();
+    return result;
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    size_t pacedFrames = argc > 1 ? std::atol(argv[1]) : 200000;
+    size_t floodFrames = argc > 2 ? std::atol(argv[2]) : 1000000;
+    int rounds = argc > 3 ? std::atoi(argv[3]) : 5;
+
+    struct Row {
+        std::vector<double> syscalls, receives, cpu, rate;
+    };
+    bool ok = true, uringUsed = true;
+    std::vector<std::pair<std::string, Row>> rows;
+    for (bool paced : {true, false}) {
+        for (int readers : {1, 16, 64}) {
+            Row epoll, uring;
+            for (int round = 0; round < rounds; round++) {
+                for (bool ioUring : {false, true}) {
+                    RunResult result = paced ? runOnce(ioUring, readers, pacedFrames, PACED_RATE)
+                                             : runOnce(ioUring, readers, floodFrames, 0);
+                    Row& row = ioUring ? uring : epoll;
+                    row.syscalls.push_back(result.syscallsPerFrame);
+                    row.receives.push_back(result.receivesPerFrame);
+                    row.cpu.push_back(result.cpuNsPerFrame);
+                    row.rate.push_back(result.framesPerSecond);
+                    ok = ok && result.ok;
+                    uringUsed = uringUsed && (result.ioUring == ioUring);
+                }
+            }
+            std::string load = paced ? "paced  " : "flood  ";
+            rows.emplace_back(load + "epoll    " + std::to_string(readers), epoll);
+            rows.emplace_back(load + "io_uring " + std::to_string(readers), uring);
+        }
+    }
+
+    std::cout << std::endl << "Check: every frame handled: " << (ok ? "ok" : "MISMATCH") << std::endl;
+    if (!uringUsed) {
+        std::cout << "io_uring was not available, both rows used epoll" << std::endl;
+    }
+    std::cout << std::endl << std::left << std::setw(24) << "load   backend  readers" << std::setw(18) << "syscalls/frame"
+              << std::setw(18) << "receives/frame" << std::setw(16) << "CPU ns/frame" << "frames/sec" << std::endl;
+    for (auto& row : rows) {
+        std::cout << std::left << std::setw(24) << row.first << std::fixed << std::setprecision(3) << std::setw(18)
+                  << median(row.second.syscalls) << std::setw(18) << median(row.second.receives)
+                  << std::setprecision(1) << std::setw(16) << median(row.second.cpu) << std::setprecision(0)
+                  << median(row.second.rate) << std::endl;
+    }
+    return ok ? 0 : -1;
+}
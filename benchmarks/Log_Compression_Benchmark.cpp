@@ -0,0 +1,283 @@
+/**
+ * Compression ratio, throughput and CPU cost of the compressed csv logs (rfid/log_compression.h).
+ *
+ * The traffic is tag-read heavy like a dock door: 1M frames, 98% tag reads and 2% heartbeats. There
+ * are 10000 EPCs with a shared 6-byte prefix (one manufacturer and batch) and random serials, read
+ * with Zipf 1.0 popularity, with the RSSI and antenna varying from read to read. The frames are
+ * formatted into the csv layout of the data logs.
+ *
+ * Codec: the csv text is cut into blocks like the logger's batches (64 KiB, 256 KiB = the default
+ * --log-flush-kb, 1 MiB) and every block is compressed and decompressed on its own.
+ *      ratio:          csv bytes / compressed bytes (block headers included)
+ *      bytes/frame:    on disk (the raw frames and the plain csv are printed above the table)
+ *      compress MB/s, decompress MB/s: of csv text, thread CPU time; decompression includes
+ *                      verifying the checksum
+ *      ns/frame:       compression CPU per frame (the CPU of formatting the csv is printed for scale)
+ *
+ * Logger: the frames are logged through FrameLogger (plain and compressed) into a temporary folder.
+ *      bytes/frame:    written to the log file
+ *      logger CPU ns/frame: process CPU minus the logging thread's CPU (the logging thread only
+ *                      copies frames into the queue and sleeps while the queue is half full)
+ *      log() ns:       cost of log() on the receiving thread, which compression must not change
+ *
+ * Checks: every block decompresses to its text; a corrupted block is the only one rejected; the
+ * compressed log file reads back to the same text as the plain one.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Log_Compression_Benchmark.cpp -o Log_Compression_Benchmark
+ * Execute: ./Log_Compression_Benchmark [frames]
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <cstdlib>
+#include <dirent.h>
+
+#include "../rfid/frame_logger.h"
+#include "../rfid/log_compression.h"
+#include "bench_util.h"
+
+#define EPC_COUNT 10000
+
+static int64_t threadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t processCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Tag-read heavy traffic, every frame as a complete 0xBB frame
+static std::vector<std::vector<uint8_t>> makeTraffic(size_t frames) {
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<uint8_t>> epcs(EPC_COUNT);
+    std::vector<double> cumulative(EPC_COUNT);
+    double sum = 0;
+    for (size_t k = 0; k < EPC_COUNT; k++) {
+        epcs[k] = {0xe2, 0x00, 0x00, 0x1d, 0x25, 0x03};
+        for (int i = 0; i < 6; i++) {
+            epcs[k].push_back(static_cast<uint8_t>(rng()));
+        }
+        sum += 1.0 / (k + 1);
+        cumulative[k] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0, sum);
+
+    std::vector<std::vector<uint8_t>> traffic;
+    traffic.reserve(frames);
+    for (size_t i = 0; i < frames; i++) {
+        if (rng() % 50 == 0) {
+            traffic.push_back(sampleFrames::heartbeat());
+            continue;
+        }
+        size_t k = std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng)) - cumulative.begin();
+        const std::vector<uint8_t>& epc = epcs[std::min<size_t>(k, EPC_COUNT - 1)];
+        std::vector<uint8_t> data = {0x30, 0x00};
+        data.insert(data.end(), epc.begin(), epc.end());
+        data.push_back(static_cast<uint8_t>(epc[11] * 7 + 0x75));      // Tag CRC, fixed per tag
+        data.push_back(static_cast<uint8_t>(epc[10] * 13 + 0x8d));
+        data.push_back(static_cast<uint8_t>(0x18 + rng() % 16));        // RSSI
+        data.push_back(0x1f);
+        data.push_back(static_cast<uint8_t>(1 + rng() % 4));            // Antenna
+        traffic.push_back(makeFrame(0x17, data));
+    }
+    return traffic;
+}
+
+struct CodecResult {
+    size_t blockBytes = 0;
+    double ratio = 0;
+    double bytesPerFrame = 0;
+    double compressMBs = 0;
+    double decompressMBs = 0;
+    double compressNsPerFrame = 0;
+    bool ok = true;
+};
+
+static CodecResult runCodec(const std::string& csv, size_t frames, size_t blockBytes) {
+    CodecResult result;
+    result.blockBytes = blockBytes;
+    LzCompressor compressor;
+    std::vector<uint8_t> stored;
+    stored.reserve(csv.size() + csv.size() / 8);
+    std::vector<uint8_t> block(sizeof(LzBlockHeader) + lzCompressBound(blockBytes));
+
+    // Blocks end at a row end, like the logger's batches
+    const uint8_t* text = reinterpret_cast<const uint8_t*>(csv.data());
+    int64_t start = threadCpuNs();
+    for (size_t offset = 0; offset < csv.size();) {
+        size_t size = std::min(blockBytes, csv.size() - offset);
+        while (offset + size < csv.size() && text[offset + size - 1] != '\n') {
+            size--;
+        }
+        size_t blockSize = compressor.encodeBlock(text + offset, size, block.data());
+        stored.insert(stored.end(), block.begin(), block.begin() + blockSize);
+        offset += size;
+    }
+    int64_t compressNs = threadCpuNs() - start;
+
+    std::vector<uint8_t> scratch;
+    size_t compared = 0;
+    LzReadStats stats;
+    start = threadCpuNs();
+    bool intact = readLzBlocks(stored.data(), stored.size(), scratch, stats, [&](const uint8_t* block, size_t size) {
+        result.ok = result.ok && compared + size <= csv.size() && memcmp(block, text + compared, size) == 0;
+        compared += size;
+    });
+    int64_t decompressNs = threadCpuNs() - start;
+    result.ok = result.ok && intact && compared == csv.size();
+
+    // A corrupted block must be the only one lost
+    if (stats.blocks > 2) {
+        std::vector<uint8_t> corrupted = stored;
+        LzBlockHeader first;
+        memcpy(&first, corrupted.data(), sizeof(first));
+        corrupted[sizeof(first) + first.storedBytes + sizeof(first) + 10] ^= 0x01;
+        LzReadStats corruptedStats;
+        readLzBlocks(corrupted.data(), corrupted.size(), scratch, corruptedStats, [](const uint8_t*, size_t) {});
+        result.ok = result.ok && corruptedStats.badBlocks == 1 && corruptedStats.blocks == stats.blocks - 1;
+    }
+
+    result.ratio = static_cast<double>(csv.size()) / stored.size();
+    result.bytesPerFrame = static_cast<double>(stored.size()) / frames;
+    result.compressMBs = csv.size() / (compressNs / 1e9) / 1e6;
+    result.decompressMBs = csv.size() / (decompressNs / 1e9) / 1e6;
+    result.compressNsPerFrame = static_cast<double>(compressNs) / frames;
+    return result;
+}
+
+struct LoggerResult {
+    double bytesPerFrame = 0;
+    double loggerCpuNsPerFrame = 0;
+    double logCallNs = 0;
+    uint64_t dropped = 0;
+    std::string text;               // The log read back as csv
+};
+
+static std::string readLogFolder(const std::string& folder) {
+    std::string text;
+    DIR* dir = opendir(folder.c_str());
+    if (!dir) {
+        return text;
+    }
+    std::vector<std::string> files;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            files.push_back(folder + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    std::vector<uint8_t> scratch;
+    for (const std::string& file : files) {
+        std::ifstream in(file, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (file.size() > 4 && file.compare(file.size() - 4, 4, LZ_LOG_EXTENSION) == 0) {
+            LzReadStats stats;
+            readLzBlocks(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), scratch, stats,
+                         [&text](const uint8_t* block, size_t size) { text.append(reinterpret_cast<const char*>(block), size); });
+        } else {
+            text += bytes;
+        }
+        unlink(file.c_str());
+    }
+    rmdir(folder.c_str());
+    return text;
+}
+
+static LoggerResult runLogger(const std::vector<std::vector<uint8_t>>& traffic, bool compress) {
+    LoggerConfig config;
+    config.folder = "/tmp/rfid_log_compression_bench_" + std::to_string(getpid());
+    config.compress = compress;
+    config.rotateSeconds = 0;
+    FrameLogger logger(config);
+    if (!logger.start()) {
+        exit(-1);
+    }
+
+    int64_t processStart = processCpuNs();
+    int64_t threadStart = threadCpuNs();
+    uint64_t logNs = 0;
+    for (size_t i = 0; i < traffic.size(); i++) {
+        uint64_t before = nowNs();
+        logger.log(traffic[i].data(), traffic[i].size(), static_cast<int64_t>(before), 1);
+        logNs += nowNs() - before;
+        if (i % 1024 == 0) {
+            while (logger.stats().queueDepth > config.queueSize / 2) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+    logger.stop();
+    int64_t loggerCpuNs = (processCpuNs() - processStart) - (threadCpuNs() - threadStart);
+
+    LoggerStats stats = logger.stats();
+    LoggerResult result;
+    result.bytesPerFrame = static_cast<double>(stats.bytesWritten) / traffic.size();
+    result.loggerCpuNsPerFrame = static_cast<double>(loggerCpuNs) / traffic.size();
+    result.logCallNs = static_cast<double>(logNs) / traffic.size();
+    result.dropped = stats.dropped;
+    result.text = readLogFolder(config.folder);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    size_t frames = argc > 1 ? std::atol(argv[1]) : 1000000;
+    std::vector<std::vector<uint8_t>> traffic = makeTraffic(frames);
+
+    // The csv text exactly as the logger formats it
+    size_t rawBytes = 0;
+    std::string csv;
+    csv.reserve(frames * 3 * 25);
+    char row[3 * MAX_FRAME_SIZE + 1];
+    int64_t start = threadCpuNs();
+    for (const std::vector<uint8_t>& frame : traffic) {
+        char* end = formatHex(row, frame.data(), frame.size(), ',');
+        *end++ = '\n';
+        csv.append(row, end - row);
+        rawBytes += frame.size();
+    }
+    double formatNsPerFrame = static_cast<double>(threadCpuNs() - start) / frames;
+
+    bool ok = true;
+    std::vector<CodecResult> codec;
+    for (size_t blockBytes : {64u << 10, 256u << 10, 1u << 20}) {
+        codec.push_back(runCodec(csv, frames, blockBytes));
+        ok = ok && codec.back().ok;
+    }
+    LoggerResult plain = runLogger(traffic, false);
+    LoggerResult compressed = runLogger(traffic, true);
+    bool sameText = plain.text == csv && compressed.text == csv;
+
+    std::cout << "Check: every block decompresses to its text, a corrupted block is the only one lost: "
+              << (ok ? "ok" : "MISMATCH") << std::endl;
+    std::cout << "Check: the compressed log reads back to the same csv as the plain log: "
+              << (sameText ? "ok" : "MISMATCH") << std::endl;
+
+    std::cout << std::endl << frames << " frames: " << std::fixed << std::setprecision(1)
+              << static_cast<double>(rawBytes) / frames << " bytes/frame raw, "
+              << static_cast<double>(csv.size()) / frames << " bytes/frame as csv (formatting: "
+              << formatNsPerFrame << " ns/frame)" << std::endl << std::endl;
+    std::cout << std::left << std::setw(12) << "block" << std::setw(10) << "ratio" << std::setw(14) << "bytes/frame"
+              << std::setw(16) << "compress MB/s" << std::setw(18) << "decompress MB/s" << "compress ns/frame" << std::endl;
+    for (const CodecResult& result : codec) {
+        std::cout << std::left << std::setw(12) << (std::to_string(result.blockBytes >> 10) + " KiB")
+                  << std::setprecision(2) << std::setw(10) << result.ratio << std::setprecision(1) << std::setw(14)
+                  << result.bytesPerFrame << std::setprecision(0) << std::setw(16) << result.compressMBs
+                  << std::setw(18) << result.decompressMBs << std::setprecision(1) << result.compressNsPerFrame << std::endl;
+    }
+
+    std::cout << std::endl << std::left << std::setw(14) << "logger" << std::setw(14) << "bytes/frame"
+              << std::setw(22) << "logger CPU ns/frame" << std::setw(12) << "log() ns" << "dropped" << std::endl;
+    for (const auto& [name, result] : {std::make_pair("csv", &plain), std::make_pair("csv.rlz", &compressed)}) {
+        std::cout << std::left << std::setw(14) << name << std::setprecision(1) << std::setw(14) << result->bytesPerFrame
+                  << std::setw(22) << result->loggerCpuNsPerFrame << std::setw(12) << result->logCallNs
+                  << result->dropped << std::endl;
+    }
+    return ok && sameText ? 0 : -1;
+}
@@ -0,0 +1,125 @@
+/**
+ * Overhead of the metrics instrumentation on the frame handling cost.
+ *
+ * The server runs in-process on a loopback port with metrics off and on (on = publish timer,
+ * recv-to-parsed histogram on one read in LATENCY_SAMPLE_READS and a scrape of the HTTP endpoint every
+ * 100 ms). 8 readers
+ * send a fixed number of tag-read frames (1000 distinct EPCs), first one frame per write() (the
+ * worst case: the per-read instrumentation is paid by every frame) and then 16 frames per write().
+ *
+ * The cost is the CPU time of the server's event loop thread (CLOCK_THREAD_CPUTIME_ID, so time
+ * waiting in epoll_wait() and the sender and scraper threads do not count) per handled frame. Off
+ * and on runs alternate and the median of the rounds is reported.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Metrics_Overhead_Benchmark.cpp -o Metrics_Overhead_Benchmark
+ * Execute: ./Metrics_Overhead_Benchmark [frames_per_reader] [rounds]
+*/
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+
+#include "../rfid/reader_server.h"
+#include "bench_util.h"
+
+#define READERS 8
+
+// GET /metrics and throw the answer away
+static void scrape(int port) {
+    int fd = connectLoopback(port);
+    if (fd < 0) {
+        return;
+    }
+    const char request[] = "GET /metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    if (write(fd, request, sizeof(request) - 1) > 0) {
+        char buffer[65536];
+        while (read(fd, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+    close(fd);
+}
+
+// Server thread CPU ns per handled frame for one run
+static double runOnce(bool metrics, size_t framesPerReader, size_t framesPerWrite) {
+    ServerConfig config = quietConfig<ServerConfig>();
+    config.metricsPort = metrics ? 0 : -1;
+
+    ReaderServer server(config);
+    if (!server.start()) {
+        exit(-1);
+    }
+    ServerThread<ReaderServer> serverThread(server);
+
+    std::atomic<bool> scraping{metrics};
+    std::thread scraper([&]() {
+        while (scraping.load()) {
+            scrape(server.metricsPort());
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    });
+
+    std::vector<std::thread> senders;
+    for (int r = 0; r < READERS; r++) {
+        senders.emplace_back([&, r]() {
+            int fd = connectLoopback(server.boundPort());
+            if (fd < 0) {
+                return;
+            }
+            std::vector<uint8_t> frame = sampleFrames::tagRead();
+            std::vector<uint8_t> data(frame.begin() + 3, frame.end() - 3);
+            std::vector<std::vector<uint8_t>> writes(64);
+            for (size_t w = 0; w < writes.size(); w++) {
+                for (size_t f = 0; f < framesPerWrite; f++) {
+                    uint32_t tag = static_cast<uint32_t>((r * 64 + w) * framesPerWrite + f) % 1000;
+                    memcpy(&data[EPC_OFFSET + EPC_LEN - sizeof(tag)], &tag, sizeof(tag));
+                    std::vector<uint8_t> next = makeFrame(FRAME_TYPE_TAG_READ, data);
+                    writes[w].insert(writes[w].end(), next.begin(), next.end());
+                }
+            }
+            for (size_t sent = 0, w = 0; sent < framesPerReader; sent += framesPerWrite, w++) {
+                const std::vector<uint8_t>& bytes = writes[w % writes.size()];
+                if (write(fd, bytes.data(), bytes.size()) < 0) {
+                    perror("Write failed");
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            close(fd);
+        });
+    }
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+    scraping.store(false);
+    scraper.join();
+    serverThread.stop();
+
+    uint64_t frames = server.totals().frames;
+    return frames ? static_cast<double>(serverThread.cpuNs()) / frames : 0;
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    size_t framesPerReader = argc > 1 ? std::atol(argv[1]) : 200000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::cout << std::left << std::setw(18) << "frames/write" << std::setw(16) << "off (ns/frame)"
+              << std::setw(16) << "on (ns/frame)" << "overhead" << std::endl;
+    for (size_t framesPerWrite : {1, 16}) {
+        std::vector<double> off, on;
+        for (int round = 0; round < rounds; round++) {
+            off.push_back(runOnce(false, framesPerReader, framesPerWrite));
+            on.push_back(runOnce(true, framesPerReader, framesPerWrite));
+        }
+        double offNs = median(off), onNs = median(on);
+        std::cout << std::left << std::setw(18) << framesPerWrite << std::setw(16) << std::fixed
+                  << std::setprecision(1) << offNs << std::setw(16) << onNs << std::setprecision(2)
+                  << 100.0 * (onNs - offNs) / offNs << "%" << std::endl;
+    }
+    return 0;
+}
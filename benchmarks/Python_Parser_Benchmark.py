@@ -0,0 +1,139 @@
+"""
+Frames/sec of the Python server's parsing against the C++ extension module (rfid_native.cpp).
+
+The stream is 200K frames (90% tag reads of 1000 EPCs, 10% heartbeats, 1% corrupt checksums), cut
+into recv(1024) sized chunks like TCP_Server_Example.py receives them. Each path counts the reads
+of every tag:
+
+    hex join:           ' '.join(hex(x) for x in chunk), what the server prints now (no counting)
+    python slicing:     the Head/Type/Len/Data/CRC slicing and sum() checksum of TCP_Server_Example.py,
+                        with a bytearray carrying frames cut off at a chunk end
+    parse_frames:       rfid_native.parse_frames() finds and validates the frames, Python counts the
+                        EPCs sliced from a memoryview
+    TagCounter.feed:    parsing and counting in C++
+
+Check: the tag counts of every path must be equal.
+
+Compile: g++ -std=c++17 -O2 -pthread -shared -fPIC $(python3-config --includes) rfid_native.cpp -o rfid_native$(python3-config --extension-suffix)
+Execute: python3 benchmarks/Python_Parser_Benchmark.py [frames]
+"""
+import os
+import random
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import rfid_native
+
+CHUNK_SIZE = 1024
+
+
+def make_frame(frame_type, data):
+    body = bytes([frame_type, len(data)]) + data
+    return b"\xbb" + body + bytes([sum(body) & 0xFF]) + b"\r\n"
+
+
+def make_stream(frames):
+    rng = random.Random(7)
+    epcs = [bytes(rng.randrange(256) for _ in range(12)) for _ in range(1000)]
+    stream = bytearray()
+    for _ in range(frames):
+        if rng.random() < 0.9:
+            frame = bytearray(make_frame(0x17, b"\x30\x00" + rng.choice(epcs) + b"\x75\x8d\x20\x1f\x01"))
+        else:
+            frame = bytearray(make_frame(0x40, b"\x00\x01"))
+        if rng.random() < 0.01:
+            frame[-3] ^= 0x55
+        stream += frame
+    return bytes(stream)
+
+
+def hex_join(chunks):
+    for chunk in chunks:
+        ' '.join(hex(x) for x in chunk)
+    return None
+
+
+def python_slicing(chunks):
+    counts = {}
+    pending = bytearray()
+    for chunk in chunks:
+        pending += chunk
+        i = 0
+        while True:
+            i = pending.find(0xBB, i)
+            if i < 0 or len(pending) - i < 3:
+                break
+            Len = pending[i + 2]
+            end = i + 3 + Len + 3
+            if end > len(pending):
+                break
+            Type = pending[i + 1]
+            Data = pending[i + 3:i + 3 + Len]
+            CRC = pending[i + 3 + Len]
+            if pending[end - 2:end] != b"\r\n" or sum(pending[i + 1:i + 3 + Len]) & 0xFF != CRC:
+                i += 1
+                continue
+            if Type == 0x17 and Len >= 14:
+                epc = bytes(Data[2:14])
+                counts[epc] = counts.get(epc, 0) + 1
+            i = end
+        del pending[:i if i >= 0 else len(pending)]
+    return counts
+
+
+def native_parse_frames(chunks):
+    counts = {}
+    pending = bytearray()
+    for chunk in chunks:
+        pending += chunk
+        frames, consumed = rfid_native.parse_frames(pending)
+        view = memoryview(pending)
+        for frame_type, offset, length, ok in frames:
+            if ok and frame_type == 0x17 and length >= 14:
+                epc = bytes(view[offset + 2:offset + 14])
+                counts[epc] = counts.get(epc, 0) + 1
+        view.release()
+        del pending[:consumed]
+    return counts
+
+
+def native_tag_counter(chunks):
+    counter = rfid_native.TagCounter()
+    pending = bytearray()
+    for chunk in chunks:
+        pending += chunk
+        del pending[:counter.feed(pending)]
+    return dict(counter.top(len(counter)))
+
+
+def main():
+    frames = int(sys.argv[1]) if len(sys.argv) > 1 else 200000
+    stream = make_stream(frames)
+    chunks = [stream[i:i + CHUNK_SIZE] for i in range(0, len(stream), CHUNK_SIZE)]
+
+    paths = [
+        ("hex join", hex_join),
+        ("python slicing", python_slicing),
+        ("parse_frames", native_parse_frames),
+        ("TagCounter.feed", native_tag_counter),
+    ]
+    results = []
+    for name, run in paths:
+        start = time.perf_counter()
+        counts = run(chunks)
+        results.append((name, time.perf_counter() - start, counts))
+
+    reference = results[1][2]
+    ok = all(counts == reference for _, _, counts in results[2:])
+    print("Check: tag counts equal on every path: " + ("ok" if ok else "MISMATCH"))
+    print()
+    print("%-20s%-16s%-14s%s" % ("path", "frames/sec", "ns/frame", "vs slicing"))
+    slicing = results[1][1]
+    for name, seconds, _ in results:
+        print("%-20s%-16.0f%-14.0f%.1fx" % (name, frames / seconds, seconds / frames * 1e9, slicing / seconds))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,653 @@
+/**
+ * Loopback RFID reader simulator and end-to-end load benchmark.
+ *
+ * Opens N TCP connections to a running TCP_Server_Example (127.0.0.1:6000 by default) and streams
+ * valid reader frames with correct checksums over all of them, so the server can be load tested
+ * without physical readers. The frames are built from the samples captured from the reader (see
+ * TCP_Server_Example.py): connect (0x3a), heartbeat (0x40) and tag read (0x17) with the EPC replaced
+ * by one of --epcs generated tags.
+ *
+ * Every connection is non-blocking and driven from one event loop. Each write() carries 1 to
+ * --coalesce frames, may be split in two writes (--fragment, cut at a random byte so a frame header,
+ * EPC or trailer straddles two TCP segments) and frames may be sent with a wrong checksum (--corrupt).
+ *
+ * With --answer-us the readers also answer the commands of the server (command_channel.h, e.g.
+ * TCP_Server_Example --configure): every command frame is answered with a frame of the same TYPE
+ * and Data 00 (OK), --answer-us after it arrived. Like a real reader each one works through its
+ * commands one at a time, so a reader with 4 commands answers the last one after 4 x --answer-us.
+ *
+ * Reported at the end of the run:
+ *      - Frames sent per type (and corrupted), bytes and frames/sec. Compare with the server's
+ *        "Received ..." line printed when it is stopped with Ctrl+C.
+ *      - Delivery latency percentiles: the time from write() until the server's socket has taken
+ *        the bytes (the client's unacknowledged send queue, SIOCOUTQ, has drained past them). On
+ *        loopback the bytes are acknowledged as soon as they are queued on the server's socket, so
+ *        this stays in the microseconds while the server keeps up and grows to the time the server
+ *        needs to work through its full receive buffer once it falls behind. It does not include
+ *        the server's own frame handling time (Epoll_Server_Benchmark measures that in-process).
+ *      - With --answer-us: the commands answered and when the last one was answered, counted from the
+ *        first connect. That is how long the server took to configure all readers.
+ *      - CPU usage of the server process (user + system time from /proc/<pid>/stat). The process is
+ *        the one owning the listening socket on --port, or --server-pid.
+ *
+ * Compile: g++ -std=c++17 -O2 benchmarks/RFID_Reader_Simulator.cpp -o RFID_Reader_Simulator
+ * Execute: ./RFID_Reader_Simulator [options]
+ *      --host A            Server address (default 127.0.0.1)
+ *      --port N            Server port (default 6000)
+ *      --readers N         Connections (default 16)
+ *      --seconds S         Length of the run (default 10)
+ *      --rate N            Frames/sec per reader (default 0 = as fast as the server accepts them)
+ *      --mix T:H:C         Weights of tag read, heartbeat and connect frames (default 90:9:1)
+ *      --epcs N            Number of distinct EPCs (default 10000)
+ *      --zipf S            Zipf exponent of the EPC popularity (default 0 = uniform)
+ *      --coalesce N        Up to N frames per write() (default 1)
+ *      --fragment P        Fraction of writes split in two (default 0)
+ *      --corrupt P         Fraction of frames with a wrong checksum (default 0)
+ *      --seed N            Random seed (default 1)
+ *      --answer-us N       Answer the server's commands, N us after each one arrived (default off)
+ *      --server-pid N      Server process for the CPU usage (default: found from --port)
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <random>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+
+#include "../rfid/frame_parser.h"
+#include "../rfid/frame_reassembler.h"
+#include "bench_util.h"
+
+// Command line options
+struct SimulatorOptions {
+    std::string host = "127.0.0.1";
+    int port = 6000;
+    int readers = 16;
+    double seconds = 10;
+    double rate = 0;                // Frames/sec per reader, 0 = unpaced
+    double mix[3] = {90, 9, 1};     // Tag read, heartbeat, connect
+    size_t epcs = 10000;
+    double zipf = 0;
+    int coalesce = 1;
+    double fragment = 0;
+    double corrupt = 0;
+    uint64_t seed = 1;
+    int serverPid = 0;
+    int64_t answerUs = -1;          // Answer commands after this long (-1 = do not read the sockets)
+};
+
+// Frames sent, per type
+struct SimulatorCounters {
+    uint64_t tagReads = 0;
+    uint64_t heartbeats = 0;
+    uint64_t connects = 0;
+    uint64_t corrupted = 0;
+    uint64_t writes = 0;
+    uint64_t fragmented = 0;
+    uint64_t bytes = 0;
+    uint64_t commands = 0;          // Command frames received from the server
+    uint64_t answers = 0;           // Answers written
+    uint64_t lastAnswerNs = 0;
+};
+
+// A command to answer once the reader is done with it
+struct DueAnswer {
+    uint64_t dueNs;
+    uint8_t type;
+};
+
+// A sampled write waiting for the server to take its bytes
+struct PendingSample {
+    uint64_t endOffset;             // Stream offset of the last byte of the write
+    uint64_t sentNs;
+};
+
+struct SimulatedReader {
+    int fd = -1;
+    std::vector<uint8_t> pending;   // Bytes generated but not yet accepted by write()
+    size_t pendingSent = 0;
+    size_t splitAt = 0;             // Fragmented writes stop here first
+    uint64_t streamOffset = 0;      // Bytes accepted by write() so far
+    uint64_t nextDueNs = 0;
+    std::deque<PendingSample> samples;
+    std::unique_ptr<FrameReassembler> received;    // Commands from the server (with --answer-us)
+    std::deque<DueAnswer> answers;
+    uint64_t busyUntilNs = 0;       // The reader works on commands until then
+    uint64_t commands = 0;
+};
+
+// Function prototypes
+bool parseArguments(int argc, char* argv[], SimulatorOptions& options);
+int connectReader(const SimulatorOptions& options);
+int findServerPid(int port);
+bool readProcessCpuTicks(int pid, uint64_t& ticks);
+bool receiveCommands(SimulatedReader& reader, const SimulatorOptions& options, uint64_t now, SimulatorCounters& counters);
+
+// Set by Ctrl+C to end the run early
+volatile sig_atomic_t interrupted = 0;
+
+/* EPC popularity
+
+Uniform, or Zipf distributed: the EPC with rank k is read with a probability proportional to
+1 / k^s. Drawing an EPC is a binary search of a uniform random number in the cumulative distribution.
+*/
+class EpcPopulation {
+public:
+    EpcPopulation(size_t count, double zipf) {
+        if (zipf > 0) {
+            cumulative_.resize(count);
+            double sum = 0;
+            for (size_t k = 0; k < count; k++) {
+                sum += 1.0 / std::pow(static_cast<double>(k + 1), zipf);
+                cumulative_[k] = sum;
+            }
+            for (double& value : cumulative_) {
+                value /= sum;
+            }
+        }
+        count_ = count;
+    }
+
+    uint32_t draw(std::mt19937_64& rng) const {
+        if (cumulative_.empty()) {
+            return static_cast<uint32_t>(rng() % count_);
+        }
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        size_t index = std::lower_bound(cumulative_.begin(), cumulative_.end(), u) - cumulative_.begin();
+        return static_cast<uint32_t>(std::min(index, count_ - 1));
+    }
+
+private:
+    size_t count_;
+    std::vector<double> cumulative_;
+};
+
+/* Frame generator
+
+Keeps one template of each frame type and only patches the EPC (last 4 bytes = tag number) and the
+checksum of the tag read template, so a frame costs a memcpy rather than an allocation.
+*/
+class FrameGenerator {
+public:
+    FrameGenerator(const SimulatorOptions& options)
+        : options_(options), population_(options.epcs, options.zipf), rng_(options.seed),
+          typeDistribution_({options.mix[0], options.mix[1], options.mix[2]}) {
+        templates_[0] = sampleFrames::tagRead();
+        templates_[1] = sampleFrames::heartbeat();
+        templates_[2] = sampleFrames::connect();
+    }
+
+    std::mt19937_64& rng() { return rng_; }
+
+    // Append one frame to out
+    void append(std::vector<uint8_t>& out, SimulatorCounters& counters) {
+        int type = typeDistribution_(rng_);
+        std::vector<uint8_t>& frame = templates_[type];
+        size_t start = out.size();
+        out.insert(out.end(), frame.begin(), frame.end());
+        uint8_t* bytes = out.data() + start;
+
+        if (type == 0) {
+            uint32_t tag = population_.draw(rng_);
+            uint8_t* epc = bytes + FRAME_HEADER_SIZE + EPC_OFFSET;
+            for (int i = 0; i < 4; i++) {
+                epc[EPC_LEN - 1 - i] = static_cast<uint8_t>(tag >> (8 * i));
+            }
+            bytes[frame.size() - 3] = frameChecksum(bytes);
+            counters.tagReads++;
+        } else if (type == 1) {
+            counters.heartbeats++;
+        } else {
+            counters.connects++;
+        }
+
+        if (options_.corrupt > 0 && uniform_(rng_) < options_.corrupt) {
+            bytes[frame.size() - 3] ^= 0x5A;
+            counters.corrupted++;
+        }
+    }
+
+    double uniform() { return uniform_(rng_); }
+
+private:
+    const SimulatorOptions& options_;
+    EpcPopulation population_;
+    std::mt19937_64 rng_;
+    std::discrete_distribution<int> typeDistribution_;
+    std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+    std::vector<uint8_t> templates_[3];
+};
+
+// Stop the run early on Ctrl+C and still print the results
+void signalHandler(int signal) {
+    (void)signal;
+    interrupted = 1;
+}
+
+int main(int argc, char* argv[]) {
+    SimulatorOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--host A] [--port N] [--readers N] [--seconds S] [--rate N]"
+                  << " [--mix T:H:C] [--epcs N] [--zipf S] [--coalesce N] [--fragment P] [--corrupt P]"
+                  << " [--seed N] [--server-pid N] [--answer-us N]" << std::endl;
+        return -1;
+    }
+    signal(SIGINT, signalHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    int serverPid = options.serverPid ? options.serverPid : findServerPid(options.port);
+    uint64_t cpuStart = 0;
+    bool haveCpu = serverPid > 0 && readProcessCpuTicks(serverPid, cpuStart);
+
+    std::vector<SimulatedReader> readers(options.readers);
+    uint64_t firstConnect = nowNs();
+    for (SimulatedReader& reader : readers) {
+        reader.fd = connectReader(options);
+        if (reader.fd < 0) {
+            return -1;
+        }
+        if (options.answerUs >= 0) {
+            reader.received = std::make_unique<FrameReassembler>();
+            if (!reader.received->init(4096)) {
+                return -1;
+            }
+        }
+    }
+
+    FrameGenerator generator(options);
+    SimulatorCounters counters;
+    std::vector<uint64_t> latencies;
+    latencies.reserve(1 << 20);
+    std::vector<struct pollfd> pollFds;
+    uint64_t intervalNs = options.rate > 0 ? static_cast<uint64_t>(1e9 / options.rate) : 0;
+    uint64_t start = nowNs();
+    uint64_t end = start + static_cast<uint64_t>(options.seconds * 1e9);
+    // Stagger the paced readers over one interval so they do not all send at the same instant
+    for (size_t i = 0; i < readers.size(); i++) {
+        readers[i].nextDueNs = start + intervalNs * i / readers.size();
+    }
+
+    uint64_t now = start;
+    uint64_t lastLatencyCheck = 0;
+    uint64_t lastCommandCheck = 0;
+    while (!interrupted && (now = nowNs()) < end) {
+        bool progress = false;
+        uint64_t nextDue = end;
+
+        // Every 100 us while busy sending (and before waiting, below): did the server send commands?
+        if (options.answerUs >= 0 && now - lastCommandCheck >= 100000) {
+            lastCommandCheck = now;
+            pollFds.clear();
+            for (SimulatedReader& reader : readers) {
+                pollFds.push_back({reader.fd, POLLIN, 0});
+            }
+            if (poll(pollFds.data(), pollFds.size(), 0) > 0) {
+                for (size_t i = 0; i < readers.size(); i++) {
+                    if ((pollFds[i].revents & POLLIN) && !receiveCommands(readers[i], options, now, counters)) {
+                        return -1;
+                    }
+                }
+            }
+        }
+
+        for (SimulatedReader& reader : readers) {
+            // Answers that are due go out as soon as the previous write was fully accepted
+            if (reader.pendingSent == reader.pending.size() && !reader.answers.empty() &&
+                reader.answers.front().dueNs <= now) {
+                reader.pending.clear();
+                reader.pendingSent = 0;
+                while (!reader.answers.empty() && reader.answers.front().dueNs <= now) {
+                    std::vector<uint8_t> answer = makeFrame(reader.answers.front().type, {0x00});
+                    reader.pending.insert(reader.pending.end(), answer.begin(), answer.end());
+                    reader.answers.pop_front();
+                    counters.answers++;
+                }
+                reader.splitAt = reader.pending.size();
+                counters.lastAnswerNs = now;
+            }
+
+            // Generate the next write once the previous one was fully accepted
+            if (reader.pendingSent == reader.pending.size() && now >= reader.nextDueNs) {
+                reader.pending.clear();
+                reader.pendingSent = 0;
+                int frames = 1 + static_cast<int>(generator.rng()() % options.coalesce);
+                for (int i = 0; i < frames; i++) {
+                    generator.append(reader.pending, counters);
+                }
+                reader.splitAt = reader.pending.size();
+                if (options.fragment > 0 && generator.uniform() < options.fragment) {
+                    reader.splitAt = 1 + generator.rng()() % (reader.pending.size() - 1);
+                    counters.fragmented++;
+                }
+                reader.nextDueNs = intervalNs ? reader.nextDueNs + intervalNs * frames : now;
+                // A reader that fell behind its rate does not try to catch up with a burst
+                if (reader.nextDueNs + 100 * intervalNs < now) {
+                    reader.nextDueNs = now;
+                }
+                counters.writes++;
+                if (counters.writes % 16 == 0) {
+                    reader.samples.push_back({reader.streamOffset + reader.pending.size(), now});
+                }
+            }
+
+            // Write what the socket accepts, the two halves of a fragmented write separately
+            while (reader.pendingSent < reader.pending.size()) {
+                size_t limit = reader.pendingSent < reader.splitAt ? reader.splitAt : reader.pending.size();
+                ssize_t n = write(reader.fd, reader.pending.data() + reader.pendingSent, limit - reader.pendingSent);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno != EAGAIN) {
+                        perror("Write failed");
+                        return -1;
+                    }
+                    break;
+                }
+                reader.pendingSent += n;
+                reader.streamOffset += n;
+                counters.bytes += n;
+                progress = true;
+            }
+            if (reader.pendingSent == reader.pending.size()) {
+                nextDue = std::min(nextDue, reader.nextDueNs);
+            }
+            if (!reader.answers.empty()) {
+                nextDue = std::min(nextDue, reader.answers.front().dueNs);
+            }
+        }
+
+        // Every 100 us: which sampled writes did the server take?
+        if (now - lastLatencyCheck >= 100000) {
+            lastLatencyCheck = now;
+            for (SimulatedReader& reader : readers) {
+                if (reader.samples.empty()) {
+                    continue;
+                }
+                int unacknowledged = 0;
+                ioctl(reader.fd, SIOCOUTQ, &unacknowledged);
+                uint64_t taken = reader.streamOffset - unacknowledged;
+                while (!reader.samples.empty() && reader.samples.front().endOffset <= taken) {
+                    latencies.push_back(now - reader.samples.front().sentNs);
+                    reader.samples.pop_front();
+                }
+            }
+        }
+
+        if (progress) {
+            continue;
+        }
+        // Nothing could be written: wait until a socket is writable (or has commands), or the next frame is due
+        pollFds.clear();
+        for (SimulatedReader& reader : readers) {
+            short events = (reader.pendingSent < reader.pending.size() ? POLLOUT : 0) |
+                           (options.answerUs >= 0 ? POLLIN : 0);
+            if (events) {
+                pollFds.push_back({reader.fd, events, 0});
+            }
+        }
+        uint64_t waitNs = nextDue > now ? nextDue - now : 0;
+        if (!pollFds.empty()) {
+            waitNs = std::min<uint64_t>(waitNs, 1000000);
+            int ready = poll(pollFds.data(), pollFds.size(), static_cast<int>(waitNs / 1000000));
+            if (ready > 0 && options.answerUs >= 0) {
+                now = nowNs();
+                lastCommandCheck = now;
+                for (size_t i = 0; i < readers.size(); i++) {
+                    if ((pollFds[i].revents & POLLIN) && !receiveCommands(readers[i], options, now, counters)) {
+                        return -1;
+                    }
+                }
+            }
+        } else if (waitNs > 0) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(waitNs, 1000000)));
+        }
+    }
+    double seconds = (nowNs() - start) / 1e9;
+
+    uint64_t cpuEnd = 0;
+    haveCpu = haveCpu && readProcessCpuTicks(serverPid, cpuEnd);
+    for (SimulatedReader& reader : readers) {
+        close(reader.fd);
+    }
+
+    uint64_t frames = counters.tagReads + counters.heartbeats + counters.connects;
+    std::cout << options.readers << " readers, " << std::fixed << std::setprecision(2) << seconds << " s\n";
+    std::cout << "Sent " << frames << " frames (" << counters.bytes << " bytes in " << counters.writes
+              << " writes, " << counters.fragmented << " fragmented)\n";
+    std::cout << "Tag reads: " << counters.tagReads << ", Heartbeats: " << counters.heartbeats << ", Connect: "
+              << counters.connects << ", Corrupted checksums: " << counters.corrupted << "\n";
+    std::cout << "Throughput: " << static_cast<uint64_t>(frames / seconds) << " frames/s, " << std::setprecision(1)
+              << counters.bytes / seconds / 1e6 << " MB/s\n";
+    std::cout << "Delivery latency (us): p50 " << percentile(latencies, 50) / 1000 << ", p99 "
+              << percentile(latencies, 99) / 1000 << ", p99.9 " << percentile(latencies, 99.9) / 1000 << ", max "
+              << percentile(latencies, 100) / 1000 << " (" << latencies.size() << " samples)\n";
+    if (options.answerUs >= 0) {
+        uint64_t fewest = UINT64_MAX, most = 0;
+        for (const SimulatedReader& reader : readers) {
+            fewest = std::min(fewest, reader.commands);
+            most = std::max(most, reader.commands);
+        }
+        std::cout << "Commands: " << counters.commands << " received (" << fewest << " to " << most
+                  << " per reader), " << counters.answers << " answered";
+        if (counters.answers) {
+            std::cout << ", the last one " << std::setprecision(1) << (counters.lastAnswerNs - firstConnect) / 1e6
+                      << " ms after the first connect";
+        }
+        std::cout << "\n";
+    }
+    if (haveCpu) {
+        double cpuSeconds = static_cast<double>(cpuEnd - cpuStart) / sysconf(_SC_CLK_TCK);
+        std::cout << "Server CPU (pid " << serverPid << "): " << std::setprecision(1) << 100.0 * cpuSeconds / seconds
+                  << "% of one core, " << std::setprecision(0) << cpuSeconds * 1e9 / std::max<uint64_t>(frames, 1)
+                  << " ns/frame\n";
+    } else {
+        std::cout << "Server CPU: unknown (server process not found, use --server-pid)\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
+
+/* Read the commands the server sent to a reader
+
+Every complete command frame with a valid checksum is answered answerUs after the reader finished
+the command before it (a reader handles one command at a time). Returns false if the server closed
+the connection.
+*/
+bool receiveCommands(SimulatedReader& reader, const SimulatorOptions& options, uint64_t now, SimulatorCounters& counters) {
+    FrameReassembler& received = *reader.received;
+    while (true) {
+        ssize_t n = read(reader.fd, received.writePtr(), received.writable());
+        if (n == 0) {
+            std::cerr << "Server closed the connection" << std::endl;
+            return false;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        received.commit(n);
+        FrameStats stats;
+        received.drain(stats, [&](const uint8_t* frame, size_t, bool checksumOk) {
+            if (!checksumOk) {
+                return;
+            }
+            reader.busyUntilNs = std::max(reader.busyUntilNs, now) + options.answerUs * 1000;
+            reader.answers.push_back({reader.busyUntilNs, frame[1]});
+            reader.commands++;
+            counters.commands++;
+        });
+    }
+}
+
+// Connect one non-blocking reader socket
+int connectReader(const SimulatorOptions& options) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));     // Keep fragmented writes apart
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+        std::cerr << "Invalid address: " << options.host << std::endl;
+        close(fd);
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Connect failed");
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/* Find the process listening on the port
+
+/proc/net/tcp and /proc/net/tcp6 list the listening sockets (state 0A) with their inode. The owner
+is the process with a /proc/<pid>/fd entry linking to "socket:[inode]".
+*/
+int findServerPid(int port) {
+    std::string inode;
+    for (const char* table : {"/proc/net/tcp", "/proc/net/tcp6"}) {
+        std::ifstream file(table);
+        std::string line;
+        std::getline(file, line);   // Header
+        while (inode.empty() && std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string slot, local, remote, state, queues, timer, retransmits, uid, timeout, socketInode;
+            fields >> slot >> local >> remote >> state >> queues >> timer >> retransmits >> uid >> timeout >> socketInode;
+            size_t colon = local.rfind(':');
+            if (state == "0A" && colon != std::string::npos && std::stoi(local.substr(colon + 1), nullptr, 16) == port) {
+                inode = socketInode;
+            }
+        }
+    }
+    if (inode.empty()) {
+        return 0;
+    }
+
+    std::string target = "socket:[" + inode + "]";
+    DIR* proc = opendir("/proc");
+    if (!proc) {
+        return 0;
+    }
+    int found = 0;
+    while (struct dirent* process = readdir(proc)) {
+        int pid = std::atoi(process->d_name);
+        if (pid <= 0 || found) {
+            continue;
+        }
+        std::string fdFolder = std::string("/proc/") + process->d_name + "/fd";
+        DIR* fds = opendir(fdFolder.c_str());
+        if (!fds) {
+            continue;
+        }
+        while (struct dirent* fd = readdir(fds)) {
+            char link[64];
+            ssize_t length = readlink((fdFolder + "/" + fd->d_name).c_str(), link, sizeof(link) - 1);
+            if (length > 0 && target.compare(0, std::string::npos, link, length) == 0) {
+                found = pid;
+                break;
+            }
+        }
+        closedir(fds);
+    }
+    closedir(proc);
+    return found;
+}
+
+// utime + stime of a process in clock ticks (fields 14 and 15 of /proc/<pid>/stat)
+bool readProcessCpuTicks(int pid, uint64_t& ticks) {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat;
+    if (!std::getline(file, stat)) {
+        return false;
+    }
+    // The command name (field 2) may contain spaces; the fields after it start past the last ')'
+    size_t nameEnd = stat.rfind(')');
+    if (nameEnd == std::string::npos) {
+        return false;
+    }
+    std::istringstream fields(stat.substr(nameEnd + 2));
+    std::string field;
+    uint64_t utime = 0, stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; i++) {
+        if (i == 14) {
+            utime = std::stoull(field);
+        } else if (i == 15) {
+            stime = std::stoull(field);
+        }
+    }
+    ticks = utime + stime;
+    return true;
+}
+
+bool parseArguments(int argc, char* argv[], SimulatorOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (argument == "--host") {
+            options.host = value;
+        } else if (argument == "--port") {
+            options.port = std::atoi(value);
+        } else if (argument == "--readers") {
+            options.readers = std::max(1, std::atoi(value));
+        } else if (argument == "--seconds") {
+            options.seconds = std::atof(value);
+        } else if (argument == "--rate") {
+            options.rate = std::atof(value);
+        } else if (argument == "--mix") {
+            if (sscanf(value, "%lf:%lf:%lf", &options.mix[0], &options.mix[1], &options.mix[2]) != 3 ||
+                options.mix[0] + options.mix[1] + options.mix[2] <= 0) {
+                return false;
+            }
+        } else if (argument == "--epcs") {
+            options.epcs = std::max(1L, std::atol(value));
+        } else if (argument == "--zipf") {
+            options.zipf = std::atof(value);
+        } else if (argument == "--coalesce") {
+            options.coalesce = std::max(1, std::atoi(value));
+        } else if (argument == "--fragment") {
+            options.fragment = std::atof(value);
+        } else if (argument == "--corrupt") {
+            options.corrupt = std::atof(value);
+        } else if (argument == "--seed") {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (argument == "--server-pid") {
+            options.serverPid = std::atoi(value);
+        } else if (argument == "--answer-us") {
+            options.answerUs = std::max(0L, std::atol(value));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,152 @@
+/**
+ * Throughput scaling of the sharded reader server from 1 to N shards.
+ *
+ * For every shard count (1, 2, 4, ... up to the number of cores, or the count given on the command
+ * line) a ShardedReaderServer runs in-process on a loopback port picked by the kernel. 64 readers
+ * connect and the same number of sender threads as shards stream tag-read frames (8 coalesced frames
+ * per write, 1000 distinct EPCs) over them for a fixed time window.
+ *
+ * Reported per shard count: frames/sec handled by the server, the speedup over 1 shard, how the
+ * kernel spread the connections over the shards (SO_REUSEPORT) and a check that the merged global
+ * EPC_Tag_Counts adds up to the tag reads counted by the shards. The first line names the machine
+ * (CPU model and cores), so a table copied from the output says where it was taken.
+ *
+ * The sender threads run on the same machine, so they take cores away from the shards; on a 4-core
+ * Raspberry Pi the curve flattens before 4 shards. Run RFID_Reader_Simulator from another machine
+ * against TCP_Server_Example --shards N for the server-only numbers.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Sharded_Server_Benchmark.cpp -o Sharded_Server_Benchmark
+ * Execute: ./Sharded_Server_Benchmark [max_shards] [window_ms]
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+
+#include "../rfid/sharded_server.h"
+#include "bench_util.h"
+
+#define READERS 64
+
+// 8 tag reads of different EPCs back to back
+static std::vector<uint8_t> tagBurst(uint32_t seed) {
+    std::vector<uint8_t> burst;
+    std::vector<uint8_t> frame = sampleFrames::tagRead();
+    std::vector<uint8_t> data(frame.begin() + 3, frame.end() - 3);
+    for (uint32_t i = 0; i < 8; i++) {
+        uint32_t tag = (seed * 8 + i) % 1000;
+        memcpy(&data[EPC_OFFSET + EPC_LEN - sizeof(tag)], &tag, sizeof(tag));
+        std::vector<uint8_t> next = makeFrame(FRAME_TYPE_TAG_READ, data);
+        burst.insert(burst.end(), next.begin(), next.end());
+    }
+    return burst;
+}
+
+// CPU model (from /proc/cpuinfo) and online cores
+static std::string machineName() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line, model = "unknown CPU";
+    while (std::getline(cpuinfo, line)) {
+        // "model name" on x86, "Model" (the board) on the Raspberry Pi
+        if (line.rfind("model name", 0) == 0 || line.rfind("Model", 0) == 0) {
+            model = line.substr(line.find(':') + 2);
+        }
+    }
+    return model + ", " + std::to_string(std::thread::hardware_concurrency()) + " cores";
+}
+
+int main(int argc, char* argv[]) {
+    int maxShards = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int windowMs = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    std::cout << machineName() << std::endl;
+    std::cout << std::left << std::setw(8) << "shards" << std::setw(14) << "frames/sec" << std::setw(10) << "speedup"
+              << std::setw(24) << "connections per shard" << "merged counts" << std::endl;
+
+    // 1, 2, 4, ... and maxShards itself
+    std::vector<int> shardCounts;
+    for (int shards = 1; shards < maxShards; shards *= 2) {
+        shardCounts.push_back(shards);
+    }
+    shardCounts.push_back(maxShards);
+
+    double baseline = 0;
+    bool ok = true;
+    for (int shards : shardCounts) {
+        ServerConfig config = quietConfig<ServerConfig>();
+        config.backlog = 512;
+        config.shards = shards;
+
+        ShardedReaderServer server(config);
+        if (!server.start()) {
+            return -1;
+        }
+        ServerThread<ShardedReaderServer> serverThread(server);
+
+        std::vector<int> clients;
+        for (int i = 0; i < READERS; i++) {
+            int fd = connectLoopback(server.boundPort());
+            if (fd < 0) {
+                return -1;
+            }
+            clients.push_back(fd);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        // One sender thread per shard, each writing round-robin over its share of the readers
+        std::atomic<bool> sending{true};
+        std::vector<std::thread> senders;
+        uint64_t start = nowNs();
+        for (int s = 0; s < shards; s++) {
+            senders.emplace_back([&, s]() {
+                std::vector<std::vector<uint8_t>> bursts;
+                for (uint32_t i = 0; i < 16; i++) {
+                    bursts.push_back(tagBurst(s * 16 + i));
+                }
+                for (uint32_t round = 0; sending.load(std::memory_order_relaxed); round++) {
+                    for (int c = s; c < READERS; c += shards) {
+                        const std::vector<uint8_t>& burst = bursts[(round + c) % bursts.size()];
+                        if (write(clients[c], burst.data(), burst.size()) < 0) {
+                            perror("Write failed");
+                            return;
+                        }
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(windowMs));
+        sending.store(false);
+        for (std::thread& sender : senders) {
+            sender.join();
+        }
+        uint64_t elapsed = nowNs() - start;
+
+        // Give the shards time to drain the socket buffers before stopping them
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        serverThread.stop();
+        for (int fd : clients) {
+            close(fd);
+        }
+
+        std::ostringstream spread;
+        for (size_t i = 0; i < server.shardCount(); i++) {
+            spread << (i ? "/" : "") << server.shard(i).connectionCount();
+        }
+        ConnectionCounters totals = server.totals();
+        uint64_t merged = 0;
+        server.tagCounts().forEach([&merged](const TagEntry& entry) { merged += entry.count; });
+
+        double framesPerSec = totals.frames * 1e9 / elapsed;
+        if (shards == 1) {
+            baseline = framesPerSec;
+        }
+        std::cout << std::left << std::setw(8) << shards << std::setw(14) << static_cast<uint64_t>(framesPerSec)
+                  << std::setw(10) << std::fixed << std::setprecision(2) << framesPerSec / baseline
+                  << std::setw(24) << spread.str() << (merged == totals.tagReads ? "ok" : "MISMATCH") << std::endl;
+        ok = ok && merged == totals.tagReads;
+    }
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,275 @@
+/**
+ * Check and benchmark of the memory-mapped tag file (TagTable::open(), rfid/tag_table.h).
+ *
+ * Check: 1M tags are counted into a tag file (growing it from 1024 slots) and into an in-memory
+ * TagTable, and must match after a close() and open(). Then a child process counts more reads,
+ * writes a checkpoint, counts more and exits without close() (a crash): the reopened file must hold
+ * the reads up to the checkpoint and none after it. Last, the file is put back as it was before that
+ * checkpoint (as if its pages never reached the disk): open() must redo the checkpoint from the log.
+ *
+ * Benchmark with 1M stored tags:
+ *      cold start:     open() of the tag file with its pages in the page cache and after they were
+ *                      dropped from it (posix_fadvise), then the first 1000 lookups and the top tag
+ *                      ranking the server does at start. Compared with parsing the same tags from
+ *                      a text dump (EPC, count, first and last seen per line).
+ *      updates:        reads/sec of record() with Zipf distributed reads, in memory, in the tag file,
+ *                      and in the tag file with a checkpoint every 1M reads (and the time one
+ *                      checkpoint takes the reading thread and the writer thread).
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Tag_File_Benchmark.cpp -o Tag_File_Benchmark
+ * Execute: ./Tag_File_Benchmark [tags] [folder]
+*/
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../rfid/tag_table.h"
+#include "../rfid/tag_report.h"
+#include "bench_util.h"
+
+#define START_NS 1683295200000000000LL     // Time stamp of the first read
+
+static EpcKey epcOf(uint32_t tag) {
+    EpcKey key;
+    key.bytes[0] = 0xe2;
+    memcpy(key.bytes + EPC_LEN - sizeof(tag), &tag, sizeof(tag));
+    return key;
+}
+
+// Zipf (s = 1) distributed tag numbers, drawn once so the timed loops only count
+static std::vector<uint32_t> zipfReads(size_t tags, size_t reads) {
+    std::vector<double> cdf(tags);
+    double sum = 0;
+    for (size_t i = 0; i < tags; i++) {
+        sum += 1.0 / (i + 1);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<uint32_t> order(reads);
+    for (uint32_t& tag : order) {
+        tag = static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+    }
+    return order;
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string& path, const std::string& bytes) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), bytes.size());
+}
+
+static size_t mismatches(const TagTable& table, const TagTable& model) {
+    size_t bad = table.size() != model.size();
+    model.forEach([&](const TagEntry& expected) {
+        const TagEntry* entry = table.find(expected.epc);
+        bad += !entry || entry->count != expected.count || entry->firstSeen != expected.firstSeen ||
+               entry->lastSeen != expected.lastSeen;
+    });
+    return bad;
+}
+
+static bool check(const std::string& path, size_t tags) {
+    unlink(path.c_str());
+    TagTable model;
+    size_t bad = 0;
+    {
+        TagTable table;
+        if (!table.open(path)) {
+            return false;
+        }
+        std::mt19937 rng(2);
+        for (size_t i = 0; i < tags * 2; i++) {
+            uint32_t tag = i < tags ? static_cast<uint32_t>(i) : rng() % tags;
+            table.record(epcOf(tag), START_NS + i);
+            model.record(epcOf(tag), START_NS + i);
+        }
+        bad += mismatches(table, model);
+    }
+    TagTable reopened;
+    bad += !reopened.open(path) || !reopened.isMapped() || mismatches(reopened, model);
+    reopened.close();
+
+    std::string walPath = path + TAG_FILE_WAL_EXTENSION;
+    std::string saved = readFile(path);     // The file as of the last checkpoint, before the child's
+
+    // A child counts more reads around a checkpoint and exits without close()
+    pid_t pid = fork();
+    if (pid == 0) {
+        TagTable table;
+        table.open(path);
+        for (uint32_t i = 0; i < 1000; i++) {
+            table.record(epcOf(i % 10), START_NS + i);
+        }
+        table.checkpoint(START_NS);
+        table.waitForCheckpoint();
+        for (uint32_t i = 0; i < 1000; i++) {
+            table.record(epcOf(static_cast<uint32_t>(tags) + i), START_NS + i);   // New tags after the checkpoint
+        }
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+    std::string wal = readFile(walPath);
+    for (uint32_t i = 0; i < 1000; i++) {
+        model.record(epcOf(i % 10), START_NS + i);
+    }
+    bad += !reopened.open(path) || mismatches(reopened, model);
+    reopened.close();
+
+    // Undo the child's checkpoint in the file but not in the log
+    writeFile(path, saved);
+    writeFile(walPath, wal);
+    bad += !reopened.open(path) || mismatches(reopened, model);
+
+    std::cout << "Check: " << reopened.size() << " tags after close/open, a crash and a torn checkpoint: "
+              << (bad == 0 ? "ok" : "MISMATCH (" + std::to_string(bad) + ")") << std::endl;
+    return bad == 0;
+}
+
+static void printRow(const std::string& name, double ms) {
+    std::cout << std::left << std::setw(40) << name << std::fixed << std::setprecision(2) << ms << std::endl;
+}
+
+static void coldStart(const std::string& path, const std::string& dumpPath, size_t tags) {
+    // Store tags tags in the tag file and in a text dump
+    {
+        unlink(path.c_str());
+        TagTable table;
+        table.open(path);
+        for (uint32_t i = 0; i < tags; i++) {
+            for (uint32_t r = 0; r <= i % 7; r++) {
+                table.record(epcOf(i), START_NS + i);
+            }
+        }
+        std::ofstream dump(dumpPath, std::ios::out | std::ios::trunc);
+        table.forEach([&dump](const TagEntry& entry) {
+            for (uint8_t byte : entry.epc.bytes) {
+                dump << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+            }
+            dump << std::dec << ',' << entry.count << ',' << entry.firstSeen << ',' << entry.lastSeen << '\n';
+        });
+    }
+    std::vector<EpcKey> lookups;
+    std::mt19937 rng(3);
+    for (int i = 0; i < 1000; i++) {
+        lookups.push_back(epcOf(rng() % tags));
+    }
+
+    std::cout << std::endl << std::left << std::setw(40) << "cold start (" + std::to_string(tags) + " tags)" << "ms"
+              << std::endl;
+    for (bool dropCache : {false, true}) {
+        if (dropCache) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+        std::string label = dropCache ? " (not cached)" : " (cached)";
+        uint64_t start = nowNs();
+        TagTable table;
+        table.open(path);
+        uint64_t opened = nowNs();
+        uint64_t found = 0;
+        for (const EpcKey& epc : lookups) {
+            found += table.find(epc) != nullptr;
+        }
+        uint64_t looked = nowNs();
+        TagReporter reporter(table);
+        reporter.loadTop();
+        uint64_t ranked = nowNs();
+        printRow("tag file open()" + label, (opened - start) / 1e6);
+        printRow("  + 1000 lookups" + label, (looked - opened) / 1e6);
+        printRow("  + top tag ranking" + label, (ranked - looked) / 1e6);
+        if (found != lookups.size()) {
+            std::cout << "MISMATCH: " << found << " of " << lookups.size() << " tags found" << std::endl;
+        }
+    }
+
+    uint64_t start = nowNs();
+    TagTable parsed;
+    std::ifstream dump(dumpPath);
+    std::string line;
+    while (std::getline(dump, line)) {
+        EpcKey epc;
+        for (size_t i = 0; i < EPC_LEN; i++) {
+            epc.bytes[i] = static_cast<uint8_t>(std::stoi(line.substr(2 * i, 2), nullptr, 16));
+        }
+        size_t p = 2 * EPC_LEN + 1, q = line.find(',', p), r = line.find(',', q + 1);
+        parsed.merge(epc, static_cast<uint32_t>(std::stoul(line.substr(p, q - p))),
+                     std::stoll(line.substr(q + 1, r - q - 1)), std::stoll(line.substr(r + 1)));
+    }
+    printRow("text dump parse", (nowNs() - start) / 1e6);
+}
+
+static void updates(const std::string& path, size_t tags) {
+    std::vector<uint32_t> order = zipfReads(tags, 20000000);
+    std::vector<EpcKey> epcs;
+    for (uint32_t i = 0; i < tags; i++) {
+        epcs.push_back(epcOf(i));
+    }
+
+    std::cout << std::endl << std::left << std::setw(40) << "updates (" + std::to_string(tags) + " tags)" << "reads/sec"
+              << std::endl;
+    for (int mode = 0; mode < 3; mode++) {
+        unlink(path.c_str());
+        TagTable table;
+        if (mode > 0) {
+            table.open(path);
+        }
+        for (const EpcKey& epc : epcs) {
+            table.record(epc, START_NS);
+        }
+        table.checkpoint(START_NS);
+
+        uint64_t checkpointNs = 0, checkpoints = 0;
+        uint64_t start = nowNs();
+        for (size_t i = 0; i < order.size(); i++) {
+            table.record(epcs[order[i]], START_NS + i);
+            if (mode == 2 && i % 1000000 == 999999) {
+                uint64_t before = nowNs();
+                table.checkpoint(START_NS + i);
+                checkpointNs += nowNs() - before;
+                checkpoints++;
+            }
+        }
+        double seconds = (nowNs() - start) / 1e9;
+        table.waitForCheckpoint();
+        TagFileStats stats = table.fileStats();
+        const char* names[] = {"in memory", "tag file", "tag file, checkpoint per 1M reads"};
+        std::cout << std::left << std::setw(40) << names[mode] << std::fixed << std::setprecision(1)
+                  << order.size() / seconds / 1e6 << "M";
+        if (checkpoints) {
+            std::cout << " (" << std::setprecision(2) << checkpointNs / 1e6 / checkpoints << " ms per checkpoint, writer "
+                      << stats.lastWriteNs / 1e6 << " ms, " << stats.skipped << " skipped)";
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t tags = argc > 1 ? std::atol(argv[1]) : 1000000;
+    std::string folder = argc > 2 ? argv[2] : "/tmp";
+    std::string path = folder + "/tag_file_benchmark" TAG_FILE_EXTENSION;
+    std::string dumpPath = folder + "/tag_file_benchmark.csv";
+
+    if (!check(path, tags)) {
+        return -1;
+    }
+    coldStart(path, dumpPath, tags);
+    updates(path, tags);
+    unlink(path.c_str());
+    unlink((path + TAG_FILE_WAL_EXTENSION).c_str());
+    unlink(dumpPath.c_str());
+    return 0;
+}
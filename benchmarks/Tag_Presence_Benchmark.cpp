@@ -0,0 +1,199 @@
+/**
+ * Check and benchmark of the sliding-window tag presence tracker (rfid/tag_presence.h).
+ *
+ * All times are simulated (one read per microsecond), so the runs take seconds, not hours.
+ *
+ * Check: 500 tags read in random bursts with gaps longer than the leave timeout, compared after
+ * every advance() with a brute-force model that keeps every read: the set of present tags, the
+ * enter/leave event counts and windowReads() of every tag must match.
+ *
+ * Benchmark:
+ *      ns/read:    record() plus the advance() every 100 ms of simulated time, for 1K to 1M tags
+ *                  present at once (uniform reads), next to a plain TagTable::record() of the same
+ *                  reads. Both grow only as the tables fall out of the caches (a presence read
+ *                  touches the index and a 104 byte entry, TagTable one inline slot); the expiry
+ *                  adds nothing that depends on the number of tags.
+ *      churn:      a new tag arrives every 200 us and is read for 2 s, so about 10000 tags are
+ *                  present at any time while 100000 pass by. Memory follows the present tags while
+ *                  a TagTable of every tag ever seen keeps growing.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Tag_Presence_Benchmark.cpp -o Tag_Presence_Benchmark
+ * Execute: ./Tag_Presence_Benchmark
+*/
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+#include "../rfid/tag_presence.h"
+#include "bench_util.h"
+
+#define START_NS 1700000000000000000LL     // Simulated clock start (ns since the epoch)
+#define US 1000LL
+#define MS 1000000LL
+
+static EpcKey epcOf(uint32_t tag) {
+    EpcKey key;
+    key.bytes[0] = 0xe2;
+    memcpy(key.bytes + EPC_LEN - sizeof(tag), &tag, sizeof(tag));
+    return key;
+}
+
+// Brute-force model: every read of every present tag
+struct ModelTag {
+    bool present = false;
+    std::vector<int64_t> reads;     // Times of the reads since the tag entered
+};
+
+static bool check() {
+    PresenceConfig config;
+    config.windowMs = 1600;
+    config.leaveTimeoutMs = 1000;
+    config.tickMs = 10;
+    int64_t bucketNs = config.windowMs * MS / PRESENCE_WINDOW_SLOTS;
+    int64_t tickNs = config.tickMs * MS;
+
+    size_t enters = 0, leaves = 0;
+    TagPresence presence(config, [&](const PresenceEvent& event) {
+        (event.type == PresenceEventType::Enter ? enters : leaves)++;
+    });
+    std::vector<ModelTag> model(500);
+    size_t modelEnters = 0, modelLeaves = 0, mismatches = 0;
+
+    std::mt19937_64 rng(3);
+    int64_t now = START_NS;
+    for (int step = 0; step < 20000; step++) {
+        // A burst of reads, then sometimes a pause longer than the timeout
+        now += static_cast<int64_t>(rng() % (step % 500 == 499 ? 3000 : 20)) * MS + static_cast<int64_t>(rng() % MS);
+        for (int i = 0, burst = rng() % 8; i < burst; i++) {
+            uint32_t tag = rng() % (step % 2000 < 1000 ? 50 : model.size());
+            presence.record(epcOf(tag), now);
+            ModelTag& m = model[tag];
+            if (!m.present) {
+                m.present = true;
+                m.reads.clear();
+                modelEnters++;
+            }
+            m.reads.push_back(now);
+        }
+
+        presence.advance(now);
+        int64_t nowBucket = now / bucketNs;
+        for (uint32_t tag = 0; tag < model.size(); tag++) {
+            ModelTag& m = model[tag];
+            if (m.present) {
+                // Leaves once the tick of now reaches the first tick at or after lastSeen + timeout
+                int64_t deadline = m.reads.back() + config.leaveTimeoutMs * MS;
+                if (now / tickNs >= (deadline + tickNs - 1) / tickNs) {
+                    m.present = false;
+                    modelLeaves++;
+                }
+            }
+            const PresenceEntry* entry = presence.find(epcOf(tag));
+            if ((entry != nullptr) != m.present) {
+                mismatches++;
+                continue;
+            }
+            if (entry) {
+                int64_t lastBucket = m.reads.back() / bucketNs;
+                uint32_t expected = 0;
+                for (int64_t t : m.reads) {
+                    int64_t b = t / bucketNs;
+                    expected += b > nowBucket - PRESENCE_WINDOW_SLOTS && b > lastBucket - PRESENCE_WINDOW_SLOTS;
+                }
+                mismatches += presence.windowReads(*entry, now) != expected;
+                mismatches += entry->reads != m.reads.size();
+            }
+        }
+    }
+    bool ok = mismatches == 0 && enters == modelEnters && leaves == modelLeaves;
+    std::cout << "Check: " << enters << " enter and " << leaves << " leave events: "
+              << (ok ? "ok" : "MISMATCH (" + std::to_string(mismatches) + ")") << std::endl;
+    return ok;
+}
+
+// ns per read with tags tags present, read uniformly one per simulated microsecond (and the same reads on a TagTable)
+static std::pair<double, double> readCost(size_t tags, size_t reads) {
+    PresenceConfig config;
+    config.leaveTimeoutMs = 3000;
+    TagPresence presence(config, nullptr);
+    TagTable table;
+    std::vector<EpcKey> epcs;
+    for (uint32_t tag = 0; tag < tags; tag++) {
+        epcs.push_back(epcOf(tag));
+        presence.record(epcs.back(), START_NS);
+        table.record(epcs.back(), START_NS);
+    }
+    std::mt19937 rng(1);
+    std::vector<uint32_t> order(1 << 20);
+    for (uint32_t& tag : order) {
+        tag = rng() % tags;
+    }
+
+    uint64_t start = nowNs();
+    int64_t now = START_NS;
+    for (size_t i = 0; i < reads; i++) {
+        now += US;
+        presence.record(epcs[order[i & (order.size() - 1)]], now);
+        if (i % 100000 == 99999) {
+            presence.advance(now);
+        }
+    }
+    double presenceNs = static_cast<double>(nowNs() - start) / reads;
+
+    start = nowNs();
+    now = START_NS;
+    for (size_t i = 0; i < reads; i++) {
+        now += US;
+        table.record(epcs[order[i & (order.size() - 1)]], now);
+    }
+    return {presenceNs, static_cast<double>(nowNs() - start) / reads};
+}
+
+static void churn() {
+    PresenceConfig config;
+    config.leaveTimeoutMs = 500;
+    size_t leaves = 0;
+    TagPresence presence(config, [&leaves](const PresenceEvent& event) {
+        leaves += event.type == PresenceEventType::Leave;
+    });
+    TagTable history;
+    std::mt19937 rng(2);
+
+    std::cout << std::endl << std::left << std::setw(12) << "time (s)" << std::setw(14) << "tags seen"
+              << std::setw(14) << "present" << std::setw(18) << "presence (KiB)" << "TagTable (KiB)" << std::endl;
+    int64_t now = START_NS;
+    for (int64_t us = 1; us <= 20000000; us++) {
+        now += US;
+        uint32_t first = static_cast<uint32_t>(us / 200);     // Tags [first, first + 10000) are at the portal
+        uint32_t tag = first + rng() % 10000;
+        presence.record(epcOf(tag), now);
+        history.record(epcOf(tag), now);
+        if (us % 100000 == 0) {
+            presence.advance(now);
+        }
+        if (us % 4000000 == 0) {
+            std::cout << std::left << std::setw(12) << us / 1000000 << std::setw(14) << history.size()
+                      << std::setw(14) << presence.size() << std::setw(18) << presence.memoryBytes() / 1024
+                      << history.memoryBytes() / 1024 << std::endl;
+        }
+    }
+    std::cout << leaves << " tags left" << std::endl;
+}
+
+int main() {
+    if (!check()) {
+        return -1;
+    }
+
+    std::cout << std::endl << std::left << std::setw(12) << "present" << std::setw(22) << "presence (ns/read)"
+              << "TagTable::record (ns/read)" << std::endl;
+    for (size_t tags : {1000, 10000, 100000, 1000000}) {
+        std::pair<double, double> cost = readCost(tags, 20000000);
+        std::cout << std::left << std::setw(12) << tags << std::setw(22) << std::fixed << std::setprecision(1)
+                  << cost.first << cost.second << std::endl;
+    }
+
+    churn();
+    return 0;
+}
@@ -0,0 +1,251 @@
+/**
+ * Latency of tag queries (rfid/tag_query.h) under ingest load, and what the query service costs the
+ * receive path.
+ *
+ * The server runs in-process on a loopback port. 4 readers send tag-read frames (16 per write(),
+ * 100k distinct EPCs) as fast as the server takes them while 2 clients query the Unix-domain
+ * socket, each about 250 times a second, in turn: GET of a random tag, TOP 10 and SINCE the last
+ * 100 ms (at most 100 tags). Each query is timed from write() to the last line of the answer.
+ *
+ * Reported:
+ *      check:      after the readers stop, GET of 1000 tags must return the counts of the event
+ *                  loop's own EPC_Tag_Counts
+ *      latency:    p50, p99 and max per query type
+ *      cost:       CPU time of the event loop thread per frame with the query service off and on
+ *                  (median of the rounds, off and on alternate)
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Tag_Query_Benchmark.cpp -o Tag_Query_Benchmark
+ * Execute: ./Tag_Query_Benchmark [frames_per_reader] [rounds]
+*/
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+#include <sys/un.h>
+
+#include "../rfid/reader_server.h"
+#include "bench_util.h"
+
+#define READERS 4
+#define QUERY_CLIENTS 2
+#define TAGS 100000
+#define SOCKET_PATH "/tmp/tag_query_benchmark.sock"
+
+static EpcKey epcOf(uint32_t tag) {
+    EpcKey key;
+    key.bytes[0] = 0xe2;
+    memcpy(key.bytes + EPC_LEN - sizeof(tag), &tag, sizeof(tag));
+    return key;
+}
+
+// Blocking line-based client of the query socket
+class QueryClient {
+public:
+    bool connect() {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, SOCKET_PATH);
+        fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0 || ::connect(fd_, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            perror("Query connect failed");
+            return false;
+        }
+        return true;
+    }
+    ~QueryClient() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    // Send one request and return the lines of its answer (the header first)
+    std::vector<std::string> query(const std::string& request) {
+        std::string line = request + '\n';
+        std::vector<std::string> lines;
+        if (write(fd_, line.data(), line.size()) != static_cast<ssize_t>(line.size())) {
+            return lines;
+        }
+        size_t expected = 1;
+        while (lines.size() < expected) {
+            size_t end = buffer_.find('\n');
+            if (end == std::string::npos) {
+                char chunk[65536];
+                ssize_t n = read(fd_, chunk, sizeof(chunk));
+                if (n <= 0) {
+                    break;
+                }
+                buffer_.append(chunk, n);
+                continue;
+            }
+            lines.push_back(buffer_.substr(0, end));
+            buffer_.erase(0, end + 1);
+            if (lines.size() == 1 && lines[0].compare(0, 3, "OK ") == 0) {
+                expected += std::stoul(lines[0].substr(lines[0].rfind(' ') + 1));
+            }
+        }
+        return lines;
+    }
+
+private:
+    int fd_ = -1;
+    std::string buffer_;
+};
+
+static std::string hexEpc(const EpcKey& epc) {
+    char text[2 * EPC_LEN];
+    formatHex(text, epc.bytes, EPC_LEN, 0);
+    return std::string(text, sizeof(text));
+}
+
+struct RunResult {
+    double cpuNsPerFrame = 0;
+    std::vector<uint64_t> latency[3];     // GET, TOP, SINCE
+    bool ok = true;
+};
+
+static RunResult runOnce(bool queries, size_t framesPerReader) {
+    ServerConfig config = quietConfig<ServerConfig>();
+    config.querySocket = queries ? SOCKET_PATH : "";
+
+    ReaderServer server(config);
+    if (!server.start()) {
+        exit(-1);
+    }
+    RunResult result;
+    ServerThread<ReaderServer> serverThread(server);
+
+    std::atomic<bool> sending{true};
+    std::vector<std::thread> clients;
+    for (int c = 0; queries && c < QUERY_CLIENTS; c++) {
+        clients.emplace_back([&, c]() {
+            QueryClient client;
+            if (!client.connect()) {
+                return;
+            }
+            std::mt19937 rng(c);
+            std::vector<uint64_t> samples[3];
+            for (int i = 0; sending.load(); i++) {
+                int type = i % 3;
+                std::string request = type == 0 ? "GET " + hexEpc(epcOf(rng() % TAGS))
+                                    : type == 1 ? "TOP 10"
+                                    : "SINCE " + std::to_string(wallClockNs() - 100000000) + " 100";
+                uint64_t start = nowNs();
+                std::vector<std::string> answer = client.query(request);
+                samples[type].push_back(nowNs() - start);
+                if (answer.empty() || answer[0].compare(0, 3, "OK ") != 0) {
+                    std::cout << "Query failed: " << request << std::endl;
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(4));
+            }
+            static std::mutex mutex;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int type = 0; type < 3; type++) {
+                result.latency[type].insert(result.latency[type].end(), samples[type].begin(), samples[type].end());
+            }
+        });
+    }
+
+    std::vector<std::thread> senders;
+    for (int r = 0; r < READERS; r++) {
+        senders.emplace_back([&, r]() {
+            int fd = connectLoopback(server.boundPort());
+            if (fd < 0) {
+                return;
+            }
+            std::vector<uint8_t> frame = sampleFrames::tagRead();
+            std::vector<uint8_t> data(frame.begin() + 3, frame.end() - 3);
+            std::mt19937 rng(100 + r);
+            std::vector<std::vector<uint8_t>> writes(256);
+            for (std::vector<uint8_t>& bytes : writes) {
+                for (int f = 0; f < 16; f++) {
+                    uint32_t tag = rng() % TAGS;
+                    memcpy(&data[EPC_OFFSET], epcOf(tag).bytes, EPC_LEN);
+                    std::vector<uint8_t> next = makeFrame(FRAME_TYPE_TAG_READ, data);
+                    bytes.insert(bytes.end(), next.begin(), next.end());
+                }
+            }
+            for (size_t sent = 0, w = 0; sent < framesPerReader; sent += 16, w++) {
+                const std::vector<uint8_t>& bytes = writes[w % writes.size()];
+                if (write(fd, bytes.data(), bytes.size()) < 0) {
+                    perror("Write failed");
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            close(fd);
+        });
+    }
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+    sending.store(false);
+    for (std::thread& client : clients) {
+        client.join();
+    }
+    serverThread.stop();
+
+    // Every read was published by the query timer during the 300 ms the readers waited
+    if (queries) {
+        QueryClient client;
+        size_t bad = !client.connect();
+        std::mt19937 rng(7);
+        for (int i = 0; i < 1000 && !bad; i++) {
+            EpcKey epc = epcOf(rng() % TAGS);
+            const TagEntry* entry = server.tagCounts().find(epc);
+            std::vector<std::string> answer = client.query("GET " + hexEpc(epc));
+            std::string expected = entry ? hexEpc(epc) + ' ' + std::to_string(entry->count) : "";
+            bad += entry ? answer.size() != 2 || answer[1].compare(0, expected.size(), expected) != 0
+                         : answer.size() != 1;
+        }
+        result.ok = bad == 0;
+    }
+    uint64_t frames = server.totals().frames;
+    server.shutdown();
+    result.cpuNsPerFrame = frames ? static_cast<double>(serverThread.cpuNs()) / frames : 0;
+    return result;
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    size_t framesPerReader = argc > 1 ? std::atol(argv[1]) : 1000000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::vector<double> off, on;
+    std::vector<uint64_t> latency[3];
+    bool ok = true;
+    for (int round = 0; round < rounds; round++) {
+        off.push_back(runOnce(false, framesPerReader).cpuNsPerFrame);
+        RunResult result = runOnce(true, framesPerReader);
+        on.push_back(result.cpuNsPerFrame);
+        ok = ok && result.ok;
+        for (int type = 0; type < 3; type++) {
+            latency[type].insert(latency[type].end(), result.latency[type].begin(), result.latency[type].end());
+        }
+    }
+    std::cout << "Check: GET answers match EPC_Tag_Counts: " << (ok ? "ok" : "MISMATCH") << std::endl;
+
+    const char* names[] = {"GET <epc>", "TOP 10", "SINCE -100ms"};
+    std::cout << std::endl << std::left << std::setw(16) << "query" << std::setw(10) << "queries"
+              << std::setw(12) << "p50 (us)" << std::setw(12) << "p99 (us)" << "max (us)" << std::endl;
+    for (int type = 0; type < 3; type++) {
+        std::vector<uint64_t>& samples = latency[type];
+        uint64_t max = samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+        std::cout << std::left << std::setw(16) << names[type] << std::setw(10) << samples.size() << std::fixed
+                  << std::setprecision(1) << std::setw(12) << percentile(samples, 50) / 1e3 << std::setw(12)
+                  << percentile(samples, 99) / 1e3 << max / 1e3 << std::endl;
+    }
+
+    double offNs = median(off), onNs = median(on);
+    std::cout << std::endl << "Event loop CPU per frame: " << std::setprecision(1) << offNs << " ns without queries, "
+              << onNs << " ns with queries (" << std::setprecision(2) << 100.0 * (onNs - offNs) / offNs << "%)"
+              << std::endl;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,101 @@
+/**
+ * Benchmark of the per-read cost of tag frequency reporting.
+ *
+ * For a growing number of distinct tags (Zipf distributed reads, s = 1.1) it measures the ns per tag
+ * read of:
+ *      full dump:      TagTable::record() + printEpcTagFrequencies() after every read (the original
+ *                      behaviour of the server)
+ *      incremental:    TagTable::record() + TagReporter::onRead(), plus one TagReporter::report()
+ *                      per 100000 reads (one report per second at 100k reads/s)
+ *
+ * Both print into a stream that formats everything and throws the text away, so the terminal is
+ * not part of the measurement (with a real terminal the full dump is far slower still).
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Tag_Report_Benchmark.cpp -o Tag_Report_Benchmark
+ * Execute: ./Tag_Report_Benchmark
+*/
+#include <iostream>
+#include <iomanip>
+#include <streambuf>
+#include <random>
+#include <cmath>
+#include <vector>
+
+#include "../rfid/tag_report.h"
+#include "bench_util.h"
+
+// Stream buffer that accepts and discards everything
+class DiscardBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// Zipf distributed tag numbers in [0, tags)
+static std::vector<uint32_t> zipfReads(size_t tags, size_t reads, std::mt19937_64& rng) {
+    std::vector<double> cumulative(tags);
+    double sum = 0;
+    for (size_t k = 0; k < tags; k++) {
+        sum += 1.0 / std::pow(static_cast<double>(k + 1), 1.1);
+        cumulative[k] = sum;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, sum);
+    std::vector<uint32_t> result(reads);
+    for (uint32_t& tag : result) {
+        tag = static_cast<uint32_t>(std::lower_bound(cumulative.begin(), cumulative.end(), uniform(rng)) -
+                                    cumulative.begin());
+        tag = std::min<uint32_t>(tag, tags - 1);
+    }
+    return result;
+}
+
+static EpcKey epcOf(uint32_t tag) {
+    EpcKey key;
+    key.bytes[0] = 0xe2;
+    memcpy(key.bytes + EPC_LEN - sizeof(tag), &tag, sizeof(tag));
+    return key;
+}
+
+int main() {
+    DiscardBuffer discard;
+    std::ostream out(&discard);
+    std::mt19937_64 rng(1);
+
+    std::cout << std::left << std::setw(10) << "tags" << std::setw(20) << "full dump (ns/read)"
+              << std::setw(22) << "incremental (ns/read)" << std::endl;
+
+    for (size_t tags : {100, 1000, 10000, 100000}) {
+        std::vector<uint32_t> reads = zipfReads(tags, 2000000, rng);
+
+        // Warm both tables with every tag so the dump prints all of them
+        TagTable fullTable, incrementalTable;
+        TagReporter reporter(incrementalTable, 10);
+        for (uint32_t tag = 0; tag < tags; tag++) {
+            fullTable.record(epcOf(tag), 0);
+            reporter.onRead(incrementalTable.record(epcOf(tag), 0));
+        }
+        reporter.report(out);
+
+        // Full dump after every read (fewer reads for the large tables, it is slow)
+        size_t fullReads = std::min<size_t>(reads.size(), 20000000 / tags);
+        uint64_t start = nowNs();
+        for (size_t i = 0; i < fullReads; i++) {
+            fullTable.record(epcOf(reads[i]), static_cast<int64_t>(i));
+            printEpcTagFrequencies(out, fullTable);
+        }
+        double fullNs = static_cast<double>(nowNs() - start) / fullReads;
+
+        start = nowNs();
+        for (size_t i = 0; i < reads.size(); i++) {
+            reporter.onRead(incrementalTable.record(epcOf(reads[i]), static_cast<int64_t>(i)));
+            if (i % 100000 == 99999) {
+                reporter.report(out);
+            }
+        }
+        double incrementalNs = static_cast<double>(nowNs() - start) / reads.size();
+
+        std::cout << std::left << std::setw(10) << tags << std::setw(20) << std::fixed << std::setprecision(1)
+                  << fullNs << std::setw(22) << incrementalNs << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/**
+ * Benchmark of the open-addressing TagTable against the original std::unordered_map<std::string, int>.
+ *
+ * 1M distinct EPCs are read with a skewed (Zipf, s = 1) distribution, so a few tags are read very
+ * often and most are read a handful of times, like tags parked in front of a portal versus tags
+ * passing through. The original path builds the 24 character hex key for every read before the
+ * map lookup, the new path copies the 12 raw EPC bytes into an EpcKey.
+ *
+ * Reported: lookups/sec (the reads after every tag has been inserted) and heap bytes per tag,
+ * measured by counting the bytes handed out by operator new.
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread benchmarks/Tag_Table_Benchmark.cpp -o Tag_Table_Benchmark
+ * Execute: ./Tag_Table_Benchmark [distinct_tags] [reads]
+*/
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <unordered_map>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+#include "../rfid/tag_table.h"
+#include "bench_util.h"
+
+// Heap bytes currently allocated through operator new
+static size_t heapBytes = 0;
+
+void* operator new(size_t size) {
+    void* p = malloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    heapBytes += malloc_usable_size(p);
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (p) {
+        heapBytes -= malloc_usable_size(p);
+        free(p);
+    }
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+// Random 12 byte EPCs with the e2 00 prefix of the captured tags
+static std::vector<EpcKey> makeEpcs(size_t count) {
+    std::mt19937_64 rng(42);
+    std::vector<EpcKey> epcs(count);
+    for (EpcKey& epc : epcs) {
+        uint64_t a = rng(), b = rng();
+        memcpy(epc.bytes, &a, 8);
+        memcpy(epc.bytes + 8, &b, 4);
+        epc.bytes[0] = 0xe2;
+        epc.bytes[1] = 0x00;
+    }
+    return epcs;
+}
+
+// Tag indexes drawn from a Zipf(s = 1) distribution over count tags
+static std::vector<uint32_t> makeZipfReads(size_t count, size_t reads) {
+    std::vector<double> cdf(count);
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += 1.0 / (i + 1);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    std::vector<uint32_t> indexes(reads);
+    for (uint32_t& index : indexes) {
+        index = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+    }
+    // The rank order must not follow the insertion order
+    std::vector<uint32_t> permutation(count);
+    for (size_t i = 0; i < count; i++) {
+        permutation[i] = i;
+    }
+    std::shuffle(permutation.begin(), permutation.end(), rng);
+    for (uint32_t& index : indexes) {
+        index = permutation[index];
+    }
+    return indexes;
+}
+
+int main(int argc, char* argv[]) {
+    size_t distinct = argc > 1 ? std::atol(argv[1]) : 1000000;
+    size_t reads = argc > 2 ? std::atol(argv[2]) : 10000000;
+
+    std::vector<EpcKey> epcs = makeEpcs(distinct);
+    std::vector<uint32_t> zipf = makeZipfReads(distinct, reads);
+    volatile uint64_t sink = 0;
+
+    // Original: hex string key in an unordered_map
+    double mapLookups, mapBytesPerTag;
+    {
+        size_t before = heapBytes;
+        std::unordered_map<std::string, int> EPC_Tag_Counts;
+        std::string key;
+        char hex[2 * EPC_LEN];
+        for (const EpcKey& epc : epcs) {
+            formatHex(hex, epc.bytes, EPC_LEN, 0);
+            EPC_Tag_Counts[std::string(hex, sizeof(hex))]++;
+        }
+        mapBytesPerTag = double(heapBytes - before) / EPC_Tag_Counts.size();
+
+        uint64_t start = nowNs();
+        for (uint32_t index : zipf) {
+            formatHex(hex, epcs[index].bytes, EPC_LEN, 0);
+            key.assign(hex, sizeof(hex));
+            sink += ++EPC_Tag_Counts[key];
+        }
+        mapLookups = reads * 1e9 / (nowNs() - start);
+    }
+
+    // New: EpcKey in the open-addressing TagTable
+    double tableLookups, tableBytesPerTag;
+    {
+        size_t before = heapBytes;
+        TagTable table;
+        for (const EpcKey& epc : epcs) {
+            table.record(epc, 1);
+        }
+        tableBytesPerTag = double(heapBytes - before) / table.size();
+
+        uint64_t start = nowNs();
+        int64_t now = 2;
+        for (uint32_t index : zipf) {
+            sink += table.record(epcs[index], now++).count;
+        }
+        tableLookups = reads * 1e9 / (nowNs() - start);
+    }
+
+    std::cout << distinct << " distinct EPCs, " << reads << " Zipf distributed reads" << std::endl;
+    std::cout << std::left << std::setw(32) << "table" << std::setw(16) << "lookups/sec" << "bytes/tag" << std::endl;
+    std::cout << std::left << std::setw(32) << "unordered_map<string, int>" << std::setw(16)
+              << static_cast<uint64_t>(mapLookups) << std::fixed << std::setprecision(1) << mapBytesPerTag << std::endl;
+    std::cout << std::left << std::setw(32) << "TagTable (with timestamps)" << std::setw(16)
+              << static_cast<uint64_t>(tableLookups) << std::fixed << std::setprecision(1) << tableBytesPerTag << std::endl;
+    return sink == 0;
+}
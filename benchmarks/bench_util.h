@@ -0,0 +1,138 @@
+/**
+ * Small helpers shared by the benchmark programs in this folder.
+ *
+ * - nowNs():           Monotonic time stamp in nanoseconds.
+ * - percentile():      Percentile of a set of samples (sorts the vector in place).
+ * - makeFrame():       Builds a complete 0xBB frame (Head, Type, Len, Data, CRC, 0x0D 0x0A) with the
+ *                      same sum-and-mask checksum the server verifies.
+ * - sampleFrames:      The connect, heartbeat and tag-read frames captured from the RFID reader.
+ * - connectLoopback(): Connects a reader socket to a server on the loopback interface.
+ * - quietConfig():     Server settings shared by every in-process benchmark server (loopback port
+ *                      picked by the kernel, no console output, no csv log, no tag reports).
+ * - ServerThread:      Runs a started server on its own thread until stop().
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+inline uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// p in [0, 100]. Returns 0 for an empty sample set.
+inline uint64_t percentile(std::vector<uint64_t>& samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p / 100.0 * (samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+inline std::vector<uint8_t> makeFrame(uint8_t type, const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> frame;
+    frame.reserve(data.size() + 6);
+    frame.push_back(0xBB);
+    frame.push_back(type);
+    frame.push_back(static_cast<uint8_t>(data.size()));
+    frame.insert(frame.end(), data.begin(), data.end());
+    unsigned int sum = 0;
+    for (size_t i = 1; i < frame.size(); i++) {
+        sum += frame[i];
+    }
+    frame.push_back(static_cast<uint8_t>(sum & 0xFF));
+    frame.push_back(0x0D);
+    frame.push_back(0x0A);
+    return frame;
+}
+
+// Frames captured from the RFID reader (see TCP_Server_Example.py)
+namespace sampleFrames {
+    inline std::vector<uint8_t> connect() { return makeFrame(0x3a, {0x02, 0x00, 0x00}); }
+    inline std::vector<uint8_t> heartbeat() { return makeFrame(0x40, {0x00, 0x01}); }
+    inline std::vector<uint8_t> tagRead() {
+        return makeFrame(0x17, {0x30, 0x00, 0xe2, 0x00, 0x00, 0x1d, 0x25, 0x03, 0x02, 0x58, 0x16, 0x50,
+                                0xe7, 0xa5, 0x75, 0x8d, 0x20, 0x1f, 0x01});
+    }
+}
+
+// Connect one client socket (TCP_NODELAY, non-blocking once connected if asked) to port on the loopback interface
+inline int connectLoopback(int port, bool nonBlocking = false) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Connect failed");
+        close(fd);
+        return -1;
+    }
+    if (nonBlocking) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+// A ServerConfig for a server running inside a benchmark
+template <typename Config>
+inline Config quietConfig() {
+    Config config;
+    config.port = 0;
+    config.quiet = true;
+    config.logger.csv = false;
+    config.reportIntervalMs = 0;
+    return config;
+}
+
+/* A started server running on its own thread
+
+stop() (or the destructor) stops the server and joins the thread. cpuNs() is then the CPU time of
+the thread (CLOCK_THREAD_CPUTIME_ID, so time waiting in epoll_wait() does not count).
+*/
+template <typename Server>
+class ServerThread {
+public:
+    explicit ServerThread(Server& server) : server_(server), thread_([this]() {
+        server_.run();
+        struct timespec cpu;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+        cpuNs_ = cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+    }) {}
+    ~ServerThread() { stop(); }
+
+    void stop() {
+        if (thread_.joinable()) {
+            server_.stop();
+            thread_.join();
+        }
+    }
+    uint64_t cpuNs() const { return cpuNs_; }
+
+private:
+    Server& server_;
+    uint64_t cpuNs_ = 0;
+    std::thread thread_;
+};
@@ -0,0 +1,486 @@
+/**
+ * Compact binary capture format for received frames.
+ *
+ * A capture file is append-only. It starts with a CaptureFileHeader followed by blocks:
+ *
+ *      | CaptureFileHeader | data block | data block | ... | index block | data block | ... | index block |
+ *
+ * Every block starts with a CaptureBlockHeader (magic, payload size, record count, first and last
+ * receive time, checksum of the payload).
+ *
+ * Data block payload, one record per frame:
+ *      | u32 receive time in microseconds after the block's firstNs | u32 connection id | frame bytes |
+ *      The frame size is not stored: it follows from the frame's Len byte (Len + 6).
+ *
+ * Index block payload:
+ *      | u64 offset of the previous index block (0 for the first) | CaptureIndexEntry per data block |
+ *
+ * The writer emits an index block after every indexInterval data blocks and when the file is
+ * closed, and then stores the offset of the last index block in the file header. A reader that mmaps
+ * the file follows the chain of index blocks backwards from there and gets the offset and time range
+ * of every data block without touching the data, so it can binary search for a time range. If the
+ * writer did not close the file (crash, power loss) the header has no index offset and the reader
+ * walks the block headers from the start instead; a torn block at the end is ignored.
+ *
+ * All integers are little-endian (the byte order of the Raspberry Pi and x86).
+*/
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frame_parser.h"
+
+#define CAPTURE_MAGIC "RFIDCAP"         // 8 bytes with the terminating 0
+#define CAPTURE_VERSION 1
+#define CAPTURE_DATA_MAGIC 0x314B4C42   // "BLK1"
+#define CAPTURE_INDEX_MAGIC 0x31584449  // "IDX1"
+#define CAPTURE_RECORD_HEADER 8         // Time offset + connection id
+#define CAPTURE_EXTENSION ".rfidcap"
+
+struct CaptureFileHeader {
+    char magic[8];                  // CAPTURE_MAGIC
+    uint32_t version;               // CAPTURE_VERSION
+    uint32_t headerSize;            // sizeof(CaptureFileHeader)
+    int64_t createdNs;              // Creation time (ns since the epoch)
+    uint64_t lastIndexOffset;       // Offset of the last index block, 0 if the file was not closed
+    uint8_t reserved[32];
+};
+
+struct CaptureBlockHeader {
+    uint32_t magic;                 // CAPTURE_DATA_MAGIC or CAPTURE_INDEX_MAGIC
+    uint32_t payloadBytes;          // Bytes following this header
+    uint32_t recordCount;           // Records (data block) or entries (index block)
+    uint32_t checksum;              // captureChecksum() of the payload
+    int64_t firstNs;                // Receive time of the first record
+    int64_t lastNs;                 // Receive time of the last record
+};
+
+struct CaptureIndexEntry {
+    uint64_t offset;                // File offset of the data block header
+    int64_t firstNs;
+    int64_t lastNs;
+    uint32_t recordCount;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(CaptureFileHeader) == 64, "capture file header layout");
+static_assert(sizeof(CaptureBlockHeader) == 32, "capture block header layout");
+static_assert(sizeof(CaptureIndexEntry) == 32, "capture index entry layout");
+
+// One frame read back from a capture
+struct CaptureRecord {
+    int64_t receivedNs;
+    uint32_t connectionId;
+    const uint8_t* frame;           // Points into the mapped file
+    size_t size;
+};
+
+// 32-bit FNV-1a over the payload (detects torn or corrupted blocks). Pass the checksum of the bytes
+// before as hash to checksum a payload in pieces.
+inline uint32_t captureChecksum(const uint8_t* bytes, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Builds capture blocks and writes them to a file
+
+Used by the logger thread: append() every frame, then flush() writes the pending data block (plus an
+index block when one is due) with a single write(). close() writes the final index block and patches
+its offset into the file header. open() closes the current file only once the new one is created, so
+a failed open() (disk full, read-only SD card) leaves the writer on the current file. Frames appended
+while no file is open are dropped.
+*/
+class CaptureWriter {
+public:
+    explicit CaptureWriter(size_t indexInterval = 64) : indexInterval_(indexInterval) {}
+    ~CaptureWriter() { close(); }
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    bool open(const std::string& filename, int64_t nowNs) {
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            perror("Capture file open failed");
+            return false;
+        }
+        CaptureFileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = CAPTURE_VERSION;
+        header.headerSize = sizeof(header);
+        header.createdNs = nowNs;
+        if (!writeAll(fd, &header, sizeof(header))) {
+            ::close(fd);
+            unlink(filename.c_str());
+            return false;
+        }
+        close();
+        fd_ = fd;
+        offset_ = sizeof(header);
+        lastIndexOffset_ = 0;
+        index_.clear();
+        pending_.clear();
+        pendingRecords_ = 0;
+        return true;
+    }
+
+    /* Add one frame to the pending data block
+
+    Time offsets are kept relative to the first record of the block while it is being built, so a
+    record received slightly earlier than the first one (frames from several connections are not
+    strictly in time order) gets a negative offset. flush() shifts them all to be relative to the
+    earliest record before writing.
+    */
+    void append(const uint8_t* frame, size_t size, int64_t receivedNs, uint32_t connectionId) {
+        if (fd_ < 0) {
+            return;
+        }
+        int64_t offsetUs = pendingRecords_ == 0 ? 0 : (receivedNs - pendingBaseNs_) / 1000;
+        // Records in a block must fit the 32-bit microsecond offset (about 35 minutes either way)
+        if (offsetUs < -(INT32_MAX / 2) || offsetUs > INT32_MAX / 2) {
+            flush();
+            offsetUs = 0;
+        }
+        if (pendingRecords_ == 0) {
+            pendingBaseNs_ = receivedNs;
+            pendingMinUs_ = 0;
+            pendingLastNs_ = receivedNs;
+        }
+        pendingMinUs_ = std::min(pendingMinUs_, offsetUs);
+        pendingLastNs_ = std::max(pendingLastNs_, receivedNs);
+
+        int32_t offset = static_cast<int32_t>(offsetUs);
+        const uint8_t* fields[2] = {reinterpret_cast<const uint8_t*>(&offset),
+                                    reinterpret_cast<const uint8_t*>(&connectionId)};
+        pending_.insert(pending_.end(), fields[0], fields[0] + sizeof(offset));
+        pending_.insert(pending_.end(), fields[1], fields[1] + sizeof(connectionId));
+        pending_.insert(pending_.end(), frame, frame + size);
+        pendingRecords_++;
+    }
+
+    // Write the pending data block (and an index block every indexInterval blocks)
+    bool flush() {
+        if (fd_ < 0 || pendingRecords_ == 0) {
+            return true;
+        }
+        // Make every time offset relative to the earliest record
+        int64_t firstNs = pendingBaseNs_ + pendingMinUs_ * 1000;
+        if (pendingMinUs_ < 0) {
+            for (size_t p = 0; p < pending_.size();) {
+                int32_t offset;
+                memcpy(&offset, &pending_[p], sizeof(offset));
+                offset -= static_cast<int32_t>(pendingMinUs_);
+                memcpy(&pending_[p], &offset, sizeof(offset));
+                p += CAPTURE_RECORD_HEADER + pending_[p + CAPTURE_RECORD_HEADER + 2] + FRAME_OVERHEAD;
+            }
+        }
+
+        CaptureIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = offset_;
+        entry.firstNs = firstNs;
+        entry.lastNs = pendingLastNs_;
+        entry.recordCount = pendingRecords_;
+
+        output_.clear();
+        appendBlock(CAPTURE_DATA_MAGIC, pending_.data(), pending_.size(), pendingRecords_, firstNs, pendingLastNs_);
+        index_.push_back(entry);
+        pending_.clear();
+        pendingRecords_ = 0;
+
+        if (index_.size() >= indexInterval_) {
+            appendIndexBlock();
+        }
+        return writeOutput();
+    }
+
+    // Write the pending block and the final index block, then record the index offset in the header
+    void close() {
+        if (fd_ < 0) {
+            return;
+        }
+        flush();
+        if (!index_.empty()) {
+            output_.clear();
+            appendIndexBlock();
+            writeOutput();
+        }
+        if (lastIndexOffset_ != 0) {
+            if (pwrite(fd_, &lastIndexOffset_, sizeof(lastIndexOffset_),
+                       offsetof(CaptureFileHeader, lastIndexOffset)) < 0) {
+                perror("Capture header update failed");
+            }
+        }
+        ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool isOpen() const { return fd_ >= 0; }
+    uint64_t bytesWritten() const { return offset_; }
+
+private:
+    static bool writeAll(int fd, const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+            ssize_t n = write(fd, bytes, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Capture write failed");
+                return false;
+            }
+            bytes += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    void appendBlock(uint32_t magic, const uint8_t* payload, size_t size, uint32_t count, int64_t firstNs,
+                     int64_t lastNs) {
+        CaptureBlockHeader header;
+        header.magic = magic;
+        header.payloadBytes = static_cast<uint32_t>(size);
+        header.recordCount = count;
+        header.checksum = captureChecksum(payload, size);
+        header.firstNs = firstNs;
+        header.lastNs = lastNs;
+        const uint8_t* h = reinterpret_cast<const uint8_t*>(&header);
+        output_.insert(output_.end(), h, h + sizeof(header));
+        output_.insert(output_.end(), payload, payload + size);
+    }
+
+    void appendIndexBlock() {
+        uint64_t indexOffset = offset_ + output_.size();
+        std::vector<uint8_t> payload(sizeof(uint64_t) + index_.size() * sizeof(CaptureIndexEntry));
+        memcpy(payload.data(), &lastIndexOffset_, sizeof(uint64_t));
+        memcpy(payload.data() + sizeof(uint64_t), index_.data(), index_.size() * sizeof(CaptureIndexEntry));
+        appendBlock(CAPTURE_INDEX_MAGIC, payload.data(), payload.size(), static_cast<uint32_t>(index_.size()),
+                    index_.front().firstNs, index_.back().lastNs);
+        lastIndexOffset_ = indexOffset;
+        index_.clear();
+    }
+
+    bool writeOutput() {
+        bool ok = writeAll(fd_, output_.data(), output_.size());
+        offset_ += output_.size();
+        output_.clear();
+        return ok;
+    }
+
+    size_t indexInterval_;
+    int fd_ = -1;
+    uint64_t offset_ = 0;                   // Bytes in the file
+    uint64_t lastIndexOffset_ = 0;
+    std::vector<CaptureIndexEntry> index_;  // Data blocks since the last index block
+    std::vector<uint8_t> pending_;          // Payload of the data block being built
+    uint32_t pendingRecords_ = 0;
+    int64_t pendingBaseNs_ = 0;             // Receive time of the first record in the pending block
+    int64_t pendingMinUs_ = 0;              // Smallest time offset in the pending block
+    int64_t pendingLastNs_ = 0;             // Latest receive time in the pending block
+    std::vector<uint8_t> output_;           // Blocks written by the next write()
+};
+
+/* Read-only mmap view of a capture file
+
+open() maps the file and loads the block index (from the index blocks if the file was closed,
+otherwise by walking the block headers). forEachRecord() visits the frames received in a time
+range; only the data blocks overlapping the range are touched.
+*/
+class CaptureReader {
+public:
+    CaptureReader() = default;
+    ~CaptureReader() { close(); }
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    bool open(const std::string& filename) {
+        close();
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror("Capture file open failed");
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(CaptureFileHeader)) {
+            fprintf(stderr, "%s: not a capture file\n", filename.c_str());
+            ::close(fd);
+            return false;
+        }
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            perror("Capture mmap failed");
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(data);
+        size_ = st.st_size;
+
+        const CaptureFileHeader* header = reinterpret_cast<const CaptureFileHeader*>(data_);
+        if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 || header->version != CAPTURE_VERSION) {
+            fprintf(stderr, "%s: not a version %d capture file\n", filename.c_str(), CAPTURE_VERSION);
+            close();
+            return false;
+        }
+        madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+
+        closedCleanly_ = header->lastIndexOffset != 0 && loadIndexChain(header->lastIndexOffset);
+        if (!closedCleanly_) {
+            scanBlocks(header->headerSize);
+        }
+        return true;
+    }
+
+    void close() {
+        if (data_) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+            data_ = nullptr;
+        }
+        blocks_.clear();
+    }
+
+    // Data blocks in file order
+    const std::vector<CaptureIndexEntry>& blocks() const { return blocks_; }
+
+    // True if the block index came from the index blocks (the writer closed the file)
+    bool closedCleanly() const { return closedCleanly_; }
+
+    uint64_t fileSize() const { return size_; }
+
+    uint64_t recordCount() const {
+        uint64_t count = 0;
+        for (const CaptureIndexEntry& block : blocks_) {
+            count += block.recordCount;
+        }
+        return count;
+    }
+
+    /* Call fn(const CaptureRecord&) for every frame received in [fromNs, toNs]
+
+    Returns false if a block's checksum did not match (the records of that block are skipped).
+    */
+    template <typename Fn>
+    bool forEachRecord(int64_t fromNs, int64_t toNs, Fn&& fn) const {
+        bool ok = true;
+        // Data blocks are in time order, so skip every block that ended before fromNs
+        auto first = std::lower_bound(blocks_.begin(), blocks_.end(), fromNs,
+            [](const CaptureIndexEntry& block, int64_t t) { return block.lastNs < t; });
+        for (auto it = first; it != blocks_.end() && it->firstNs <= toNs; ++it) {
+            const CaptureBlockHeader* header = reinterpret_cast<const CaptureBlockHeader*>(data_ + it->offset);
+            const uint8_t* payload = data_ + it->offset + sizeof(CaptureBlockHeader);
+            if (captureChecksum(payload, header->payloadBytes) != header->checksum) {
+                ok = false;
+                continue;
+            }
+            const uint8_t* p = payload;
+            const uint8_t* end = payload + header->payloadBytes;
+            while (p + CAPTURE_RECORD_HEADER + FRAME_HEADER_SIZE <= end) {
+                uint32_t fields[2];
+                memcpy(fields, p, sizeof(fields));
+                CaptureRecord record;
+                record.receivedNs = header->firstNs + static_cast<int64_t>(fields[0]) * 1000;
+                record.connectionId = fields[1];
+                record.frame = p + CAPTURE_RECORD_HEADER;
+                record.size = record.frame[2] + FRAME_OVERHEAD;
+                if (record.frame + record.size > end) {
+                    break;
+                }
+                p = record.frame + record.size;
+                if (record.receivedNs >= fromNs && record.receivedNs <= toNs) {
+                    fn(record);
+                }
+            }
+        }
+        return ok;
+    }
+
+private:
+    // The block header at offset, or nullptr if the block does not fit in the file
+    const CaptureBlockHeader* blockAt(uint64_t offset) const {
+        if (offset > size_ || size_ - offset < sizeof(CaptureBlockHeader)) {
+            return nullptr;
+        }
+        const CaptureBlockHeader* header = reinterpret_cast<const CaptureBlockHeader*>(data_ + offset);
+        if (offset + sizeof(CaptureBlockHeader) + header->payloadBytes > size_) {
+            return nullptr;     // Torn block at the end of the file
+        }
+        return header;
+    }
+
+    /* Load the block index from the chain of index blocks ending at offset
+
+    Returns false if an index block is torn or corrupted, or one of its entries does not point at a
+    data block inside the file; open() then walks the block headers instead.
+    */
+    bool loadIndexChain(uint64_t offset) {
+        std::vector<std::vector<CaptureIndexEntry>> chain;
+        while (offset != 0) {
+            const CaptureBlockHeader* header = blockAt(offset);
+            if (!header || header->magic != CAPTURE_INDEX_MAGIC ||
+                header->payloadBytes != sizeof(uint64_t) + static_cast<uint64_t>(header->recordCount) * sizeof(CaptureIndexEntry)) {
+                return false;
+            }
+            const uint8_t* payload = data_ + offset + sizeof(CaptureBlockHeader);
+            if (captureChecksum(payload, header->payloadBytes) != header->checksum) {
+                return false;
+            }
+            const CaptureIndexEntry* entries = reinterpret_cast<const CaptureIndexEntry*>(payload + sizeof(uint64_t));
+            for (uint32_t i = 0; i < header->recordCount; i++) {
+                const CaptureBlockHeader* block = blockAt(entries[i].offset);
+                if (!block || block->magic != CAPTURE_DATA_MAGIC) {
+                    return false;
+                }
+            }
+            chain.emplace_back(entries, entries + header->recordCount);
+            uint64_t previous;
+            memcpy(&previous, payload, sizeof(previous));
+            if (previous >= offset) {
+                return false;
+            }
+            offset = previous;
+        }
+        blocks_.clear();
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            blocks_.insert(blocks_.end(), it->begin(), it->end());
+        }
+        return true;
+    }
+
+    void scanBlocks(uint64_t offset) {
+        blocks_.clear();
+        while (const CaptureBlockHeader* header = blockAt(offset)) {
+            if (header->magic == CAPTURE_DATA_MAGIC) {
+                CaptureIndexEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.offset = offset;
+                entry.firstNs = header->firstNs;
+                entry.lastNs = header->lastNs;
+                entry.recordCount = header->recordCount;
+                blocks_.push_back(entry);
+            } else if (header->magic != CAPTURE_INDEX_MAGIC) {
+                break;
+            }
+            offset += sizeof(CaptureBlockHeader) + header->payloadBytes;
+        }
+    }
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool closedCleanly_ = false;
+    std::vector<CaptureIndexEntry> blocks_;
+};
@@ -0,0 +1,293 @@
+/**
+ * Command channel to the RFID readers.
+ *
+ * Every reader connection can also carry commands from the server to the reader (start or stop the
+ * inventory, set the antenna power etc.). A command is a 0xBB frame like the ones the reader sends,
+ * built by buildFrame() with the same sum-and-mask checksum the receive path verifies. The reader
+ * answers every command with one frame; which TYPE that is, is part of the command (the command's
+ * own TYPE unless set otherwise).
+ *
+ * CommandChannel is the per-connection state:
+ *
+ *      queued          commands waiting to be written, in the order they were queued
+ *      in flight       commands written to the socket and waiting for their answer
+ *
+ * Commands are pipelined: up to `window` commands are in flight at once, so a reader gets its next
+ * command without waiting one round trip per command. flush() writes every queued frame that fits
+ * in the window with one vectored write, straight out of the command records (the frames are not
+ * copied into a send buffer). That is sendmsg() with MSG_NOSIGNAL, a writev() that returns EPIPE
+ * instead of raising SIGPIPE when the reader is gone. A frame the socket only took part of is
+ * finished by the next flush().
+ *
+ * An answer is matched to the oldest command in flight that expects its TYPE (match()); frames that
+ * match no command are handled as usual. Timeouts are kept by the owner (expire() takes the
+ * sequence number of a command that is due), so the channel never reads a clock on its own.
+ *
+ * A command that timed out stays in flight as an abandoned placeholder: if its answer still comes,
+ * the placeholder takes it, not the next command waiting for the same TYPE (which would then be
+ * handed the wrong Data, and its own answer would match nothing). The owner drops the placeholder
+ * (drop()) after a second timeout. Until then it keeps its place in the window, as the reader may
+ * still be working on it.
+ *
+ * The channel is only used by the event loop thread. ReaderServer::submitCommand() hands commands
+ * from other threads to the event loop.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <deque>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "frame_parser.h"
+
+#define COMMAND_MAX_DATA 64         // Data bytes of one command
+#define COMMAND_WINDOW 8            // Default commands in flight per reader
+#define COMMAND_TIMEOUT_MS 1000     // Default time a reader has to answer a command
+#define COMMAND_QUEUE_SIZE 4096     // Commands that can wait between submitCommand() and the event loop
+#define COMMAND_CHANNEL_LIMIT 256   // Commands queued or in flight per reader (more are rejected)
+#define COMMAND_WRITE_FRAMES 64     // Frames gathered into one sendmsg()
+
+// Build a complete frame (Head, Type, Len, Data, CRC, 0x0D 0x0A) into out. Returns its size.
+inline size_t buildFrame(uint8_t* out, uint8_t type, const uint8_t* data, uint8_t len) {
+    out[0] = FRAME_HEAD;
+    out[1] = type;
+    out[2] = len;
+    memcpy(out + FRAME_HEADER_SIZE, data, len);
+    out[FRAME_HEADER_SIZE + len] = frameChecksum(out);
+    out[FRAME_HEADER_SIZE + len + 1] = FRAME_END1;
+    out[FRAME_HEADER_SIZE + len + 2] = FRAME_END2;
+    return len + FRAME_OVERHEAD;
+}
+
+// A command for one reader (connectionId) or for every connected reader (connectionId 0)
+struct ReaderCommand {
+    uint32_t connectionId = 0;
+    uint8_t type = 0;               // TYPE of the command frame
+    int responseType = -1;          // TYPE of the answer (-1: the same as type)
+    uint8_t len = 0;
+    uint8_t data[COMMAND_MAX_DATA] = {};
+    uint64_t tag = 0;               // Caller's value, handed back with the result
+
+    uint8_t answerType() const { return responseType < 0 ? type : static_cast<uint8_t>(responseType); }
+};
+
+/* Parse a command from the command line: TYPE:DATA in hex, e.g. "22:" or "b6:0a28"
+
+responseType is set when the text ends with "/TYPE" (e.g. "27:22ffff/22"). Returns false if the
+text is not a valid command.
+*/
+inline bool parseReaderCommand(const std::string& text, ReaderCommand& command) {
+    auto hexValue = [](char c) {
+        return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    };
+    auto hexByte = [&hexValue](const std::string& digits, size_t at) {
+        int high = hexValue(digits[at]), low = hexValue(digits[at + 1]);
+        return high < 0 || low < 0 ? -1 : high * 16 + low;
+    };
+    size_t colon = text.find(':');
+    size_t slash = text.find('/');
+    std::string data = text.substr(colon + 1, slash == std::string::npos ? std::string::npos : slash - colon - 1);
+    if (colon != 2 || data.size() % 2 || data.size() / 2 > COMMAND_MAX_DATA ||
+        (slash != std::string::npos && text.size() != slash + 3)) {
+        return false;
+    }
+    int type = hexByte(text, 0);
+    if (type < 0) {
+        return false;
+    }
+    command.type = static_cast<uint8_t>(type);
+    command.len = static_cast<uint8_t>(data.size() / 2);
+    for (size_t i = 0; i < command.len; i++) {
+        int value = hexByte(data, 2 * i);
+        if (value < 0) {
+            return false;
+        }
+        command.data[i] = static_cast<uint8_t>(value);
+    }
+    if (slash != std::string::npos) {
+        command.responseType = hexByte(text, slash + 1);
+        if (command.responseType < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum class CommandStatus {
+    Answered,       // The reader answered (response holds the answer's Data)
+    TimedOut,       // No answer within the timeout
+    Closed,         // The connection closed before the answer
+    Rejected,       // No such reader, or too many commands queued for it
+};
+
+inline const char* commandStatusName(CommandStatus status) {
+    switch (status) {
+        case CommandStatus::Answered: return "answered";
+        case CommandStatus::TimedOut: return "timed out";
+        case CommandStatus::Closed: return "connection closed";
+        case CommandStatus::Rejected: return "rejected";
+    }
+    return "unknown";
+}
+
+// Outcome of one command, handed to the command handler on the event loop thread
+struct CommandResult {
+    uint32_t connectionId = 0;
+    const char* address = "";      // "ip:port" of the reader (only valid in the handler)
+    uint8_t type = 0;
+    uint64_t tag = 0;
+    CommandStatus status = CommandStatus::Rejected;
+    ByteSpan response;              // Data of the answer (only valid in the handler)
+    int64_t latencyNs = 0;          // From the frame being written to its answer (or timeout)
+};
+
+// One command in a channel
+struct PendingCommand {
+    uint64_t sequence = 0;          // Server-wide number, names the command to its timeout
+    uint64_t tag = 0;
+    uint8_t answerType = 0;
+    bool onConnect = false;         // Queued by the server when the reader connected (config.connectCommands)
+    bool abandoned = false;         // Timed out; waits for a late answer until drop()
+    uint16_t size = 0;
+    int64_t writtenNs = 0;          // Time the last byte was written
+    uint8_t frame[COMMAND_MAX_DATA + FRAME_OVERHEAD];
+};
+
+class CommandChannel {
+public:
+    // Queue a command. Returns false if the channel already holds COMMAND_CHANNEL_LIMIT commands.
+    bool queue(const ReaderCommand& command, uint64_t sequence, bool onConnect) {
+        if (commands_.size() >= COMMAND_CHANNEL_LIMIT) {
+            return false;
+        }
+        PendingCommand& pending = commands_.emplace_back();
+        pending.sequence = sequence;
+        pending.tag = command.tag;
+        pending.answerType = command.answerType();
+        pending.onConnect = onConnect;
+        pending.size = static_cast<uint16_t>(buildFrame(pending.frame, command.type, command.data, command.len));
+        return true;
+    }
+
+    // True if flush() has something to write
+    bool writable(size_t window) const { return inFlight_ < commands_.size() && inFlight_ < window; }
+
+    size_t inFlight() const { return inFlight_; }
+    bool empty() const { return commands_.empty(); }
+
+    /* Write the queued frames that fit in the window with one sendmsg()
+
+    onWritten(command) is called for every frame written completely. Returns false with errno set
+    if the socket failed; a full socket (EAGAIN) is not a failure, the rest stays queued.
+    */
+    template <typename OnWritten>
+    bool flush(int fd, size_t window, int64_t nowNs, uint64_t& writes, OnWritten&& onWritten) {
+        while (writable(window)) {
+            struct iovec iov[COMMAND_WRITE_FRAMES];
+            int count = 0;
+            for (size_t i = inFlight_; i < commands_.size() && i < window && count < COMMAND_WRITE_FRAMES; i++) {
+                size_t skip = i == inFlight_ ? partial_ : 0;
+                iov[count].iov_base = commands_[i].frame + skip;
+                iov[count].iov_len = commands_[i].size - skip;
+                count++;
+            }
+            struct msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            ssize_t written = sendmsg(fd, &message, MSG_NOSIGNAL);
+            if (written < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            writes++;
+            size_t left = written;
+            while (left > 0) {
+                PendingCommand& command = commands_[inFlight_];
+                size_t rest = command.size - partial_;
+                if (left < rest) {
+                    partial_ += left;
+                    return true;    // The socket is full
+                }
+                left -= rest;
+                partial_ = 0;
+                command.writtenNs = nowNs;
+                inFlight_++;
+                onWritten(command);
+            }
+        }
+        return true;
+    }
+
+    /* Remove the oldest command in flight that expects type
+
+    onAnswer(command) is called unless the command was abandoned (the late answer is dropped with the
+    placeholder). Returns false if no command expects type.
+    */
+    template <typename OnAnswer>
+    bool match(uint8_t type, OnAnswer&& onAnswer) {
+        for (size_t i = 0; i < inFlight_; i++) {
+            if (commands_[i].answerType == type) {
+                PendingCommand command = commands_[i];
+                remove(i);
+                if (!command.abandoned) {
+                    onAnswer(command);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Hand the command in flight with this sequence number to onExpired and mark it abandoned (if it is still there)
+    template <typename OnExpired>
+    bool expire(uint64_t sequence, OnExpired&& onExpired) {
+        for (size_t i = 0; i < inFlight_; i++) {
+            if (commands_[i].sequence == sequence && !commands_[i].abandoned) {
+                commands_[i].abandoned = true;
+                onExpired(commands_[i]);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Remove the abandoned command with this sequence number (if its answer did not come in the meantime)
+    bool drop(uint64_t sequence) {
+        for (size_t i = 0; i < inFlight_; i++) {
+            if (commands_[i].sequence == sequence && commands_[i].abandoned) {
+                remove(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Hand every command not yet abandoned to onDropped and empty the channel (the connection closed)
+    template <typename OnDropped>
+    void clear(OnDropped&& onDropped) {
+        std::deque<PendingCommand> commands;
+        commands.swap(commands_);
+        inFlight_ = 0;
+        partial_ = 0;
+        for (PendingCommand& command : commands) {
+            if (!command.abandoned) {
+                onDropped(command);
+            }
+        }
+    }
+
+private:
+    void remove(size_t i) {
+        commands_.erase(commands_.begin() + i);
+        inFlight_--;
+    }
+
+    std::deque<PendingCommand> commands_;   // In flight first, then queued
+    size_t inFlight_ = 0;                   // Commands at the front written completely
+    size_t partial_ = 0;                    // Bytes written of commands_[inFlight_]
+};
@@ -0,0 +1,175 @@
+/**
+ * Batch checksum validation of RFID reader frames with SIMD byte-sum kernels.
+ *
+ * The checksum of a frame is the low byte of the sum of its Type, Len and Data bytes (see
+ * frame_parser.h). The reassembler finds the boundaries of every complete frame in a read first and
+ * then validates the whole batch with one call of a kernel:
+ *
+ *      scalar:     frameChecksum() per frame, one byte per add (the reference)
+ *      sse2:       16 bytes per _mm_sad_epu8 (x86-64, always available there)
+ *      avx2:       32 bytes per _mm256_sad_epu8 (x86-64 CPUs with AVX2)
+ *      neon:       16 bytes per vpadalq_u8 (aarch64, and 32-bit ARM when built with -mfpu=neon)
+ *
+ * The last partial block of a frame is loaded whole and the bytes past the summed range are masked
+ * to zero, so a tag read (21 summed bytes) costs one or two loads instead of 21 adds. The kernels
+ * may therefore read up to CHECKSUM_READ_PADDING bytes past the end of a frame. Those bytes must be
+ * mapped (they are never used): ByteRing keeps a readable guard page after its mirror mapping for
+ * this. Callers with frames in ordinary buffers keep using frameChecksum().
+ *
+ * checksumKernel() picks the widest kernel the CPU supports once, at the first call. The AVX2 kernel
+ * is compiled with a target attribute, so no -mavx2 is needed and the program still runs on CPUs
+ * without AVX2. checksumKernels() lists every kernel this CPU can run (for the benchmark).
+ *
+ * Additional documentation: https://www.intel.com/content/www/us/en/docs/intrinsics-guide/index.html
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "frame_parser.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CHECKSUM_X86 1
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CHECKSUM_NEON 1
+#endif
+
+#define CHECKSUM_READ_PADDING 32        // Bytes past a frame the SIMD kernels may load (and mask off)
+#define FRAME_BATCH_SIZE 64             // Frames validated per kernel call
+
+// Validate count frames: ok[i] = the checksum of frames[i] matches its CRC byte. Returns the number of valid frames.
+using ChecksumBatchFn = size_t (*)(const uint8_t* const* frames, size_t count, bool* ok);
+
+struct ChecksumKernel {
+    const char* name;
+    ChecksumBatchFn validate;
+};
+
+inline size_t validateChecksumsScalar(const uint8_t* const* frames, size_t count, bool* ok) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        ok[i] = frameChecksum(frames[i]) == frames[i][FRAME_HEADER_SIZE + frames[i][2]];
+        valid += ok[i];
+    }
+    return valid;
+}
+
+// 0xFF followed by 0x00: loading at mask + 32 - n gives n 0xFF bytes then zeros
+alignas(64) static const uint8_t checksumTailMask[64] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+#ifdef CHECKSUM_X86
+
+// Sum of n bytes (may read up to 15 bytes past them)
+inline uint32_t sumBytesSse2(const uint8_t* bytes, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (; n >= 16; n -= 16, bytes += 16) {
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)), zero));
+    }
+    if (n) {
+        __m128i tail = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(checksumTailMask + 32 - n)));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(tail, zero));
+    }
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+}
+
+inline size_t validateChecksumsSse2(const uint8_t* const* frames, size_t count, bool* ok) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* frame = frames[i];
+        uint8_t sum = static_cast<uint8_t>(sumBytesSse2(frame + 1, frame[2] + 2u));
+        ok[i] = sum == frame[FRAME_HEADER_SIZE + frame[2]];
+        valid += ok[i];
+    }
+    return valid;
+}
+
+// Sum of n bytes (may read up to 31 bytes past them)
+__attribute__((target("avx2"))) inline uint32_t sumBytesAvx2(const uint8_t* bytes, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = zero;
+    for (; n >= 32; n -= 32, bytes += 32) {
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes)), zero));
+    }
+    if (n) {
+        __m256i tail = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(checksumTailMask + 32 - n)));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(tail, zero));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8)));
+}
+
+__attribute__((target("avx2"))) inline size_t validateChecksumsAvx2(const uint8_t* const* frames, size_t count, bool* ok) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* frame = frames[i];
+        uint8_t sum = static_cast<uint8_t>(sumBytesAvx2(frame + 1, frame[2] + 2u));
+        ok[i] = sum == frame[FRAME_HEADER_SIZE + frame[2]];
+        valid += ok[i];
+    }
+    return valid;
+}
+
+#endif
+
+#ifdef CHECKSUM_NEON
+
+/* Sum of n bytes (may read up to 15 bytes past them)
+
+vpadalq_u8 adds pairs of bytes into 8 16-bit lanes. A frame sums at most 257 bytes, far below what
+the lanes can hold.
+*/
+inline uint32_t sumBytesNeon(const uint8_t* bytes, size_t n) {
+    uint16x8_t sum = vdupq_n_u16(0);
+    for (; n >= 16; n -= 16, bytes += 16) {
+        sum = vpadalq_u8(sum, vld1q_u8(bytes));
+    }
+    if (n) {
+        sum = vpadalq_u8(sum, vandq_u8(vld1q_u8(bytes), vld1q_u8(checksumTailMask + 32 - n)));
+    }
+    uint64x2_t wide = vpaddlq_u32(vpaddlq_u16(sum));
+    return static_cast<uint32_t>(vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1));
+}
+
+inline size_t validateChecksumsNeon(const uint8_t* const* frames, size_t count, bool* ok) {
+    size_t valid = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* frame = frames[i];
+        uint8_t sum = static_cast<uint8_t>(sumBytesNeon(frame + 1, frame[2] + 2u));
+        ok[i] = sum == frame[FRAME_HEADER_SIZE + frame[2]];
+        valid += ok[i];
+    }
+    return valid;
+}
+
+#endif
+
+// Every kernel this CPU can run, scalar first and the preferred one last
+inline std::vector<ChecksumKernel> checksumKernels() {
+    std::vector<ChecksumKernel> kernels = {{"scalar", validateChecksumsScalar}};
+#ifdef CHECKSUM_X86
+    kernels.push_back({"sse2", validateChecksumsSse2});
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2", validateChecksumsAvx2});
+    }
+#endif
+#ifdef CHECKSUM_NEON
+    kernels.push_back({"neon", validateChecksumsNeon});
+#endif
+    return kernels;
+}
+
+// The kernel used by the reassembler (picked once)
+inline const ChecksumKernel& checksumKernel() {
+    static const ChecksumKernel kernel = checksumKernels().back();
+    return kernel;
+}
@@ -0,0 +1,202 @@
+/**
+ * Compile-time frame type registry and dispatch table.
+ *
+ * Every frame type the readers send is described once, by the struct its Data is decoded into:
+ *
+ *      type                TYPE byte
+ *      minLen, maxLen      Len range of a well-formed frame of the type
+ *      decode(data, out)   fills the struct from Data at fixed offsets (false: the frame is malformed)
+ *
+ * Code that handles frames lists the types it handles with a handler for each. The handler gets the
+ * decoded struct, not the raw bytes:
+ *
+ *      void onTagRead(Context& context, const TagReadFrame& frame);
+ *
+ *      using Dispatcher = FrameDispatcher<Context, onUnknown, onMalformed,
+ *                                         FrameHandler<TagReadFrame, onTagRead>,
+ *                                         FrameHandler<HeartbeatFrame, onHeartbeat>>;
+ *      Dispatcher::dispatch(context, view);
+ *
+ * The list is turned into a 256-entry table of function pointers, one per TYPE byte, at compile time.
+ * The entry of a listed type is decodeAndHandle() instantiated for it, with the Len check, decode()
+ * and the handler inlined. A frame therefore costs one indexed call, with no virtual functions and no
+ * allocations. Types not in the list go to onUnknown and frames with a Len out of range, or that
+ * decode() rejects, go to onMalformed. Listing two handlers for one TYPE does not compile.
+ *
+ * Adding a frame type: its TYPE in frame_parser.h, its struct below and a line in the list of
+ * the code that handles it (ReaderServer::FrameTypes for the server). The event loop is not touched.
+ *
+ * The decoded structs point into the frame, like FrameView, so they are only valid in the handler.
+*/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "frame_parser.h"
+
+// Big-endian 16-bit field
+constexpr uint16_t frameUint16(const uint8_t* bytes) {
+    return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+// 0x3a: the reader accepted the TCP connection
+struct ConnectFrame {
+    static constexpr uint8_t type = FRAME_TYPE_CONNECT;
+    static constexpr uint8_t minLen = 0;
+    static constexpr uint8_t maxLen = 255;
+
+    ByteSpan info;                  // Reader information (02 00 00 from our readers)
+
+    static constexpr bool decode(ByteSpan data, ConnectFrame& frame) {
+        frame.info = data;
+        return true;
+    }
+};
+
+// 0x17: one tag was read
+struct TagReadFrame {
+    static constexpr uint8_t type = FRAME_TYPE_TAG_READ;
+    static constexpr uint8_t minLen = EPC_OFFSET + EPC_LEN;
+    static constexpr uint8_t maxLen = 255;
+
+    uint16_t pc = 0;                // Protocol control word of the tag (Data[0..1])
+    const uint8_t* epc = nullptr;   // EPC_LEN bytes at Data + EPC_OFFSET
+    ByteSpan extra;                 // The bytes after the EPC (RSSI, antenna etc., as set up on the reader)
+
+    static constexpr bool decode(ByteSpan data, TagReadFrame& frame) {
+        frame.pc = frameUint16(data.data);
+        frame.epc = data.data + EPC_OFFSET;
+        frame.extra.data = data.data + EPC_OFFSET + EPC_LEN;
+        frame.extra.size = data.size - (EPC_OFFSET + EPC_LEN);
+        return true;
+    }
+};
+
+// 0x40: the reader is alive
+struct HeartbeatFrame {
+    static constexpr uint8_t type = FRAME_TYPE_HEARTBEAT;
+    static constexpr uint8_t minLen = 2;
+    static constexpr uint8_t maxLen = 255;
+
+    uint16_t status = 0;            // Data[0..1] (00 01 from our readers)
+
+    static constexpr bool decode(ByteSpan data, HeartbeatFrame& frame) {
+        frame.status = frameUint16(data.data);
+        return true;
+    }
+};
+
+// 0x18: an inventory round ended
+struct InventoryEndFrame {
+    static constexpr uint8_t type = FRAME_TYPE_INVENTORY_END;
+    static constexpr uint8_t minLen = 2;
+    static constexpr uint8_t maxLen = 255;
+
+    uint16_t tags = 0;              // Tag reads the reader sent in the round
+
+    static constexpr bool decode(ByteSpan data, InventoryEndFrame& frame) {
+        frame.tags = frameUint16(data.data);
+        return true;
+    }
+};
+
+// 0x41: an antenna port was connected or disconnected
+struct AntennaStatusFrame {
+    static constexpr uint8_t type = FRAME_TYPE_ANTENNA_STATUS;
+    static constexpr uint8_t minLen = 2;
+    static constexpr uint8_t maxLen = 255;
+
+    uint8_t antenna = 0;            // Antenna port (1 based)
+    bool connected = false;         // Status byte 0 means connected
+
+    static constexpr bool decode(ByteSpan data, AntennaStatusFrame& frame) {
+        frame.antenna = data[0];
+        frame.connected = data[1] == 0;
+        return true;
+    }
+};
+
+// 0xff: the reader reports an error
+struct ReaderErrorFrame {
+    static constexpr uint8_t type = FRAME_TYPE_ERROR;
+    static constexpr uint8_t minLen = 1;
+    static constexpr uint8_t maxLen = 255;
+
+    uint8_t code = 0;               // Error code (Data[0])
+    ByteSpan detail;                // The rest of Data
+
+    static constexpr bool decode(ByteSpan data, ReaderErrorFrame& frame) {
+        frame.code = data[0];
+        frame.detail.data = data.data + 1;
+        frame.detail.size = data.size - 1;
+        return true;
+    }
+};
+
+// One entry of the dispatch table: a frame struct and the function that handles it
+template <typename Frame, auto Handler>
+struct FrameHandler {
+    using FrameType = Frame;
+    static constexpr auto handler = Handler;
+    static_assert(Frame::minLen <= Frame::maxLen, "Empty Len range");
+};
+
+template <typename Context>
+using FrameDispatchFn = void (*)(Context&, const FrameView&);
+
+// Table entry of a listed type: check Len, decode, handle
+template <typename Context, auto Malformed, typename Handler>
+void decodeAndHandle(Context& context, const FrameView& view) {
+    using Frame = typename Handler::FrameType;
+    Frame frame;
+    // One unsigned compare checks both ends of the range
+    if (static_cast<unsigned>(view.len - Frame::minLen) > static_cast<unsigned>(Frame::maxLen - Frame::minLen) ||
+        !Frame::decode(view.data, frame)) {
+        Malformed(context, view);
+        return;
+    }
+    Handler::handler(context, frame);
+}
+
+template <typename... Handlers>
+constexpr bool uniqueFrameTypes() {
+    int types[] = {-1, Handlers::FrameType::type...};
+    for (size_t i = 1; i < sizeof(types) / sizeof(types[0]); i++) {
+        for (size_t j = i + 1; j < sizeof(types) / sizeof(types[0]); j++) {
+            if (types[i] == types[j]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Context, auto Unknown, auto Malformed, typename... Handlers>
+constexpr std::array<FrameDispatchFn<Context>, 256> buildFrameDispatchTable() {
+    static_assert(uniqueFrameTypes<Handlers...>(), "Two handlers for one frame TYPE");
+    std::array<FrameDispatchFn<Context>, 256> table{};
+    for (FrameDispatchFn<Context>& entry : table) {
+        entry = Unknown;
+    }
+    ((table[Handlers::FrameType::type] = &decodeAndHandle<Context, Malformed, Handlers>), ...);
+    return table;
+}
+
+template <typename Context, auto Unknown, auto Malformed, typename... Handlers>
+class FrameDispatcher {
+public:
+    // Hand a parsed frame to the handler of its TYPE
+    static void dispatch(Context& context, const FrameView& view) {
+        table[view.type](context, view);
+    }
+
+    // True if type has a handler in the list
+    static constexpr bool handles(uint8_t type) {
+        return ((Handlers::FrameType::type == type) || ...);
+    }
+
+    static constexpr std::array<FrameDispatchFn<Context>, 256> table =
+        buildFrameDispatchTable<Context, Unknown, Malformed, Handlers...>();
+};
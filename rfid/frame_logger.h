@@ -0,0 +1,396 @@
+/**
+ * Asynchronous batched csv logger.
+ *
+ * The receive thread must never wait on the disk (SD cards on the Raspberry Pi can stall for tens of
+ * milliseconds). FrameLogger therefore runs its own thread. The receive thread copies every frame
+ * into a lock-free single-producer queue (log() never blocks and never makes a system call); the
+ * logger thread formats the queued frames as hex into one large preallocated buffer and writes the
+ * whole batch with a single write() once flushBytes of text are ready or flushIntervalMs passed.
+ *
+ * csv layout: one row per frame, every byte as two hex characters followed by a comma:
+ *      bb,40,02,00,01,43,0d,0a,
+ *
+ * With compression enabled every batch of csv text is compressed into one block (log_compression.h)
+ * by the logger thread before it is written, and the file is named .csv.rlz. RFID_Log_Cat.cpp prints
+ * it as csv again.
+ *
+ * With capture enabled the same frames are also written, with their receive time and connection id,
+ * to a binary capture file (capture_file.h) next to the csv file. Each batch becomes one data block.
+ * Either output can be turned off.
+ *
+ * Files are named data_logs/client_data_log_<datetime>.csv (and .rfidcap) and new ones are started
+ * once the current files reach rotateBytes or are older than rotateSeconds. rotateBytes counts the
+ * bytes on disk, after compression. If the new files can not be opened (disk full, read-only SD card)
+ * the logger keeps writing to the current ones and tries again after another rotateBytes or
+ * rotateSeconds.
+ *
+ * When the disk falls behind and the queue fills up, log() drops the frame and counts it. The queue
+ * depth and the dropped-frame count are available from stats() and the logger thread prints a
+ * warning (at most once a second) while frames are being dropped.
+ *
+ * loggedLatency() is a histogram of the time from a frame's receive time stamp to the end of the
+ * write() of its batch, recorded by the logger thread for every frame.
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "capture_file.h"
+#include "frame_parser.h"
+#include "log_compression.h"
+#include "metrics.h"
+#include "spsc_queue.h"
+
+// Logger settings (see ServerConfig for the command line options)
+struct LoggerConfig {
+    std::string folder = "data_logs";           // Folder to save data logs in
+    std::string baseName = "client_data_log";   // File name before the _<datetime>.csv suffix
+    bool csv = true;                            // Write the csv log
+    bool capture = false;                       // Write the binary capture file
+    bool compress = false;                      // Write the csv log as compressed blocks (.csv.rlz)
+    size_t queueSize = 16384;                   // Frames that can wait for the logger thread
+    size_t batchBytes = 1 << 20;                // Size of the preallocated text buffer
+    size_t flushBytes = 256 * 1024;             // Write once this much text is ready
+    int flushIntervalMs = 1000;                 // ... or once this much time passed
+    uint64_t rotateBytes = 64ULL << 20;         // Start a new file at this size (0 = never)
+    int rotateSeconds = 3600;                   // Start a new file after this time (0 = never)
+};
+
+// One queued frame
+struct LogRecord {
+    int64_t receivedNs;             // Receive time (ns since the epoch)
+    uint32_t connectionId;          // Id of the reader connection
+    uint16_t size;                  // Frame bytes used
+    uint8_t bytes[MAX_FRAME_SIZE];
+};
+
+// Logger counters, readable from any thread
+struct LoggerStats {
+    uint64_t queueDepth = 0;        // Frames waiting for the logger thread
+    uint64_t queueCapacity = 0;
+    uint64_t dropped = 0;           // Frames dropped because the queue was full
+    uint64_t framesWritten = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t csvBytes = 0;          // csv text formatted
+    uint64_t csvStoredBytes = 0;    // ... and written to the csv files (less with compression)
+    uint64_t batches = 0;           // write() calls
+    uint64_t files = 0;             // Files opened (rotations + 1)
+    uint64_t rotateFailures = 0;    // Rotations that could not open the new files
+};
+
+// Generate a new filename with creation date and time
+inline std::string generateNewFilename(const std::string& baseFilename) {
+    // Get the current date and time
+    auto now = std::chrono::system_clock::now();
+    std::time_t currentTime = std::chrono::system_clock::to_time_t(now);
+
+    // Format the date and time
+    std::stringstream datetimeSS;
+    datetimeSS << std::put_time(std::localtime(&currentTime), "%Y-%m-%d_%H-%M-%S");
+    std::string datetime = datetimeSS.str();
+
+    // Construct the filename
+    std::stringstream filenameSS;
+    filenameSS << baseFilename << "_" << datetime << ".csv";
+    return filenameSS.str();
+}
+
+class FrameLogger {
+public:
+    explicit FrameLogger(const LoggerConfig& config) : config_(config), queue_(config.queueSize) {
+        buffer_.resize(std::max(config_.batchBytes, static_cast<size_t>(4 * MAX_FRAME_SIZE)));
+        batchTimes_.reserve(config_.queueSize);
+        if (config_.compress) {
+            compressed_.resize(sizeof(LzBlockHeader) + lzCompressBound(buffer_.size()));
+        }
+    }
+    ~FrameLogger() { stop(); }
+
+    FrameLogger(const FrameLogger&) = delete;
+    FrameLogger& operator=(const FrameLogger&) = delete;
+
+    // Open the first file and start the logger thread
+    bool start() {
+        mkdir(config_.folder.c_str(), 0755);
+        if (!openNewFile()) {
+            return false;
+        }
+        stopping_.store(false);
+        thread_ = std::thread(&FrameLogger::run, this);
+        return true;
+    }
+
+    // Write everything still queued, close the files and join the thread
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        stopping_.store(true, std::memory_order_release);
+        thread_.join();
+        closeFiles();
+    }
+
+    // Receive thread: queue a copy of the frame. Returns false (and counts a drop) if the queue is full.
+    bool log(const uint8_t* frame, size_t size, int64_t receivedNs, uint32_t connectionId) {
+        LogRecord* record = queue_.tryReserve();
+        if (!record) {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        record->receivedNs = receivedNs;
+        record->connectionId = connectionId;
+        record->size = static_cast<uint16_t>(size);
+        memcpy(record->bytes, frame, size);
+        queue_.publish();
+        return true;
+    }
+
+    // Receive-to-written latency (ns) of every logged frame; written by the logger thread only
+    const LatencyHistogram& loggedLatency() const { return loggedLatency_; }
+
+    LoggerStats stats() const {
+        LoggerStats stats;
+        stats.queueDepth = queue_.size();
+        stats.queueCapacity = queue_.capacity();
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        stats.framesWritten = framesWritten_.load(std::memory_order_relaxed);
+        stats.bytesWritten = bytesWritten_.load(std::memory_order_relaxed);
+        stats.csvBytes = csvBytes_.load(std::memory_order_relaxed);
+        stats.csvStoredBytes = csvStoredBytes_.load(std::memory_order_relaxed);
+        stats.batches = batches_.load(std::memory_order_relaxed);
+        stats.files = files_.load(std::memory_order_relaxed);
+        stats.rotateFailures = rotateFailures_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void run() {
+        Clock::time_point lastFlush = Clock::now();
+        Clock::time_point lastWarning = lastFlush;
+        uint64_t droppedReported = 0;
+
+        while (true) {
+            bool stopping = stopping_.load(std::memory_order_acquire);
+
+            // Format every queued frame into the batch buffer (and the pending capture block)
+            size_t formatted = 0;
+            LogRecord* record;
+            while (formatted < queue_.capacity() && (record = queue_.front()) != nullptr) {
+                if (buffer_.size() - used_ < 3 * MAX_FRAME_SIZE + 1) {
+                    flush();
+                }
+                if (config_.csv) {
+                    char* row = buffer_.data() + used_;
+                    char* end = formatHex(row, record->bytes, record->size, ',');
+                    *end++ = '\n';
+                    used_ += end - row;
+                }
+                if (config_.capture) {
+                    capture_.append(record->bytes, record->size, record->receivedNs, record->connectionId);
+                    captureBatch_ += CAPTURE_RECORD_HEADER + record->size;
+                }
+                batchTimes_.push_back(record->receivedNs);
+                queue_.pop();
+                formatted++;
+
+                if (used_ + captureBatch_ >= config_.flushBytes) {
+                    flush();
+                }
+            }
+            framesWritten_.fetch_add(formatted, std::memory_order_relaxed);
+
+            Clock::time_point now = Clock::now();
+            if (used_ + captureBatch_ > 0 && now - lastFlush >= std::chrono::milliseconds(config_.flushIntervalMs)) {
+                flush();
+            }
+            if (used_ + captureBatch_ == 0) {
+                lastFlush = now;
+            }
+
+            // Time based rotation (flush() may already have rotated by size)
+            if (config_.rotateSeconds > 0 && now - fileOpened_ >= std::chrono::seconds(config_.rotateSeconds)) {
+                flush();
+                if (now - fileOpened_ >= std::chrono::seconds(config_.rotateSeconds)) {
+                    rotate();
+                }
+            }
+
+            uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+            if (dropped != droppedReported && now - lastWarning >= std::chrono::seconds(1)) {
+                std::cerr << "\033[1;31mLogger falling behind: " << dropped << " frames dropped (queue depth "
+                          << queue_.size() << "/" << queue_.capacity() << ")\033[0m" << std::endl;
+                droppedReported = dropped;
+                lastWarning = now;
+            }
+
+            if (stopping && queue_.front() == nullptr) {
+                flush();
+                return;
+            }
+            if (formatted == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    // Write the batch buffer with one write() (more only if the kernel accepts a partial write)
+    void flush() {
+        if (captureBatch_ > 0) {
+            uint64_t before = capture_.bytesWritten();
+            capture_.flush();
+            uint64_t written = capture_.bytesWritten() - before;
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            bytesWritten_.fetch_add(written, std::memory_order_relaxed);
+            fileBytes_ += written;
+            captureBatch_ = 0;
+        }
+
+        const char* data = buffer_.data();
+        size_t size = used_;
+        if (config_.compress && used_ > 0) {
+            size = compressor_.encodeBlock(reinterpret_cast<const uint8_t*>(buffer_.data()), used_, compressed_.data());
+            data = reinterpret_cast<const char*>(compressed_.data());
+        }
+        size_t written = 0;
+        while (written < size && fd_ >= 0) {
+            ssize_t n = write(fd_, data + written, size - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Log write failed");
+                break;
+            }
+            written += n;
+        }
+        if (used_ > 0) {
+            batches_.fetch_add(1, std::memory_order_relaxed);
+            bytesWritten_.fetch_add(written, std::memory_order_relaxed);
+            csvBytes_.fetch_add(used_, std::memory_order_relaxed);
+            csvStoredBytes_.fetch_add(written, std::memory_order_relaxed);
+            fileBytes_ += written;
+        }
+        used_ = 0;
+
+        int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        for (int64_t receivedNs : batchTimes_) {
+            loggedLatency_.record(nowNs > receivedNs ? nowNs - receivedNs : 0);
+        }
+        batchTimes_.clear();
+
+        // Size based rotation
+        if (config_.rotateBytes > 0 && fileBytes_ >= config_.rotateBytes) {
+            rotate();
+        }
+    }
+
+    // Start the next files. If that fails, stay on the current ones and try again after another rotateBytes or rotateSeconds.
+    void rotate() {
+        if (!openNewFile()) {
+            rotateFailures_.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "\033[1;31mLog rotation failed, writing to the current file\033[0m" << std::endl;
+            fileBytes_ = 0;
+            fileOpened_ = Clock::now();
+        }
+    }
+
+    /* Open the next csv and/or capture file (both share the client_data_log_<datetime> name)
+
+    Both new files are opened before the current ones are closed. If one of them can not be opened,
+    the logger stays on the current files (a csv file already created stays behind, empty).
+    */
+    bool openNewFile() {
+        std::string generated = generateNewFilename(config_.folder + "/" + config_.baseName);
+        std::string stem = generated.substr(0, generated.size() - 4);   // Without ".csv"
+        // Two rotations within one second would get the same name
+        if (generated == lastGenerated_) {
+            stem += "_" + std::to_string(files_.load());
+        }
+        lastGenerated_ = generated;
+
+        int fd = -1;
+        if (config_.csv) {
+            std::string filename = stem + (config_.compress ? ".csv" LZ_LOG_EXTENSION : ".csv");
+            fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                perror("Log file open failed");
+                return false;
+            }
+        }
+        if (config_.capture) {
+            int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            if (!capture_.open(stem + CAPTURE_EXTENSION, nowNs)) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return false;
+            }
+        }
+        if (config_.csv) {
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            fd_ = fd;
+        }
+        fileBytes_ = 0;
+        fileOpened_ = Clock::now();
+        files_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void closeFiles() {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        capture_.close();
+    }
+
+    LoggerConfig config_;
+    SpscQueue<LogRecord> queue_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+
+    // Logger thread only
+    std::vector<char> buffer_;          // Preallocated batch of csv text
+    size_t used_ = 0;
+    LzCompressor compressor_;
+    std::vector<uint8_t> compressed_;   // Block of the compressed batch (only with config_.compress)
+    int fd_ = -1;                       // csv file
+    CaptureWriter capture_;             // Binary capture file
+    size_t captureBatch_ = 0;           // Capture bytes appended since the last flush
+    std::vector<int64_t> batchTimes_;   // Receive times of the frames in the current batch
+    LatencyHistogram loggedLatency_;
+    std::string lastGenerated_;         // Name returned by generateNewFilename() for the current file
+    uint64_t fileBytes_ = 0;
+    Clock::time_point fileOpened_;
+
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> framesWritten_{0};
+    std::atomic<uint64_t> bytesWritten_{0};
+    std::atomic<uint64_t> csvBytes_{0};
+    std::atomic<uint64_t> csvStoredBytes_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> files_{0};
+    std::atomic<uint64_t> rotateFailures_{0};
+};
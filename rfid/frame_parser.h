@@ -0,0 +1,109 @@
+/**
+ * Binary RFID frame parser.
+ *
+ * Frame layout sent by the RFID reader:
+ *      | Head (0xBB) | Type | Len | Data (Len bytes) | CRC | 0x0D | 0x0A |
+ *      CRC = (Type + Len + Data[0] + ... + Data[Len - 1]) & 0xFF
+ *
+ * Examples captured from the reader (hex):
+ *      Connect:    bb 3a 03 02 00 00 3f 0d 0a
+ *      Heartbeat:  bb 40 02 00 01 43 0d 0a
+ *      Tag read:   bb 17 13 30 00 e2 00 00 1d 25 03 02 58 16 50 e7 a5 75 8d 20 1f 01 0f 0d 0a
+ *                  (the 12 byte EPC starts at Data + 2)
+ *
+ * parseFrame() works directly on the received unsigned char bytes and fills a FrameView: the head,
+ * type, len and crc bytes plus a ByteSpan pointing at the Data bytes inside the receive buffer. It
+ * never allocates. Hex text is only produced by formatHex() at the output sinks that need text
+ * (console and csv).
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define FRAME_HEAD 0xBB                 // Frame start flag
+#define FRAME_END1 0x0D                 // First trailer byte (\r)
+#define FRAME_END2 0x0A                 // Second trailer byte (\n)
+#define FRAME_HEADER_SIZE 3             // Head, Type, Len
+#define FRAME_OVERHEAD 6                // Head, Type, Len, CRC, END1, END2
+#define MAX_FRAME_SIZE (255 + FRAME_OVERHEAD)
+
+// RFID message types
+#define FRAME_TYPE_CONNECT 0x3a         // TCP connection with RFID reader successful
+#define FRAME_TYPE_TAG_READ 0x17        // Tag read, Data holds the EPC
+#define FRAME_TYPE_HEARTBEAT 0x40       // Heartbeat
+#define FRAME_TYPE_INVENTORY_END 0x18   // Inventory round finished
+#define FRAME_TYPE_ANTENNA_STATUS 0x41  // Antenna port connected or disconnected
+#define FRAME_TYPE_ERROR 0xff           // Reader error
+
+#define EPC_OFFSET 2                    // The EPC starts at Data + 2
+#define EPC_LEN 12                      // EPC is 12 bytes long
+
+// Non-owning view of a run of bytes
+struct ByteSpan {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    constexpr uint8_t operator[](size_t i) const { return data[i]; }
+    constexpr const uint8_t* begin() const { return data; }
+    constexpr const uint8_t* end() const { return data + size; }
+};
+
+// Fields of one frame. Only valid while the bytes it points at are.
+struct FrameView {
+    uint8_t head = 0;
+    uint8_t type = 0;
+    uint8_t len = 0;
+    ByteSpan data;      // Len bytes of Data
+    uint8_t crc = 0;
+};
+
+// Sum-and-mask checksum of a complete frame (Type, Len and Data bytes)
+inline uint8_t frameChecksum(const uint8_t* frame) {
+    unsigned int sum = 0;
+    unsigned int end = FRAME_HEADER_SIZE + frame[2];
+    for (unsigned int i = 1; i < end; i++) {
+        sum += frame[i];
+    }
+    return static_cast<uint8_t>(sum & 0xFF);
+}
+
+// Fill view from size bytes starting at a frame head. Returns false if the bytes are not a complete frame.
+inline bool parseFrame(const uint8_t* frame, size_t size, FrameView& view) {
+    if (size < FRAME_OVERHEAD || frame[0] != FRAME_HEAD || size != frame[2] + static_cast<size_t>(FRAME_OVERHEAD)) {
+        return false;
+    }
+    view.head = frame[0];
+    view.type = frame[1];
+    view.len = frame[2];
+    view.data.data = frame + FRAME_HEADER_SIZE;
+    view.data.size = view.len;
+    view.crc = frame[FRAME_HEADER_SIZE + view.len];
+    return true;
+}
+
+// The EPC of a tag read frame, or an empty span if Data is too short to hold one
+inline ByteSpan frameEpc(const FrameView& view) {
+    ByteSpan epc;
+    if (view.type == FRAME_TYPE_TAG_READ && view.data.size >= EPC_OFFSET + EPC_LEN) {
+        epc.data = view.data.data + EPC_OFFSET;
+        epc.size = EPC_LEN;
+    }
+    return epc;
+}
+
+/* Write bytes as two lower case hex characters each, followed by separator (if not 0)
+
+out must have room for 3 * size characters. Returns a pointer past the last character written.
+*/
+inline char* formatHex(char* out, const uint8_t* bytes, size_t size, char separator) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < size; i++) {
+        *out++ = digits[bytes[i] >> 4];
+        *out++ = digits[bytes[i] & 0x0F];
+        if (separator) {
+            *out++ = separator;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,243 @@
+/**
+ * Streaming reassembler for RFID reader frames.
+ *
+ * The frame layout is described in frame_parser.h.
+ *
+ * TCP is a byte stream, so one read() can hold several frames (coalesced) or only part of one
+ * (split). Every connection therefore owns a ByteRing that read() writes straight into, and a
+ * FrameReassembler that scans the received bytes for the 0xBB head, uses the Len byte to find the
+ * end of the frame and hands every complete frame in the buffer to a callback. Bytes that can not be
+ * the start of a frame are skipped until the next 0xBB (a resync). A frame with a bad checksum is
+ * reported to the callback as invalid and skipped up to and including its 0x0D 0x0A trailer.
+ *
+ * The checksums are not checked frame by frame: the frame boundaries of up to FRAME_BATCH_SIZE
+ * frames are found first, and the whole batch is then validated by one call of the SIMD checksum
+ * kernel (frame_checksum.h).
+ *
+ * ByteRing maps the same memory twice, back to back, so the readable bytes and the writable space
+ * are always one contiguous block even when they wrap around the end of the ring. Frames are handed
+ * to the callback as pointers into the ring, never copied. A read-only zero page after the second
+ * mapping lets the checksum kernels load a whole vector past the last frame in the ring.
+ *
+ * Additional documentation: https://man7.org/linux/man-pages/man2/memfd_create.2.html
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "frame_checksum.h"
+#include "frame_parser.h"
+
+#define RECEIVE_BUFFER_SIZE 65536       // Default size of the receive ring of every connection
+
+// Framing counters of one connection
+struct FrameStats {
+    uint64_t frames = 0;            // Complete frames with a valid checksum
+    uint64_t checksumErrors = 0;    // Complete frames whose checksum did not match
+    uint64_t resyncs = 0;           // Times the reassembler had to skip bytes to find the next 0xBB
+    uint64_t discardedBytes = 0;    // Bytes skipped while resyncing
+
+    void add(const FrameStats& other) {
+        frames += other.frames;
+        checksumErrors += other.checksumErrors;
+        resyncs += other.resyncs;
+        discardedBytes += other.discardedBytes;
+    }
+};
+
+// Byte ring buffer whose memory is mapped twice back to back (a "magic" ring buffer)
+class ByteRing {
+public:
+    ByteRing() = default;
+    ~ByteRing() { release(); }
+
+    ByteRing(const ByteRing&) = delete;
+    ByteRing& operator=(const ByteRing&) = delete;
+
+    /* Allocate the ring
+
+    memfd_create() creates an anonymous file of the ring's size. A 2 * capacity block of address
+    space is reserved with mmap() and the file is then mapped into both halves (MAP_FIXED), so the
+    byte at offset capacity + i is the same memory as the byte at offset i. One more page is reserved
+    after the two halves and made readable (anonymous zero page) for the CHECKSUM_READ_PADDING bytes
+    the checksum kernels may load past a frame. The capacity is rounded up to a multiple of the page
+    size. Returns false (and prints the reason) on failure.
+    */
+    bool init(size_t capacity) {
+        long pageSize = sysconf(_SC_PAGESIZE);
+        capacity = (capacity + pageSize - 1) / pageSize * pageSize;
+
+        int fd = memfd_create("rfid_ring", MFD_CLOEXEC);
+        if (fd < 0) {
+            perror("Ring memfd_create failed");
+            return false;
+        }
+        if (ftruncate(fd, capacity) < 0) {
+            perror("Ring ftruncate failed");
+            close(fd);
+            return false;
+        }
+
+        size_t mapped = 2 * capacity + pageSize;
+        void* base = mmap(nullptr, mapped, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            perror("Ring mmap failed");
+            close(fd);
+            return false;
+        }
+        uint8_t* bytes = static_cast<uint8_t*>(base);
+        if (mmap(bytes, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(bytes + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            perror("Ring mirror mmap failed");
+            munmap(base, mapped);
+            close(fd);
+            return false;
+        }
+        close(fd);  // The mappings keep the memory alive
+        if (mprotect(bytes + 2 * capacity, pageSize, PROT_READ) < 0) {
+            perror("Ring guard page mprotect failed");
+            munmap(base, mapped);
+            return false;
+        }
+
+        data_ = bytes;
+        capacity_ = capacity;
+        mapped_ = mapped;
+        head_ = tail_ = 0;
+        return true;
+    }
+
+    void release() {
+        if (data_) {
+            munmap(data_, mapped_);
+            data_ = nullptr;
+        }
+    }
+
+    // Contiguous block of received bytes that have not been consumed yet
+    const uint8_t* readPtr() const { return data_ + (head_ & (capacity_ - 1)); }
+    size_t readable() const { return tail_ - head_; }
+    void consume(size_t n) { head_ += n; }
+
+    // Contiguous free space that read() can write into
+    uint8_t* writePtr() { return data_ + (tail_ & (capacity_ - 1)); }
+    size_t writable() const { return capacity_ - readable(); }
+    void commit(size_t n) { tail_ += n; }
+
+    size_t capacity() const { return capacity_; }
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t capacity_ = 0;   // Power of two (see FrameReassembler::init)
+    size_t mapped_ = 0;     // Both halves and the guard page
+    uint64_t head_ = 0;     // Total bytes consumed
+    uint64_t tail_ = 0;     // Total bytes committed
+};
+
+/* Find up to maxFrames complete frames in the readable bytes at start
+
+Bytes that can not start a frame are skipped and counted as resyncs, exactly as if they were
+consumed one frame at a time. scanned is set to the number of bytes covered (frames and skipped
+bytes); a partial frame at the end is not covered. Used by FrameReassembler on its ring and by
+callers that parse frames straight out of their own buffer (rfid_native.cpp).
+*/
+inline size_t scanFrames(const uint8_t* start, size_t readable, FrameStats& stats, const uint8_t** frames,
+                         size_t maxFrames, size_t& scanned) {
+    size_t count = 0;
+    size_t offset = 0;
+    while (count < maxFrames && readable - offset >= FRAME_HEADER_SIZE) {
+        const uint8_t* frame = start + offset;
+        size_t available = readable - offset;
+
+        // Skip to the next frame head
+        if (frame[0] != FRAME_HEAD) {
+            const void* head = memchr(frame, FRAME_HEAD, available);
+            size_t skipped = head ? static_cast<const uint8_t*>(head) - frame : available;
+            offset += skipped;
+            stats.resyncs++;
+            stats.discardedBytes += skipped;
+            continue;
+        }
+
+        size_t size = frame[2] + FRAME_OVERHEAD;
+        if (available < size) {
+            break;  // Wait for the rest of the frame
+        }
+
+        // A head byte without the trailer at the position given by Len is not a frame start
+        if (frame[size - 2] != FRAME_END1 || frame[size - 1] != FRAME_END2) {
+            offset++;
+            stats.resyncs++;
+            stats.discardedBytes++;
+            continue;
+        }
+
+        frames[count++] = frame;
+        offset += size;
+    }
+    scanned = offset;
+    return count;
+}
+
+class FrameReassembler {
+public:
+    // Capacity is rounded up to a power of two so ring offsets can be masked instead of divided
+    bool init(size_t capacity = RECEIVE_BUFFER_SIZE) {
+        size_t size = 4096;
+        while (size < capacity || size < 2 * MAX_FRAME_SIZE) {
+            size <<= 1;
+        }
+        return ring_.init(size);
+    }
+
+    // Space for the next read(). Call commit() with the number of bytes received.
+    uint8_t* writePtr() { return ring_.writePtr(); }
+    size_t writable() const { return ring_.writable(); }
+    void commit(size_t n) { ring_.commit(n); }
+
+    /* Hand every complete frame in the ring to onFrame(const uint8_t* frame, size_t size, bool checksumOk)
+
+    The frame pointer is only valid during the callback. A partial frame at the end of the ring is
+    kept for the next call. Returns the number of complete frames found (valid or not).
+
+    Frames are handled in batches: scanBatch() finds the next FRAME_BATCH_SIZE frames without
+    consuming them, the checksum kernel validates all of them in one call, and then the callbacks run
+    in order and the ring is consumed up to the end of the batch.
+    */
+    template <typename OnFrame>
+    size_t drain(FrameStats& stats, OnFrame&& onFrame) {
+        const ChecksumKernel& kernel = checksumKernel();
+        const uint8_t* frames[FRAME_BATCH_SIZE];
+        bool ok[FRAME_BATCH_SIZE];
+        size_t found = 0;
+        while (true) {
+            size_t scanned = 0;
+            size_t count = scanBatch(stats, frames, scanned);
+            if (count > 0) {
+                size_t valid = kernel.validate(frames, count, ok);
+                stats.frames += valid;
+                stats.checksumErrors += count - valid;
+                for (size_t i = 0; i < count; i++) {
+                    onFrame(frames[i], frames[i][2] + static_cast<size_t>(FRAME_OVERHEAD), ok[i]);
+                }
+                found += count;
+            }
+            ring_.consume(scanned);
+            if (count < FRAME_BATCH_SIZE) {
+                return found;
+            }
+        }
+    }
+
+private:
+    // Find the next FRAME_BATCH_SIZE frames in the unconsumed bytes (see scanFrames())
+    size_t scanBatch(FrameStats& stats, const uint8_t** frames, size_t& scanned) {
+        return scanFrames(ring_.readPtr(), ring_.readable(), stats, frames, FRAME_BATCH_SIZE, scanned);
+    }
+
+    ByteRing ring_;
+};
@@ -0,0 +1,339 @@
+/**
+ * Block compression for the csv data logs.
+ *
+ * The csv log spells every frame byte as two hex characters and a comma, three times the size of
+ * the received stream. With compression on, the logger thread (frame_logger.h) compresses each
+ * batch of csv text before its write(). The receive path is unchanged, and the SD card gets about
+ * a quarter of the bytes of the plain csv (less than the raw frames) for tag-read traffic.
+ *
+ * A compressed log (client_data_log_<datetime>.csv.rlz) is a sequence of blocks, one per batch:
+ *
+ *      | LzBlockHeader | payload | LzBlockHeader | payload | ...
+ *
+ * Every block is decoded on its own: the compressor starts each block with an empty history, so a
+ * block only refers back into itself. The header carries the size of the text and captureChecksum()
+ * of the text, so a torn block at the end of a file (power loss) or a corrupted one is detected.
+ * A reader skips such a block, finds the next header by its magic and continues from there.
+ * RFID_Log_Cat.cpp prints the text of a compressed log.
+ *
+ * The payload is in the LZ4 block format. It is a series of sequences:
+ *
+ *      | token | literal length bytes | literals | offset (u16) | match length bytes |
+ *
+ * The high 4 bits of the token are the number of literals. The low 4 bits are the match length
+ * minus 4. A nibble of 15 is followed by length bytes that are added until one is below 255. The
+ * match copies length bytes from offset bytes back in the output. The last sequence has literals
+ * only. The compressor is the single-probe hash search of LZ4's fast mode: one 4096-entry table of
+ * positions, no match chains. It speeds up the search through data that does not compress. A
+ * block that would not get smaller is stored as it is (storedBytes == rawBytes).
+ *
+ * All integers are little-endian (the byte order of the Raspberry Pi and x86).
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "capture_file.h"
+
+#define LZ_BLOCK_MAGIC 0x315A4C52       // "RLZ1"
+#define LZ_LOG_EXTENSION ".rlz"         // Appended to the csv file name
+#define LZ_MAX_BLOCK_BYTES (64u << 20)  // Largest text of one block a reader accepts
+#define LZ_HASH_BITS 12                 // 4096 positions (16 KiB, stays in the L1 cache)
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5              // A block ends with at least this many literals
+#define LZ_MATCH_FIND_LIMIT 12          // No match starts in the last 12 bytes
+#define LZ_SKIP_SHIFT 6                 // Every 64 misses in a row the search step grows by one byte
+
+struct LzBlockHeader {
+    uint32_t magic;                 // LZ_BLOCK_MAGIC
+    uint32_t rawBytes;              // Size of the text
+    uint32_t storedBytes;           // Payload bytes following this header (== rawBytes: stored uncompressed)
+    uint32_t checksum;              // captureChecksum() of the text
+};
+
+static_assert(sizeof(LzBlockHeader) == 16, "lz block header layout");
+
+// Largest payload the compressor produces for size bytes of text
+inline size_t lzCompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+inline uint32_t lzRead32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t lzRead64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/* Compresses blocks of text
+
+Holds the hash table, so one compressor is kept per thread (the logger thread) and reused for every
+block.
+*/
+class LzCompressor {
+public:
+    LzCompressor() : table_(1u << LZ_HASH_BITS) {}
+
+    // Compress size bytes into out (room for lzCompressBound(size) bytes). Returns the compressed size.
+    size_t compress(const uint8_t* src, size_t size, uint8_t* out) {
+        std::fill(table_.begin(), table_.end(), 0);
+        uint8_t* op = out;
+        const uint8_t* anchor = src;    // First byte not yet written as literal or match
+        const uint8_t* end = src + size;
+
+        if (size > LZ_MATCH_FIND_LIMIT) {
+            const uint8_t* matchLimit = end - LZ_LAST_LITERALS;
+            const uint8_t* searchLimit = end - LZ_MATCH_FIND_LIMIT;
+            const uint8_t* p = src + 1;
+            table_[hash(lzRead32(src))] = 0;
+            uint32_t misses = 0;
+            while (p < searchLimit) {
+                uint32_t h = hash(lzRead32(p));
+                const uint8_t* candidate = src + table_[h];
+                table_[h] = static_cast<uint32_t>(p - src);
+                if (candidate >= p || p - candidate > LZ_MAX_OFFSET || lzRead32(candidate) != lzRead32(p)) {
+                    p += 1 + (misses++ >> LZ_SKIP_SHIFT);
+                    continue;
+                }
+                misses = 0;
+
+                // Extend the match backwards into the pending literals, then forwards
+                while (p > anchor && candidate > src && p[-1] == candidate[-1]) {
+                    p--;
+                    candidate--;
+                }
+                const uint8_t* matchEnd = p + LZ_MIN_MATCH;
+                const uint8_t* from = candidate + LZ_MIN_MATCH;
+                while (matchEnd + 8 <= matchLimit) {
+                    uint64_t diff = lzRead64(matchEnd) ^ lzRead64(from);
+                    if (diff) {
+                        matchEnd += __builtin_ctzll(diff) >> 3;
+                        goto matched;
+                    }
+                    matchEnd += 8;
+                    from += 8;
+                }
+                while (matchEnd < matchLimit && *matchEnd == *from) {
+                    matchEnd++;
+                    from++;
+                }
+            matched:
+                op = writeSequence(op, anchor, p - anchor, p - candidate, matchEnd - p);
+                // The position two bytes back lets the next repeat start right after this match
+                table_[hash(lzRead32(matchEnd - 2))] = static_cast<uint32_t>(matchEnd - 2 - src);
+                p = anchor = matchEnd;
+            }
+        }
+
+        // The last sequence: the remaining literals
+        size_t literals = end - anchor;
+        *op++ = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+        if (literals >= 15) {
+            op = writeLength(op, literals - 15);
+        }
+        memcpy(op, anchor, literals);
+        return op + literals - out;
+    }
+
+    /* Build a complete block (header and payload) of size bytes of text into out
+
+    out needs room for sizeof(LzBlockHeader) + lzCompressBound(size) bytes. Returns the block size.
+    */
+    size_t encodeBlock(const uint8_t* text, size_t size, uint8_t* out) {
+        LzBlockHeader header;
+        header.magic = LZ_BLOCK_MAGIC;
+        header.rawBytes = static_cast<uint32_t>(size);
+        header.checksum = captureChecksum(text, size);
+        uint8_t* payload = out + sizeof(header);
+        size_t compressed = compress(text, size, payload);
+        if (compressed >= size) {
+            memcpy(payload, text, size);
+            compressed = size;
+        }
+        header.storedBytes = static_cast<uint32_t>(compressed);
+        memcpy(out, &header, sizeof(header));
+        return sizeof(header) + compressed;
+    }
+
+private:
+    static uint32_t hash(uint32_t value) {
+        return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+    static uint8_t* writeLength(uint8_t* op, size_t length) {
+        while (length >= 255) {
+            *op++ = 255;
+            length -= 255;
+        }
+        *op++ = static_cast<uint8_t>(length);
+        return op;
+    }
+
+    static uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength) {
+        size_t matchCode = matchLength - LZ_MIN_MATCH;
+        *op++ = static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15));
+        if (literalCount >= 15) {
+            op = writeLength(op, literalCount - 15);
+        }
+        memcpy(op, literals, literalCount);
+        op += literalCount;
+        *op++ = static_cast<uint8_t>(offset);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+        if (matchCode >= 15) {
+            op = writeLength(op, matchCode - 15);
+        }
+        return op;
+    }
+
+    std::vector<uint32_t> table_;   // Hash of 4 bytes -> their last position in the block
+};
+
+/* Decompress a payload of size bytes into out, which must decode to exactly rawSize bytes
+
+Every length and offset is checked against the input and the output, so a corrupted payload returns
+false instead of reading or writing outside the buffers.
+*/
+inline bool lzDecompress(const uint8_t* src, size_t size, uint8_t* out, size_t rawSize) {
+    const uint8_t* ip = src;
+    const uint8_t* inEnd = src + size;
+    uint8_t* op = out;
+    uint8_t* outEnd = out + rawSize;
+    auto readLength = [&ip, inEnd](size_t& length) {
+        uint8_t byte;
+        do {
+            if (ip == inEnd) {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < inEnd) {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(inEnd - ip) || literals > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == inEnd) {
+            break;      // The last sequence has no match
+        }
+
+        if (inEnd - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t length = token & 0x0F;
+        if (length == 15 && !readLength(length)) {
+            return false;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - out) || length > static_cast<size_t>(outEnd - op)) {
+            return false;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= 8) {
+            // Chunks of 8 never overlap their own source
+            for (; length >= 8; length -= 8, op += 8, match += 8) {
+                memcpy(op, match, 8);
+            }
+        }
+        while (length-- > 0) {
+            *op++ = *match++;
+        }
+    }
+    return op == outEnd;
+}
+
+// What readLzBlocks() found in a compressed log
+struct LzReadStats {
+    uint64_t blocks = 0;            // Blocks decoded and verified
+    uint64_t rawBytes = 0;          // Text of those blocks
+    uint64_t storedBytes = 0;       // Their size in the file (headers included)
+    uint64_t badBlocks = 0;         // Blocks skipped: torn, checksum mismatch or undecodable
+    uint64_t skippedBytes = 0;      // Bytes skipped to find the next block
+};
+
+/* Hand the text of every block of a compressed log to onBlock(const uint8_t* text, size_t size)
+
+text is only valid during the call (it points into scratch). After a bad block the reader searches
+for the next block magic, so one damaged block costs only its own text. Returns false if any
+block of data was bad.
+*/
+template <typename OnBlock>
+bool readLzBlocks(const uint8_t* data, size_t size, std::vector<uint8_t>& scratch, LzReadStats& stats, OnBlock&& onBlock) {
+    uint64_t badBefore = stats.badBlocks;
+    size_t offset = 0;
+    size_t skipFrom = SIZE_MAX;     // Start of the bytes being skipped after a bad block
+    while (offset + sizeof(LzBlockHeader) <= size) {
+        LzBlockHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if (header.magic != LZ_BLOCK_MAGIC) {
+            if (skipFrom == SIZE_MAX) {
+                skipFrom = offset;
+                stats.badBlocks++;
+            }
+            offset++;
+            continue;
+        }
+        const uint8_t* payload = data + offset + sizeof(header);
+        size_t available = size - offset - sizeof(header);
+        bool ok = header.rawBytes <= LZ_MAX_BLOCK_BYTES && header.storedBytes <= available &&
+                  header.storedBytes <= lzCompressBound(header.rawBytes);
+        const uint8_t* text = payload;
+        if (ok && header.storedBytes != header.rawBytes) {
+            if (scratch.size() < header.rawBytes) {
+                scratch.resize(header.rawBytes);
+            }
+            ok = lzDecompress(payload, header.storedBytes, scratch.data(), header.rawBytes);
+            text = scratch.data();
+        }
+        ok = ok && captureChecksum(text, header.rawBytes) == header.checksum;
+        if (!ok) {
+            if (skipFrom == SIZE_MAX) {
+                skipFrom = offset;
+                stats.badBlocks++;
+            }
+            offset++;
+            continue;
+        }
+        if (skipFrom != SIZE_MAX) {
+            stats.skippedBytes += offset - skipFrom;
+            skipFrom = SIZE_MAX;
+        }
+        onBlock(text, header.rawBytes);
+        stats.blocks++;
+        stats.rawBytes += header.rawBytes;
+        stats.storedBytes += sizeof(header) + header.storedBytes;
+        offset += sizeof(header) + header.storedBytes;
+    }
+    if (offset < size) {
+        // A header cut off at the end of the file
+        if (skipFrom == SIZE_MAX) {
+            skipFrom = offset;
+            stats.badBlocks++;
+        }
+    }
+    if (skipFrom != SIZE_MAX) {
+        stats.skippedBytes += size - skipFrom;
+    }
+    return stats.badBlocks == badBefore;
+}
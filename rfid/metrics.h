@@ -0,0 +1,278 @@
+/**
+ * Metrics primitives: latency histograms, Prometheus text output and a loopback HTTP endpoint.
+ *
+ * LatencyHistogram is an HDR-style log-linear histogram. Every power of two range of values is split
+ * into 16 equal buckets, so any recorded value is known to within 1/16 (6.25%) from 1 ns up to
+ * minutes, in a fixed array of counters. record() is a count-leading-zeros, a shift and one counter
+ * increment: no allocation, no lock, no search.
+ *
+ * A histogram (like the counters in ServerMetrics) has exactly one writer thread. The counters are
+ * std::atomic so the metrics thread can read them while they are written, but the writer only does
+ * a relaxed load and store (no locked read-modify-write instruction), which costs the same as a
+ * plain increment.
+ *
+ * MetricsHttpServer runs one thread with a blocking HTTP server on 127.0.0.1:<port> (never on the
+ * network interfaces). Every GET is answered with the text returned by the render callback, in the
+ * Prometheus text exposition format:
+ *
+ *      curl http://127.0.0.1:9464/metrics
+ *
+ * Additional documentation: https://prometheus.io/docs/instrumenting/exposition_formats/
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <functional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#define HISTOGRAM_SUB_BUCKETS 16        // Buckets per power of two (relative error 1/16)
+#define HISTOGRAM_BUCKETS (61 * HISTOGRAM_SUB_BUCKETS)
+
+class LatencyHistogram {
+public:
+    // Writer thread only
+    void record(uint64_t value) {
+        size_t index = bucketIndex(value);
+        increment(counts_[index], 1);
+        increment(count_, 1);
+        increment(sum_, value);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    // Recorded values below limit (exact when limit is a power of two)
+    uint64_t countBelow(uint64_t limit) const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS && bucketLow(i) < limit; i++) {
+            total += counts_[i].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Lower bound of the bucket holding the p-th percentile (p in [0, 100])
+    uint64_t percentile(double p) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * (total - 1));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                return bucketLow(i);
+            }
+        }
+        return bucketLow(HISTOGRAM_BUCKETS - 1);
+    }
+
+    /* Bucket of a value
+
+    Values below 16 have a bucket each. Above that, a value whose highest set bit is b falls in one of
+    the 16 buckets of [2^b, 2^(b+1)), picked by the 4 bits below the highest bit.
+    */
+    static size_t bucketIndex(uint64_t value) {
+        if (value < HISTOGRAM_SUB_BUCKETS) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        return static_cast<size_t>((msb - 3) * HISTOGRAM_SUB_BUCKETS + (value >> (msb - 4)) - HISTOGRAM_SUB_BUCKETS);
+    }
+
+    static uint64_t bucketLow(size_t index) {
+        if (index < HISTOGRAM_SUB_BUCKETS) {
+            return index;
+        }
+        size_t group = index / HISTOGRAM_SUB_BUCKETS;
+        uint64_t sub = index % HISTOGRAM_SUB_BUCKETS;
+        return (HISTOGRAM_SUB_BUCKETS + sub) << (group - 1);
+    }
+
+private:
+    static void increment(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts_[HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+/* Prometheus text format helpers
+
+writeMetricHeader() prints the # HELP and # TYPE lines of a metric family, which must come once
+before all samples of the family. Labels are passed preformatted: "reader=\"10.0.0.5:4001\"".
+*/
+inline void writeMetricHeader(std::ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+}
+
+inline void writeSample(std::ostream& out, const char* name, const std::string& labels, uint64_t value) {
+    out << name;
+    if (!labels.empty()) {
+        out << '{' << labels << '}';
+    }
+    out << ' ' << value << '\n';
+}
+
+// Histogram of ns values as seconds, with one bucket per power of two from 256 ns to 8.6 s
+inline void writeHistogram(std::ostream& out, const char* name, const std::string& labels,
+                           const LatencyHistogram& histogram) {
+    std::string prefix = labels.empty() ? "" : labels + ",";
+    char le[32];
+    for (int power = 8; power <= 33; power++) {
+        snprintf(le, sizeof(le), "%.12g", static_cast<double>(1ULL << power) / 1e9);
+        out << name << "_bucket{" << prefix << "le=\"" << le << "\"} " << histogram.countBelow(1ULL << power) << '\n';
+    }
+    out << name << "_bucket{" << prefix << "le=\"+Inf\"} " << histogram.count() << '\n';
+    out << name << "_sum";
+    if (!labels.empty()) {
+        out << '{' << labels << '}';
+    }
+    out << ' ' << histogram.sum() / 1e9 << '\n';
+    writeSample(out, (std::string(name) + "_count").c_str(), labels, histogram.count());
+}
+
+class MetricsHttpServer {
+public:
+    using Render = std::function<void(std::ostream&)>;
+
+    explicit MetricsHttpServer(Render render) : render_(std::move(render)) {}
+    ~MetricsHttpServer() { stop(); }
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    // Listen on 127.0.0.1:port (0 = any free port) and start the thread
+    bool start(int port) {
+        if ((listenFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+            perror("Metrics socket creation failed");
+            return false;
+        }
+        int opt = 1;
+        setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (bind(listenFd_, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            perror("Metrics binding failed");
+            return false;
+        }
+        socklen_t addressLength = sizeof(address);
+        getsockname(listenFd_, (struct sockaddr *)&address, &addressLength);
+        port_ = ntohs(address.sin_port);
+        if (listen(listenFd_, 16) < 0) {
+            perror("Metrics listen failed");
+            return false;
+        }
+        if ((wakeFd_ = eventfd(0, EFD_CLOEXEC)) < 0) {
+            perror("Eventfd creation failed");
+            return false;
+        }
+        thread_ = std::thread(&MetricsHttpServer::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (thread_.joinable()) {
+            uint64_t one = 1;
+            ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+            (void)ignored;
+            thread_.join();
+        }
+        if (listenFd_ >= 0) {
+            close(listenFd_);
+            listenFd_ = -1;
+        }
+        if (wakeFd_ >= 0) {
+            close(wakeFd_);
+            wakeFd_ = -1;
+        }
+    }
+
+    int port() const { return port_; }
+
+private:
+    void run() {
+        struct pollfd fds[2] = {{listenFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Metrics poll failed");
+                return;
+            }
+            if (fds[1].revents & POLLIN) {
+                return;
+            }
+            int client = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client >= 0) {
+                serve(client);
+                close(client);
+            }
+        }
+    }
+
+    // Read the request head (1 s timeout) and answer GET /metrics (or GET /) with the rendered text
+    void serve(int client) {
+        struct timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char request[2048];
+        size_t used = 0;
+        while (used < sizeof(request) - 1) {
+            ssize_t n = read(client, request + used, sizeof(request) - 1 - used);
+            if (n <= 0) {
+                return;
+            }
+            used += n;
+            request[used] = '\0';
+            if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+                break;
+            }
+        }
+
+        std::string status = "200 OK", body;
+        if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+            std::ostringstream text;
+            render_(text);
+            body = text.str();
+        } else {
+            status = "404 Not Found";
+            body = "Only GET /metrics is served\n";
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        size_t written = 0;
+        while (written < response.size()) {
+            ssize_t n = write(client, response.data() + written, response.size() - written);
+            if (n <= 0) {
+                return;
+            }
+            written += n;
+        }
+    }
+
+    Render render_;
+    std::thread thread_;
+    int listenFd_ = -1;
+    int wakeFd_ = -1;
+    int port_ = 0;
+};
@@ -0,0 +1,1635 @@
+/**
+ * Event-driven RFID reader server.
+ *
+ * ReaderServer owns the listening socket on port 6000 and a non-blocking epoll event loop. Every
+ * RFID reader that connects gets its own ReaderConnection holding its parser state and counters, so
+ * any number of readers can stream into one collector at the same time. When a reader drops only
+ * its connection is torn down and the server keeps accepting new readers.
+ *
+ * Usage:
+ *      ServerConfig config;
+ *      config.backlog = 64;
+ *      ReaderServer server(config);
+ *      if (!server.start()) return -1;
+ *      server.run();           // Returns after stop() is called (safe to call from a signal handler)
+ *
+ * Commands to the readers (command_channel.h) are queued from one other thread with submitCommand()
+ * and their results come back on the event loop thread through setCommandHandler().
+ *
+ * Additional documentation: https://man7.org/linux/man-pages/man7/epoll.7.html
+*/
+#pragma once
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+
+#include "command_channel.h"
+#include "frame_dispatch.h"
+#include "frame_logger.h"
+#include "frame_parser.h"
+#include "frame_reassembler.h"
+#include "metrics.h"
+#include "spsc_queue.h"
+#include "tag_presence.h"
+#include "tag_query.h"
+#include "tag_report.h"
+#include "tag_table.h"
+#include "uring_receiver.h"
+
+#define PORT 6000               // Port that the RFID reader sends data through
+#define LISTEN_BACKLOG 3        // Default number of pending connections queued by listen()
+#define MAX_EPOLL_EVENTS 64     // Maximum number of ready file descriptors handled per epoll_wait()
+#define LATENCY_SAMPLE_READS 16 // One read in this many is timed for the recv-to-parsed histogram
+#define URING_EPOLL_DATA (UINT64_MAX - 1)   // user_data of the io_uring poll of the epoll instance
+
+// Runtime configuration of the server (filled in from the command line in main())
+struct ServerConfig {
+    int port = PORT;                                // Port the readers connect to
+    int backlog = LISTEN_BACKLOG;                   // Pending connection queue length passed to listen()
+    bool quiet = false;                             // Suppress the per-frame console output
+    size_t receiveBufferSize = RECEIVE_BUFFER_SIZE; // Receive ring size of every connection
+    int reportIntervalMs = 1000;                    // Print the tag report this often (0 = never)
+    size_t topTags = 10;                            // Tags listed in the top of the tag report
+    int shards = 1;                                 // Event loop threads sharing the port (0 = one per core)
+    int mergeIntervalMs = 100;                      // Shards send their tag counts to the merge step this often
+    int metricsPort = -1;                           // Prometheus metrics on 127.0.0.1:<port> (-1 = off, 0 = any)
+    int metricsIntervalMs = 100;                    // Event loops publish their counters this often
+    LoggerConfig logger;                            // Outputs, batching and rotation of the data logs
+    PresenceConfig presence;                        // Enter/leave events (leaveTimeoutMs = 0: off)
+    std::string tagFile;                            // Keep EPC_Tag_Counts in this memory-mapped file (empty = in memory)
+    int checkpointIntervalMs = 1000;                // Checkpoint the tag file this often
+    std::string querySocket;                        // Answer tag queries on this Unix-domain socket (empty = off)
+    int queryIntervalMs = 100;                      // Hand the new reads to the query thread this often
+    bool ioUring = false;                           // Receive with io_uring multishot recv (epoll and read() if unavailable)
+    size_t commandWindow = COMMAND_WINDOW;          // Commands in flight per reader
+    int commandTimeoutMs = COMMAND_TIMEOUT_MS;      // Time a reader has to answer a command
+    std::vector<ReaderCommand> connectCommands;     // Sent to every reader as soon as it connects
+};
+
+// Counters kept for every reader connection (and summed over all connections by the server)
+struct ConnectionCounters : FrameStats {
+    uint64_t bytes = 0;             // Bytes received
+    uint64_t reads = 0;             // Successful read() calls (receive completions with io_uring)
+    uint64_t unknownTypes = 0;      // Frames with an unrecognized TYPE
+    uint64_t connects = 0;          // 0x3a frames
+    uint64_t tagReads = 0;          // 0x17 frames
+    uint64_t heartbeats = 0;        // 0x40 frames
+    uint64_t inventoryEnds = 0;     // 0x18 frames
+    uint64_t antennaStatus = 0;     // 0x41 frames
+    uint64_t readerErrors = 0;      // 0xff frames
+    uint64_t malformed = 0;         // Frames of a known TYPE with a Len out of its range
+    uint64_t commandsSent = 0;      // Command frames written to the reader
+    uint64_t commandsAnswered = 0;  // Commands the reader answered
+    uint64_t commandTimeouts = 0;   // Commands the reader did not answer in time
+    uint64_t commandWrites = 0;     // sendmsg() calls that wrote command frames
+
+    void add(const ConnectionCounters& other) {
+        FrameStats::add(other);
+        bytes += other.bytes;
+        reads += other.reads;
+        unknownTypes += other.unknownTypes;
+        connects += other.connects;
+        tagReads += other.tagReads;
+        heartbeats += other.heartbeats;
+        inventoryEnds += other.inventoryEnds;
+        antennaStatus += other.antennaStatus;
+        readerErrors += other.readerErrors;
+        malformed += other.malformed;
+        commandsSent += other.commandsSent;
+        commandsAnswered += other.commandsAnswered;
+        commandTimeouts += other.commandTimeouts;
+        commandWrites += other.commandWrites;
+    }
+};
+
+// Counters of one connection as published for the metrics thread
+struct ConnectionSnapshot {
+    uint32_t id;
+    std::string address;
+    ConnectionCounters counters;
+};
+
+/* Metrics of one event loop (one per shard), on their own cache lines
+
+The event loop is the only writer. It copies its counters in here every metricsIntervalMs (so the
+frame handling path does not touch them at all) and records the recv-to-parsed latency of one in
+LATENCY_SAMPLE_READS reads (timing every read would add two clock reads to each one).
+The metrics thread reads the atomics at any time and the connection list under its mutex, which
+the event loop only takes for the copy every metricsIntervalMs.
+*/
+struct alignas(CACHE_LINE_SIZE) ServerMetrics {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<uint64_t> connects{0};
+    std::atomic<uint64_t> tagReads{0};
+    std::atomic<uint64_t> heartbeats{0};
+    std::atomic<uint64_t> unknownTypes{0};
+    std::atomic<uint64_t> inventoryEnds{0};
+    std::atomic<uint64_t> antennaStatus{0};
+    std::atomic<uint64_t> readerErrors{0};
+    std::atomic<uint64_t> malformed{0};
+    std::atomic<uint64_t> commandsSent{0};
+    std::atomic<uint64_t> commandsAnswered{0};
+    std::atomic<uint64_t> commandTimeouts{0};
+    std::atomic<uint64_t> commandWrites{0};
+    std::atomic<uint64_t> checksumErrors{0};
+    std::atomic<uint64_t> resyncs{0};
+    std::atomic<uint64_t> discardedBytes{0};
+    std::atomic<uint64_t> connectionsAccepted{0};
+    std::atomic<uint64_t> connectionsOpen{0};
+    std::atomic<uint64_t> distinctTags{0};
+    std::atomic<uint64_t> tagsPerSecond{0};
+    LatencyHistogram recvToParsed;          // ns from read() returning to its frames being handled (sampled reads)
+
+    std::mutex connectionsMutex;
+    std::vector<ConnectionSnapshot> connections;
+};
+
+// State of one connected RFID reader
+struct ReaderConnection {
+    int fd = -1;                            // Client socket
+    uint32_t id = 0;                        // Connection id (increasing, never reused)
+    std::string address;                    // "ip:port" of the reader
+    ConnectionCounters counters;            // Per-connection counters
+    FrameReassembler reassembler;           // Receive ring and frame boundary scanner
+    CommandChannel commands;                // Commands to the reader, queued and in flight
+    bool flushQueued = false;               // In flushQueue_ of the server
+    bool waitingWritable = false;           // Registered for EPOLLOUT because the socket was full
+    size_t configuring = 0;                 // connectCommands not finished yet
+    size_t configureFailures = 0;           // connectCommands not answered
+    int64_t configureStartNs = 0;
+};
+
+class ReaderServer;
+
+// What the frame handlers of ReaderServer get with every decoded frame
+struct FrameContext {
+    ReaderServer& server;
+    ReaderConnection& connection;
+    std::ostream& out;              // Console (discards everything in quiet mode)
+    int64_t receivedNs;             // Receive time stamp of the frame
+};
+
+// A command in flight and the time it has to be answered by
+struct CommandDeadline {
+    int64_t deadlineNs;             // CLOCK_MONOTONIC
+    int fd;
+    uint32_t connectionId;
+    uint64_t sequence;
+    bool abandoned;                 // The command timed out, this is the end of its wait for a late answer
+};
+
+// Current time in ns since the epoch (the time stamp stored with tag reads)
+inline int64_t wallClockNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// CLOCK_MONOTONIC in ns (command deadlines, armed on a timerfd of the same clock)
+inline int64_t monotonicNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// A timerfd that becomes readable every intervalMs (at least 1 ms). Returns -1 if it can not be created.
+inline int createIntervalTimer(int64_t intervalMs) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Timerfd creation failed");
+        return -1;
+    }
+    intervalMs = std::max<int64_t>(1, intervalMs);
+    struct itimerspec interval;
+    memset(&interval, 0, sizeof(interval));
+    interval.it_interval.tv_sec = intervalMs / 1000;
+    interval.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+    interval.it_value = interval.it_interval;
+    timerfd_settime(fd, 0, &interval, nullptr);
+    return fd;
+}
+
+class ReaderServer {
+public:
+    explicit ReaderServer(const ServerConfig& config) : config_(config) {}
+    ~ReaderServer() { shutdown(); }
+
+    ReaderServer(const ReaderServer&) = delete;
+    ReaderServer& operator=(const ReaderServer&) = delete;
+
+    // Create, bind and listen on the server socket and set up the epoll instance
+    bool start();
+
+    // Run the event loop until stop() is called
+    void run();
+
+    // Ask the event loop to return. Only write()s to an eventfd, so it is async-signal-safe.
+    void stop() {
+        stopRequested_.store(true);
+        wake();
+    }
+
+    // Ask the event loop to print the full EPC_Tag_Counts table. Async-signal-safe like stop().
+    void requestTagDump() {
+        dumpRequested_.store(true);
+        wake();
+    }
+
+    // Close every connection, the server socket and the epoll instance and stop the logger
+    void shutdown();
+
+    // Port actually bound (useful when config.port is 0 and the kernel picks one)
+    int boundPort() const { return boundPort_; }
+
+    // Counters summed over every connection the server has seen
+    ConnectionCounters totals() const {
+        ConnectionCounters sum = closedTotals_;
+        for (const auto& entry : connections_) {
+            sum.add(entry.second->counters);
+        }
+        return sum;
+    }
+
+    size_t connectionCount() const { return connections_.size(); }
+
+    // True when the connections are received with io_uring (config.ioUring and the kernel supports it)
+    bool usesIoUring() const { return uring_ != nullptr; }
+
+    // epoll_wait(), read() and io_uring_enter() calls of the event loop so far
+    uint64_t receiveSyscalls() const { return receiveSyscalls_ + (uring_ ? uring_->enters() : 0); }
+
+    // Tag counts (empty after shutdown() when they were kept in a tag file)
+    const TagTable& tagCounts() const { return EPC_Tag_Counts; }
+    const TopTags& topTags() const { return tagReporter_.top(); }
+
+    // Tags present now and their windowed reads (nullptr when presence tracking is off or in a shard)
+    const TagPresence* presence() const { return presence_.get(); }
+
+    // Queue depth, dropped frames etc. of the logger (all zero when logging is off)
+    LoggerStats loggerStats() const { return logger_ ? logger_->stats() : LoggerStats(); }
+
+    // Counters published for the metrics endpoint (readable from any thread)
+    const ServerMetrics& metrics() const { return metrics_; }
+    const FrameLogger* logger() const { return logger_.get(); }
+    int metricsPort() const { return metricsServer_ ? metricsServer_->port() : -1; }
+
+    // Write the metrics of the servers (the shards of one sharded server) in the Prometheus text format
+    static void writeMetrics(std::ostream& out, const std::vector<const ReaderServer*>& servers);
+
+    /* Queue a command for a reader (command.connectionId) or for every connected reader (connectionId 0)
+
+    Never blocks: the command goes through a queue to the event loop, which writes it with the other
+    commands of its pass. Returns false if COMMAND_QUEUE_SIZE commands are already waiting. Only one
+    thread may submit commands (the event loop itself, e.g. from the command handler, or one other).
+    */
+    bool submitCommand(const ReaderCommand& command) {
+        if (!commandQueue_.tryPush(command)) {
+            return false;
+        }
+        if (!commandWakePending_.exchange(true)) {
+            wake();
+        }
+        return true;
+    }
+
+    // Called on the event loop thread with the result of every submitted command. Set before run().
+    void setCommandHandler(std::function<void(const CommandResult&)> handler) { commandHandler_ = std::move(handler); }
+
+    // Optional sink for the time (ns) spent handling each read() worth of frames (used by the benchmarks)
+    void setLatencySink(std::vector<uint64_t>* sink) { latencySink_ = sink; }
+
+    /* Run as one shard of a ShardedReaderServer (call before start())
+
+    Connection ids start at shard << 24 so they stay unique over the shards. Instead of printing the
+    tag report, the report timer (set to mergeIntervalMs by the sharded server) sends the reads since
+    the last tick to the merge step through deltas.
+    */
+    void setShard(uint32_t shard, SpscQueue<TagDelta>* deltas) {
+        shard_ = static_cast<int>(shard);
+        nextConnectionId_ = (shard << 24) + 1;
+        deltas_ = deltas;
+    }
+
+    // Queue the tag reads since the last call for the merge step. Returns false if the queue filled up first.
+    bool publishTagDeltas() {
+        return tagReporter_.drainChanges([this](const TagDelta& delta) {
+            TagDelta* slot = deltas_->tryReserve();
+            if (!slot) {
+                return false;
+            }
+            *slot = delta;
+            deltas_->publish();
+            return true;
+        });
+    }
+
+private:
+    void wake() {
+        uint64_t one = 1;
+        if (wakeFd_ >= 0) {
+            ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    bool handleWake();
+    void publishMetrics();
+    void acceptConnections();
+    void readConnection(ReaderConnection& connection);
+    bool receiveCompletions();
+    void handleReceived(ReaderConnection& connection, size_t bytes);
+    void closeConnection(int fd, const char* reason);
+    void takeSubmittedCommands();
+    void queueCommand(ReaderConnection& connection, const ReaderCommand& command, bool onConnect);
+    void scheduleFlush(ReaderConnection& connection);
+    void flushCommands();
+    bool answerCommand(ReaderConnection& connection, const FrameView& view);
+    void expireCommands();
+    void armCommandTimer();
+    int startIntervalTimer(int64_t intervalMs);
+    void finishCommand(ReaderConnection& connection, const PendingCommand& command, CommandStatus status,
+                       ByteSpan response);
+    void handleFrame(ReaderConnection& connection, const uint8_t* frame, size_t size, bool checksumOk,
+                     int64_t receivedNs);
+    void printFrame(std::ostream& out, const ReaderConnection& connection, const FrameView& view,
+                    const uint8_t* frame, size_t size, bool checksumOk);
+
+    static void onConnect(FrameContext& context, const ConnectFrame& frame);
+    static void onTagRead(FrameContext& context, const TagReadFrame& frame);
+    static void onHeartbeat(FrameContext& context, const HeartbeatFrame& frame);
+    static void onInventoryEnd(FrameContext& context, const InventoryEndFrame& frame);
+    static void onAntennaStatus(FrameContext& context, const AntennaStatusFrame& frame);
+    static void onReaderError(FrameContext& context, const ReaderErrorFrame& frame);
+    static void onUnknownFrame(FrameContext& context, const FrameView& view);
+    static void onMalformedFrame(FrameContext& context, const FrameView& view);
+
+    // Frame types the server handles. The 256-entry dispatch table is built from this list at compile time.
+    using FrameTypes = FrameDispatcher<FrameContext, onUnknownFrame, onMalformedFrame,
+                                       FrameHandler<ConnectFrame, onConnect>,
+                                       FrameHandler<TagReadFrame, onTagRead>,
+                                       FrameHandler<HeartbeatFrame, onHeartbeat>,
+                                       FrameHandler<InventoryEndFrame, onInventoryEnd>,
+                                       FrameHandler<AntennaStatusFrame, onAntennaStatus>,
+                                       FrameHandler<ReaderErrorFrame, onReaderError>>;
+
+    // user_data of the io_uring receives of a connection: its id and its socket
+    static uint64_t ringUserData(const ReaderConnection& connection) {
+        return (static_cast<uint64_t>(connection.id) << 32) | static_cast<uint32_t>(connection.fd);
+    }
+
+    // Console output is sent to a stream without a buffer in quiet mode, which makes every << a no-op
+    std::ostream& console() { return config_.quiet ? nullStream_ : std::cout; }
+
+    ServerConfig config_;
+    int serverSocket_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    int reportTimerFd_ = -1;
+    int metricsTimerFd_ = -1;
+    int presenceTimerFd_ = -1;
+    int checkpointTimerFd_ = -1;
+    int queryTimerFd_ = -1;
+    int commandTimerFd_ = -1;
+    int boundPort_ = 0;
+    std::atomic<bool> stopRequested_{false};
+    std::atomic<bool> dumpRequested_{false};
+    std::unordered_map<int, std::unique_ptr<ReaderConnection>> connections_;
+    std::unordered_map<uint32_t, int> connectionFds_;       // Socket of every connection id
+    ConnectionCounters closedTotals_;                       // Counters of the connections that were closed
+    std::unique_ptr<FrameLogger> logger_;                   // Writes the client data to csv files
+    uint32_t nextConnectionId_ = 1;
+    TagTable EPC_Tag_Counts;                                // Count of specific EPC tag
+    TagReporter tagReporter_{EPC_Tag_Counts, config_.topTags}; // Changes since the last tag report and the top tags
+    std::unique_ptr<TagPresence> presence_;                 // Tags read within the leave timeout
+    std::unique_ptr<TagQueryServer> query_;                 // Tag queries on a Unix-domain socket
+    std::unique_ptr<UringReceiver> uring_;                  // io_uring receive backend (nullptr: epoll and read())
+    uint64_t receiveSyscalls_ = 0;                          // epoll_wait() and read() calls
+    SpscQueue<ReaderCommand> commandQueue_{COMMAND_QUEUE_SIZE}; // submitCommand() to the event loop
+    std::atomic<bool> commandWakePending_{false};           // A wake() for the queued commands is on its way
+    std::function<void(const CommandResult&)> commandHandler_;
+    std::deque<CommandDeadline> commandDeadlines_;          // Commands in flight, oldest first (one timeout for all)
+    bool commandTimerArmed_ = false;
+    std::vector<int> flushQueue_;                           // Connections with commands to write in this pass
+    uint64_t nextCommandSequence_ = 1;
+    std::vector<uint64_t>* latencySink_ = nullptr;
+    int shard_ = -1;                                        // Shard number (-1 when not sharded)
+    SpscQueue<TagDelta>* deltas_ = nullptr;                 // Tag reads sent to the merge step (sharded only)
+    ServerMetrics metrics_;                                 // Counters published for the metrics endpoint
+    std::unique_ptr<MetricsHttpServer> metricsServer_;      // Loopback Prometheus endpoint (not in shards)
+    uint64_t accepted_ = 0;                                 // Connections accepted
+    uint32_t readsSinceSample_ = 0;                         // Reads since the last recv-to-parsed sample
+    uint64_t lastTagReads_ = 0;                             // Tag reads at the previous publishMetrics()
+    std::chrono::steady_clock::time_point lastPublish_;
+    std::ostream nullStream_{nullptr};
+};
+
+inline bool ReaderServer::start() {
+    struct sockaddr_in serverAddress;   // Struct that holds the server's IP address and port number.
+    int opt = 1;                        // Used for setting socket options
+
+    /* Create a TCP socket
+
+    serverSocket: A file descriptor is an abstract representation of an open file or input/output resource in a
+    computer operating system. It is a non-negative integer that uniquely identifies the opened file
+    within the scope of a process. File descriptors are commonly used for performing input/output
+    operations on files, sockets, pipes, and other input/output devices.
+
+    AF_INET: The first argument to socket() specifies the address domain or the protocol family to
+    be used for the socket. In this case, AF_INET is used, which indicates that the socket will us
+    the IPv4 addressing scheme.
+
+    SOCK_STREAM: The second argument specifies the type of socket to be created. SOCK_STREAM
+    indicates a TCP socket, which provides a reliable, connection-oriented stream of data.
+
+    SOCK_NONBLOCK: The listening socket is non-blocking so that accept() never stalls the event loop.
+    When no connection is pending accept() fails with EAGAIN instead of waiting.
+
+    0: The third argument specifies the protocol to be used. In this case, 0 indicates that the
+    operating system should choose the appropriate protocol based on the provided address domain
+    and socket type.
+
+    (serverSocket < 0): The result of the socket() function is checked. If the function call
+    returns -1, it indicates that the socket creation failed.
+
+    perror("Socket creation failed"): If the socket creation fails, the perror() function is used
+    to print an error message to the standard error stream, indicating the reason for the failure.
+    */
+    if ((serverSocket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
+        perror("Socket creation failed");
+        return false;
+    }
+
+    /* Set socket options to reuse address and port
+
+    The opt variable is used to set socket options for the server socket. Specifically, opt = 1 sets
+    the SO_REUSEADDR and SO_REUSEPORT options.
+
+    The SO_REUSEADDR option allows reusing a local address and port combination. It allows the
+    server to bind to an address and port even if it is already in use by another socket that is in
+    the TIME_WAIT state. This can be useful to quickly restart a server after it has been shut down.
+
+    The SO_REUSEPORT option allows multiple sockets to bind to the same address and port
+    combination. It enables the server to distribute incoming connections among multiple sockets,
+    which can help achieve higher concurrency or load balancing. ShardedReaderServer
+    (sharded_server.h) relies on it to give every event loop thread its own socket on the port.
+
+    Note that SO_REUSEADDR and SO_REUSEPORT are option names, not bit flags, so each one is set with
+    its own setsockopt() call.
+
+    By specifying SOL_SOCKET as the level in the setsockopt() or getsockopt() function, you
+    indicate that the option is related to the socket itself rather than a specific protocol.
+    */
+    if (setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("Setsockopt failed");
+        return false;
+    }
+
+    /* Description of code below:
+
+    serverAddress.sin_family = AF_INET: The address family being used is the IPv4 addressing scheme.
+
+    serverAddress.sin_addr.s_addr = INADDR_ANY: The server binds to any available network interface
+    on the machine, so readers can connect to any IP address associated with the machine.
+        If you want to use a specific server IP address:
+    serverAddress.sin_addr.s_addr = inet_addr("192.168.1.168");
+
+    serverAddress.sin_port = htons(port): The htons() function converts the port number from host
+    byte order to network byte order.
+    */
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_addr.s_addr = INADDR_ANY;
+    serverAddress.sin_port = htons(config_.port);
+
+    // Bind the socket to the IP address and port
+    if (bind(serverSocket_, (struct sockaddr *)&serverAddress, sizeof(serverAddress)) < 0) {
+        perror("Binding failed");
+        return false;
+    }
+
+    socklen_t addressLength = sizeof(serverAddress);
+    getsockname(serverSocket_, (struct sockaddr *)&serverAddress, &addressLength);
+    boundPort_ = ntohs(serverAddress.sin_port);
+
+    /* Listen for incoming connections
+
+    The listen() function puts the server socket in a passive listening state. Its second argument
+    is the maximum number of pending connections that can be queued up before they are accepted by
+    the server. With many readers connecting at once (e.g. after a power cycle of the dock doors) a
+    small backlog makes the kernel drop connection attempts, so it is configurable (--backlog).
+    */
+    if (listen(serverSocket_, config_.backlog) < 0) {
+        perror("Listen failed");
+        return false;
+    }
+
+    /* Create the epoll instance
+
+    epoll lets one thread wait on the server socket and on every reader socket at the same time.
+    epoll_wait() returns only the file descriptors that are ready, so the cost of a wake-up does not
+    depend on how many readers are connected.
+
+    The eventfd (wakeFd) is also registered so stop() can wake up the loop from a signal handler.
+    */
+    if ((epollFd_ = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("Epoll creation failed");
+        return false;
+    }
+    if ((wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        perror("Eventfd creation failed");
+        return false;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = serverSocket_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, serverSocket_, &event) < 0) {
+        perror("Epoll add failed");
+        return false;
+    }
+    event.data.fd = wakeFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event) < 0) {
+        perror("Epoll add failed");
+        return false;
+    }
+
+    /* Tag report timer
+
+    A timerfd becomes readable every reportIntervalMs, so the tag report is printed from the event
+    loop between reads instead of after every tag read.
+    */
+    if (config_.reportIntervalMs > 0) {
+        if ((reportTimerFd_ = startIntervalTimer(config_.reportIntervalMs)) < 0) {
+            return false;
+        }
+    }
+
+    // CSV (and capture) files for logging client data, written by the logger thread
+    if (config_.logger.csv || config_.logger.capture) {
+        logger_ = std::make_unique<FrameLogger>(config_.logger);
+        if (!logger_->start()) {
+            logger_.reset();
+            return false;
+        }
+    }
+
+    /* Tag file
+
+    With a tag file set (and unless this is a shard, then the sharded server keeps the file), the tag
+    counts live in a memory-mapped file (tag_table.h) and survive a restart: the file is mapped and
+    used as it is, only the top tags are ranked again. A timerfd writes a checkpoint every
+    checkpointIntervalMs.
+    */
+    if (!config_.tagFile.empty() && shard_ < 0) {
+        if (!EPC_Tag_Counts.open(config_.tagFile)) {
+            return false;
+        }
+        tagReporter_.loadTop();
+        std::cout << "Loaded " << EPC_Tag_Counts.size() << " tags from " << config_.tagFile << std::endl;
+        if ((checkpointTimerFd_ = startIntervalTimer(config_.checkpointIntervalMs)) < 0) {
+            return false;
+        }
+    }
+
+    /* Tag presence
+
+    With a leave timeout set (and unless this is a shard, then the merge step does it), every tag read
+    also goes into TagPresence, and a timerfd advances its timing wheel every tickMs so tags that
+    were not read for the timeout leave. Enter and leave events are printed as they happen.
+    */
+    if (config_.presence.leaveTimeoutMs > 0 && shard_ < 0) {
+        presence_ = std::make_unique<TagPresence>(config_.presence, [](const PresenceEvent& event) {
+            printPresenceEvent(std::cout, event);
+        });
+        if ((presenceTimerFd_ = startIntervalTimer(config_.presence.tickMs)) < 0) {
+            return false;
+        }
+    }
+
+    /* Tag queries
+
+    With a query socket set (and unless this is a shard, then the merge step feeds it), the query
+    thread gets every tag of EPC_Tag_Counts (loaded from a tag file) first, and then a timerfd hands
+    it the reads since the last tick every queryIntervalMs (tag_query.h).
+    */
+    if (!config_.querySocket.empty() && shard_ < 0) {
+        query_ = std::make_unique<TagQueryServer>();
+        if (!query_->start(config_.querySocket)) {
+            query_.reset();
+            return false;
+        }
+        query_->load(EPC_Tag_Counts, wallClockNs());
+        if ((queryTimerFd_ = startIntervalTimer(config_.queryIntervalMs)) < 0) {
+            return false;
+        }
+        std::cout << "Tag queries on " << config_.querySocket << std::endl;
+    }
+
+    /* Command timeouts
+
+    The commands in flight wait for their answer in commandDeadlines_, oldest first. This timerfd is
+    armed (one shot) for the oldest deadline while there is one, so an idle server is not woken up.
+    */
+    if ((commandTimerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+        perror("Timerfd creation failed");
+        return false;
+    }
+    event.data.fd = commandTimerFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, commandTimerFd_, &event) < 0) {
+        perror("Epoll add failed");
+        return false;
+    }
+
+    /* io_uring receive backend
+
+    With config.ioUring the reader sockets are not registered with epoll. Each one gets a multishot
+    recv on the ring (uring_receiver.h), and run() waits on the ring, which also watches the epoll
+    instance for everything else. If the kernel can not do it, the server says so and receives with
+    epoll and read() as usual.
+    */
+    if (config_.ioUring) {
+        uring_ = std::make_unique<UringReceiver>();
+        if (uring_->start()) {
+            if (shard_ <= 0) {
+                std::cout << "Receiving with io_uring (" << URING_BUFFERS << " provided buffers of "
+                          << URING_BUFFER_SIZE << " bytes)" << std::endl;
+            }
+        } else {
+            uring_.reset();
+            std::cout << "io_uring unavailable, receiving with epoll" << std::endl;
+        }
+    }
+
+    /* Metrics
+
+    With metrics on, a second timerfd makes the loop publish its counters every metricsIntervalMs
+    and (unless this is a shard, then the sharded server does it) a thread serves them over HTTP on
+    the loopback interface.
+    */
+    if (config_.metricsPort >= 0) {
+        if ((metricsTimerFd_ = startIntervalTimer(config_.metricsIntervalMs)) < 0) {
+            return false;
+        }
+        lastPublish_ = std::chrono::steady_clock::now();
+
+        if (shard_ < 0) {
+            metricsServer_ = std::make_unique<MetricsHttpServer>([this](std::ostream& out) {
+                writeMetrics(out, {this});
+            });
+            if (!metricsServer_->start(config_.metricsPort)) {
+                metricsServer_.reset();
+                return false;
+            }
+            std::cout << "Metrics on http://127.0.0.1:" << metricsServer_->port() << "/metrics" << std::endl;
+        }
+    }
+
+    if (shard_ < 0) {
+        std::cout << "Server listening on port " << boundPort_ << std::endl;
+    } else {
+        std::cout << "Shard " << shard_ << " listening on port " << boundPort_ << std::endl;
+    }
+    return true;
+}
+
+/* Event loop
+
+With io_uring the loop waits in io_uring_enter() and handles the receive completions. epoll_wait()
+is only called, without blocking, after the ring's poll of the epoll instance reported it ready
+(and again while it returned a full batch of events, as the poll only reports new readiness).
+
+Command frames queued during a pass (submitted, freed by an answer or waiting for a full socket to
+drain) are written at the start of the next one, before the loop waits: one sendmsg() per reader
+however many commands it got in between.
+*/
+inline void ReaderServer::run() {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    bool epollReady = false;
+    if (uring_ && (!uring_->enable() || !uring_->poll(epollFd_, URING_EPOLL_DATA))) {
+        return;
+    }
+
+    while (true) {
+        flushCommands();
+        int timeout = -1;
+        if (uring_) {
+            if (!epollReady) {
+                if (!uring_->wait()) {
+                    return;
+                }
+                epollReady = receiveCompletions();
+                if (!epollReady) {
+                    continue;
+                }
+            }
+            timeout = 0;
+        }
+        int ready = epoll_wait(epollFd_, events, MAX_EPOLL_EVENTS, timeout);
+        receiveSyscalls_++;
+        epollReady = ready == MAX_EPOLL_EVENTS;
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Epoll wait failed");
+            return;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd_) {
+                if (handleWake()) {
+                    return;
+                }
+                continue;
+            }
+            if (fd == reportTimerFd_) {
+                uint64_t expirations;
+                ssize_t ignored = read(reportTimerFd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                if (deltas_) {
+                    publishTagDeltas();
+                } else if (tagReporter_.report(std::cout) && presence_) {
+                    std::cout << "Tags present: " << presence_->size() << std::endl;
+                }
+                continue;
+            }
+            if (fd == presenceTimerFd_) {
+                uint64_t expirations;
+                ssize_t ignored = read(presenceTimerFd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                presence_->advance(wallClockNs());
+                std::cout << std::flush;
+                continue;
+            }
+            if (fd == checkpointTimerFd_) {
+                uint64_t expirations;
+                ssize_t ignored = read(checkpointTimerFd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                EPC_Tag_Counts.checkpoint(wallClockNs());
+                continue;
+            }
+            if (fd == queryTimerFd_) {
+                uint64_t expirations;
+                ssize_t ignored = read(queryTimerFd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                query_->publish(EPC_Tag_Counts, wallClockNs());
+                continue;
+            }
+            if (fd == commandTimerFd_) {
+                uint64_t expirations;
+                ssize_t ignored = read(commandTimerFd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                expireCommands();
+                continue;
+            }
+            if (fd == metricsTimerFd_) {
+                uint64_t expirations;
+                ssize_t ignored = read(metricsTimerFd_, &expirations, sizeof(expirations));
+                (void)ignored;
+                publishMetrics();
+                continue;
+            }
+            if (fd == serverSocket_) {
+                acceptConnections();
+                continue;
+            }
+
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) {
+                continue;   // Closed earlier in this batch
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeConnection(fd, "Client connection error");
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                scheduleFlush(*it->second);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                readConnection(*it->second);
+            }
+        }
+    }
+}
+
+// Handle the requests of stop() and requestTagDump(). Returns true if the event loop should return.
+inline bool ReaderServer::handleWake() {
+    uint64_t count;
+    ssize_t ignored = read(wakeFd_, &count, sizeof(count));
+    (void)ignored;
+    if (commandWakePending_.exchange(false)) {
+        takeSubmittedCommands();
+    }
+    if (dumpRequested_.exchange(false)) {
+        printEpcTagFrequencies(std::cout, EPC_Tag_Counts);
+        if (presence_) {
+            printPresentTags(std::cout, *presence_, wallClockNs());
+        }
+    }
+    return stopRequested_.load();
+}
+
+// Copy the counters into metrics_ for the metrics thread
+inline void ReaderServer::publishMetrics() {
+    ConnectionCounters sum = totals();
+    metrics_.bytes.store(sum.bytes, std::memory_order_relaxed);
+    metrics_.reads.store(sum.reads, std::memory_order_relaxed);
+    metrics_.connects.store(sum.connects, std::memory_order_relaxed);
+    metrics_.tagReads.store(sum.tagReads, std::memory_order_relaxed);
+    metrics_.heartbeats.store(sum.heartbeats, std::memory_order_relaxed);
+    metrics_.unknownTypes.store(sum.unknownTypes, std::memory_order_relaxed);
+    metrics_.inventoryEnds.store(sum.inventoryEnds, std::memory_order_relaxed);
+    metrics_.antennaStatus.store(sum.antennaStatus, std::memory_order_relaxed);
+    metrics_.readerErrors.store(sum.readerErrors, std::memory_order_relaxed);
+    metrics_.malformed.store(sum.malformed, std::memory_order_relaxed);
+    metrics_.commandsSent.store(sum.commandsSent, std::memory_order_relaxed);
+    metrics_.commandsAnswered.store(sum.commandsAnswered, std::memory_order_relaxed);
+    metrics_.commandTimeouts.store(sum.commandTimeouts, std::memory_order_relaxed);
+    metrics_.commandWrites.store(sum.commandWrites, std::memory_order_relaxed);
+    metrics_.checksumErrors.store(sum.checksumErrors, std::memory_order_relaxed);
+    metrics_.resyncs.store(sum.resyncs, std::memory_order_relaxed);
+    metrics_.discardedBytes.store(sum.discardedBytes, std::memory_order_relaxed);
+    metrics_.connectionsAccepted.store(accepted_, std::memory_order_relaxed);
+    metrics_.connectionsOpen.store(connections_.size(), std::memory_order_relaxed);
+    metrics_.distinctTags.store(EPC_Tag_Counts.size(), std::memory_order_relaxed);
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastPublish_).count();
+    if (seconds > 0) {
+        metrics_.tagsPerSecond.store(static_cast<uint64_t>((sum.tagReads - lastTagReads_) / seconds),
+                                     std::memory_order_relaxed);
+    }
+    lastTagReads_ = sum.tagReads;
+    lastPublish_ = now;
+
+    std::lock_guard<std::mutex> lock(metrics_.connectionsMutex);
+    metrics_.connections.clear();
+    for (const auto& entry : connections_) {
+        const ReaderConnection& connection = *entry.second;
+        metrics_.connections.push_back({connection.id, connection.address, connection.counters});
+    }
+}
+
+/* Prometheus text output
+
+Every metric family is written once with a sample per server (labelled shard="N" when there is more
+than one) and the per-reader families with a sample per connection. Runs on the metrics thread, so it
+only reads ServerMetrics, the logger's atomics and the connection list under its mutex.
+*/
+inline void ReaderServer::writeMetrics(std::ostream& out, const std::vector<const ReaderServer*>& servers) {
+    auto shardLabel = [&servers](size_t i) {
+        return servers.size() > 1 ? "shard=\"" + std::to_string(i) + "\"" : std::string();
+    };
+    auto withLabel = [](const std::string& labels, const std::string& label) {
+        return labels.empty() ? label : labels + "," + label;
+    };
+    auto counterFamily = [&](const char* name, const char* type, const char* help,
+                             const std::atomic<uint64_t> ServerMetrics::*field) {
+        writeMetricHeader(out, name, type, help);
+        for (size_t i = 0; i < servers.size(); i++) {
+            writeSample(out, name, shardLabel(i), (servers[i]->metrics_.*field).load(std::memory_order_relaxed));
+        }
+    };
+
+    counterFamily("rfid_received_bytes_total", "counter", "Bytes received from the readers.", &ServerMetrics::bytes);
+    counterFamily("rfid_reads_total", "counter", "read() calls that returned data.", &ServerMetrics::reads);
+
+    writeMetricHeader(out, "rfid_frames_total", "counter", "Frames with a valid checksum by TYPE.");
+    for (size_t i = 0; i < servers.size(); i++) {
+        const ServerMetrics& m = servers[i]->metrics_;
+        std::string labels = shardLabel(i);
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"connect\""), m.connects.load());
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"tag_read\""), m.tagReads.load());
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"heartbeat\""), m.heartbeats.load());
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"inventory_end\""), m.inventoryEnds.load());
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"antenna_status\""), m.antennaStatus.load());
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"error\""), m.readerErrors.load());
+        writeSample(out, "rfid_frames_total", withLabel(labels, "type=\"unknown\""), m.unknownTypes.load());
+    }
+    counterFamily("rfid_malformed_frames_total", "counter", "Frames of a known TYPE with a Len out of its range.",
+                  &ServerMetrics::malformed);
+
+    counterFamily("rfid_commands_sent_total", "counter", "Command frames written to the readers.",
+                  &ServerMetrics::commandsSent);
+    counterFamily("rfid_command_answers_total", "counter", "Commands the readers answered.",
+                  &ServerMetrics::commandsAnswered);
+    counterFamily("rfid_command_timeouts_total", "counter", "Commands the readers did not answer in time.",
+                  &ServerMetrics::commandTimeouts);
+    counterFamily("rfid_command_writes_total", "counter", "sendmsg() calls that wrote command frames.",
+                  &ServerMetrics::commandWrites);
+
+    counterFamily("rfid_checksum_errors_total", "counter", "Frames whose checksum did not match.",
+                  &ServerMetrics::checksumErrors);
+    counterFamily("rfid_resyncs_total", "counter", "Times bytes were skipped to find the next frame head.",
+                  &ServerMetrics::resyncs);
+    counterFamily("rfid_discarded_bytes_total", "counter", "Bytes skipped while resyncing.",
+                  &ServerMetrics::discardedBytes);
+    counterFamily("rfid_connections_accepted_total", "counter", "Reader connections accepted.",
+                  &ServerMetrics::connectionsAccepted);
+    counterFamily("rfid_connections_open", "gauge", "Reader connections currently open.",
+                  &ServerMetrics::connectionsOpen);
+    counterFamily("rfid_distinct_tags", "gauge", "Distinct EPCs in the tag table.", &ServerMetrics::distinctTags);
+    counterFamily("rfid_tags_per_second", "gauge", "Tag reads per second over the last publish interval.",
+                  &ServerMetrics::tagsPerSecond);
+
+    writeMetricHeader(out, "rfid_recv_to_parsed_seconds", "histogram",
+                      "Time from read() returning to every frame of that read being handled.");
+    for (size_t i = 0; i < servers.size(); i++) {
+        writeHistogram(out, "rfid_recv_to_parsed_seconds", shardLabel(i), servers[i]->metrics_.recvToParsed);
+    }
+
+    // Logger
+    writeMetricHeader(out, "rfid_log_queue_depth", "gauge", "Frames waiting for the logger thread.");
+    for (size_t i = 0; i < servers.size(); i++) {
+        writeSample(out, "rfid_log_queue_depth", shardLabel(i), servers[i]->loggerStats().queueDepth);
+    }
+    writeMetricHeader(out, "rfid_log_dropped_frames_total", "counter", "Frames dropped because the log queue was full.");
+    for (size_t i = 0; i < servers.size(); i++) {
+        writeSample(out, "rfid_log_dropped_frames_total", shardLabel(i), servers[i]->loggerStats().dropped);
+    }
+    writeMetricHeader(out, "rfid_log_frames_total", "counter", "Frames written to the data logs.");
+    for (size_t i = 0; i < servers.size(); i++) {
+        writeSample(out, "rfid_log_frames_total", shardLabel(i), servers[i]->loggerStats().framesWritten);
+    }
+    writeMetricHeader(out, "rfid_parsed_to_logged_seconds", "histogram",
+                      "Time from a frame being received to its log batch being written.");
+    for (size_t i = 0; i < servers.size(); i++) {
+        if (servers[i]->logger_) {
+            writeHistogram(out, "rfid_parsed_to_logged_seconds", shardLabel(i), servers[i]->logger_->loggedLatency());
+        }
+    }
+
+    // Per reader connection
+    std::vector<std::pair<std::string, ConnectionCounters>> readers;
+    for (size_t i = 0; i < servers.size(); i++) {
+        ServerMetrics& m = const_cast<ServerMetrics&>(servers[i]->metrics_);
+        std::lock_guard<std::mutex> lock(m.connectionsMutex);
+        for (const ConnectionSnapshot& connection : m.connections) {
+            readers.emplace_back(withLabel(shardLabel(i), "reader=\"" + connection.address + "\",id=\"" +
+                                           std::to_string(connection.id) + "\""), connection.counters);
+        }
+    }
+    writeMetricHeader(out, "rfid_reader_received_bytes_total", "counter", "Bytes received from one reader.");
+    for (const auto& reader : readers) {
+        writeSample(out, "rfid_reader_received_bytes_total", reader.first, reader.second.bytes);
+    }
+    writeMetricHeader(out, "rfid_reader_frames_total", "counter", "Frames with a valid checksum from one reader by TYPE.");
+    for (const auto& reader : readers) {
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"connect\"", reader.second.connects);
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"tag_read\"", reader.second.tagReads);
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"heartbeat\"", reader.second.heartbeats);
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"inventory_end\"", reader.second.inventoryEnds);
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"antenna_status\"", reader.second.antennaStatus);
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"error\"", reader.second.readerErrors);
+        writeSample(out, "rfid_reader_frames_total", reader.first + ",type=\"unknown\"", reader.second.unknownTypes);
+    }
+    writeMetricHeader(out, "rfid_reader_checksum_errors_total", "counter", "Checksum mismatches from one reader.");
+    for (const auto& reader : readers) {
+        writeSample(out, "rfid_reader_checksum_errors_total", reader.first, reader.second.checksumErrors);
+    }
+    writeMetricHeader(out, "rfid_reader_resyncs_total", "counter", "Resyncs in the stream of one reader.");
+    for (const auto& reader : readers) {
+        writeSample(out, "rfid_reader_resyncs_total", reader.first, reader.second.resyncs);
+    }
+}
+
+inline void ReaderServer::shutdown() {
+    metricsServer_.reset();     // Stops the metrics thread before anything it reads is torn down
+    query_.reset();             // Stops the query thread and removes its socket
+    for (auto& entry : connections_) {
+        close(entry.first);
+    }
+    connections_.clear();
+    connectionFds_.clear();
+    commandDeadlines_.clear();
+    uring_.reset();             // Cancels the receives still queued
+
+    if (serverSocket_ >= 0) {
+        close(serverSocket_);
+        serverSocket_ = -1;
+    }
+    if (epollFd_ >= 0) {
+        close(epollFd_);
+        epollFd_ = -1;
+    }
+    if (wakeFd_ >= 0) {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+    if (reportTimerFd_ >= 0) {
+        close(reportTimerFd_);
+        reportTimerFd_ = -1;
+    }
+    if (metricsTimerFd_ >= 0) {
+        close(metricsTimerFd_);
+        metricsTimerFd_ = -1;
+    }
+    if (presenceTimerFd_ >= 0) {
+        close(presenceTimerFd_);
+        presenceTimerFd_ = -1;
+    }
+    if (queryTimerFd_ >= 0) {
+        close(queryTimerFd_);
+        queryTimerFd_ = -1;
+    }
+    if (commandTimerFd_ >= 0) {
+        close(commandTimerFd_);
+        commandTimerFd_ = -1;
+    }
+    if (checkpointTimerFd_ >= 0) {
+        close(checkpointTimerFd_);
+        checkpointTimerFd_ = -1;
+        std::cout << "Saved " << EPC_Tag_Counts.size() << " tags to " << config_.tagFile << std::endl;
+        EPC_Tag_Counts.close();
+    }
+    if (logger_) {
+        logger_->stop();
+        LoggerStats stats = logger_->stats();
+        std::cout << "Logged " << stats.framesWritten << " frames (" << stats.bytesWritten << " bytes in "
+                  << stats.batches << " writes, " << stats.dropped << " frames dropped)";
+        if (stats.rotateFailures > 0) {
+            std::cout << ", " << stats.rotateFailures << " log rotations failed";
+        }
+        if (config_.logger.compress && stats.csvStoredBytes > 0) {
+            std::cout << ", csv compressed " << std::fixed << std::setprecision(1)
+                      << static_cast<double>(stats.csvBytes) / stats.csvStoredBytes << "x" << std::defaultfloat;
+        }
+        std::cout << std::endl;
+        logger_.reset();
+    }
+}
+
+/* Accept every pending client connection
+
+accept4() returns a new socket descriptor for each established connection. The sockets are created
+non-blocking (SOCK_NONBLOCK) so a read() can never stall the event loop. accept4() is called until it
+fails with EAGAIN, which means the kernel's queue of pending connections is empty.
+
+Each reader socket is registered with epoll for EPOLLIN, so the loop is woken up whenever that
+reader sent data or disconnected. With io_uring a multishot recv is queued for it instead.
+*/
+inline void ReaderServer::acceptConnections() {
+    while (true) {
+        struct sockaddr_in clientAddress;
+        socklen_t addressLength = sizeof(clientAddress);
+        int clientSocket = accept4(serverSocket_, (struct sockaddr *)&clientAddress, &addressLength,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientSocket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        auto connection = std::make_unique<ReaderConnection>();
+        connection->fd = clientSocket;
+        connection->id = nextConnectionId_++;
+        accepted_++;
+        if (!connection->reassembler.init(config_.receiveBufferSize)) {
+            close(clientSocket);
+            continue;
+        }
+        connection->address = std::string(inet_ntoa(clientAddress.sin_addr)) + ":" +
+                              std::to_string(ntohs(clientAddress.sin_port));
+
+        if (uring_) {
+            if (!uring_->receive(clientSocket, ringUserData(*connection))) {
+                close(clientSocket);
+                continue;
+            }
+        } else {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = clientSocket;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, clientSocket, &event) < 0) {
+                perror("Epoll add failed");
+                close(clientSocket);
+                continue;
+            }
+        }
+
+        std::cout << "Accepted connection from " << connection->address << std::endl;
+        ReaderConnection& reader = *connection;
+        connectionFds_[reader.id] = clientSocket;
+        connections_[clientSocket] = std::move(connection);
+
+        // Configure the reader (written at the start of the next loop pass, with the other new readers')
+        if (!config_.connectCommands.empty()) {
+            reader.configuring = config_.connectCommands.size();
+            reader.configureStartNs = monotonicNs();
+            for (const ReaderCommand& command : config_.connectCommands) {
+                queueCommand(reader, command, true);
+            }
+        }
+    }
+}
+
+/* Receive data from a reader that epoll reported as readable
+
+read() writes straight into the free space of the connection's receive ring. It returns the number
+of bytes received, 0 when the reader disconnected and -1 on an error. EAGAIN means there was nothing
+left to read (the socket is non-blocking), so the loop just goes back to epoll_wait(). One read() is
+done per wake-up so a busy reader can not starve the others.
+
+handleReceived() then parses what arrived.
+*/
+inline void ReaderServer::readConnection(ReaderConnection& connection) {
+    FrameReassembler& reassembler = connection.reassembler;
+
+    ssize_t valRead = read(connection.fd, reassembler.writePtr(), reassembler.writable());
+    receiveSyscalls_++;
+    if (valRead > 0) {
+        connection.counters.reads++;
+        handleReceived(connection, valRead);
+    } else if (valRead == 0) {
+        closeConnection(connection.fd, "Client disconnected");
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("Read failed");
+        closeConnection(connection.fd, "Client connection closed");
+    }
+}
+
+/* Handle the receive completions of the io_uring backend
+
+Every completion names its connection by id and socket (ringUserData()), so a completion still
+queued for a connection that was closed (or whose socket number was already reused) is dropped. The
+bytes are copied from the provided buffer into the connection's receive ring, where a frame split
+over two receives is put together as with read(); the buffer goes back to the kernel right after.
+
+The multishot recv stays armed until the reader disconnects. If it ended because the provided
+buffers ran out (-ENOBUFS) it is queued again; the buffers are back once this pass is done.
+
+Returns true if the poll of the epoll instance completed (something other than a reader is ready).
+*/
+inline bool ReaderServer::receiveCompletions() {
+    bool epollReady = false;
+    uring_->reap([this, &epollReady](uint64_t userData, const uint8_t* data, int32_t res, bool more) {
+        if (userData == URING_EPOLL_DATA) {
+            epollReady = true;
+            if (!more) {
+                uring_->poll(epollFd_, URING_EPOLL_DATA);
+            }
+            return;
+        }
+        auto it = connections_.find(static_cast<int>(userData & 0xffffffffu));
+        if (it == connections_.end() || ringUserData(*it->second) != userData) {
+            return;
+        }
+        ReaderConnection& connection = *it->second;
+        if (res > 0) {
+            connection.counters.reads++;
+            FrameReassembler& reassembler = connection.reassembler;
+            for (size_t done = 0; done < static_cast<size_t>(res);) {
+                size_t size = std::min(reassembler.writable(), static_cast<size_t>(res) - done);
+                memcpy(reassembler.writePtr(), data + done, size);
+                handleReceived(connection, size);
+                done += size;
+            }
+        } else if (res == 0) {
+            closeConnection(connection.fd, "Client disconnected");
+            return;
+        } else if (res != -ENOBUFS) {
+            errno = -res;
+            perror("Receive failed");
+            closeConnection(connection.fd, "Client connection closed");
+            return;
+        }
+        if (!more) {
+            uring_->receive(connection.fd, userData);
+        }
+    });
+    return epollReady;
+}
+
+/* Parse bytes that were just written into the connection's receive ring
+
+The reassembler hands every complete frame in the ring to handleFrame(). A frame split over two
+receives stays in the ring until the rest of it arrives.
+*/
+inline void ReaderServer::handleReceived(ReaderConnection& connection, size_t bytes) {
+    FrameReassembler& reassembler = connection.reassembler;
+
+    // Time this read for the benchmarks' sink, or every LATENCY_SAMPLE_READS-th read for the metrics
+    bool timed = latencySink_ || (metricsTimerFd_ >= 0 && ++readsSinceSample_ == LATENCY_SAMPLE_READS);
+    auto begin = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int64_t receivedNs = wallClockNs();     // One time stamp for every frame in this read
+    connection.counters.bytes += bytes;
+    reassembler.commit(bytes);
+
+    reassembler.drain(connection.counters, [&](const uint8_t* frame, size_t size, bool checksumOk) {
+        handleFrame(connection, frame, size, checksumOk, receivedNs);
+    });
+
+    if (timed) {
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+        if (latencySink_) {
+            latencySink_->push_back(elapsed);
+        }
+        if (readsSinceSample_ == LATENCY_SAMPLE_READS) {
+            metrics_.recvToParsed.record(elapsed);
+            readsSinceSample_ = 0;
+        }
+    }
+}
+
+inline void ReaderServer::closeConnection(int fd, const char* reason) {
+    auto it = connections_.find(fd);
+    if (it == connections_.end()) {
+        return;
+    }
+    ReaderConnection& connection = *it->second;
+    std::cout << reason << " (" << connection.address << ")" << std::endl;
+    if (uring_) {
+        uring_->cancel(ringUserData(connection));
+    }
+    if (!uring_ || connection.waitingWritable) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    close(fd);
+    connection.commands.clear([this, &connection](const PendingCommand& command) {
+        finishCommand(connection, command, CommandStatus::Closed, ByteSpan());
+    });
+    closedTotals_.add(connection.counters);
+    connectionFds_.erase(connection.id);
+    connections_.erase(it);
+}
+
+/* Commands submitted from other threads
+
+Called from handleWake() after submitCommand() woke the loop. Every waiting command is queued on
+its reader's channel (on every reader's for connectionId 0); the frames are written by the next
+flushCommands(). A command for a reader that is not connected is rejected right away.
+*/
+inline void ReaderServer::takeSubmittedCommands() {
+    while (ReaderCommand* command = commandQueue_.front()) {
+        if (command->connectionId == 0) {
+            for (auto& entry : connections_) {
+                queueCommand(*entry.second, *command, false);
+            }
+        } else {
+            auto it = connectionFds_.find(command->connectionId);
+            if (it != connectionFds_.end()) {
+                queueCommand(*connections_[it->second], *command, false);
+            } else if (commandHandler_) {
+                CommandResult result;
+                result.connectionId = command->connectionId;
+                result.type = command->type;
+                result.tag = command->tag;
+                result.status = CommandStatus::Rejected;
+                commandHandler_(result);
+            }
+        }
+        commandQueue_.pop();
+    }
+}
+
+inline void ReaderServer::queueCommand(ReaderConnection& connection, const ReaderCommand& command, bool onConnect) {
+    if (!connection.commands.queue(command, nextCommandSequence_++, onConnect)) {
+        PendingCommand rejected;
+        rejected.tag = command.tag;
+        rejected.onConnect = onConnect;
+        rejected.frame[1] = command.type;
+        finishCommand(connection, rejected, CommandStatus::Rejected, ByteSpan());
+        return;
+    }
+    scheduleFlush(connection);
+}
+
+// Write the connection's commands at the start of the next loop pass
+inline void ReaderServer::scheduleFlush(ReaderConnection& connection) {
+    if (!connection.flushQueued) {
+        connection.flushQueued = true;
+        flushQueue_.push_back(connection.fd);
+    }
+}
+
+/* Write the command frames of every connection in flushQueue_
+
+Each connection writes what fits in its window with one sendmsg(), and every frame written gets a
+deadline of commandTimeoutMs. If the socket could not take all of them (the reader is not reading)
+the connection is registered for EPOLLOUT until it can; with io_uring the socket is only added to
+the epoll instance for that time.
+*/
+inline void ReaderServer::flushCommands() {
+    if (flushQueue_.empty()) {
+        return;
+    }
+    int64_t now = monotonicNs();
+    int64_t deadline = now + static_cast<int64_t>(config_.commandTimeoutMs) * 1000000;
+    for (size_t i = 0; i < flushQueue_.size(); i++) {
+        int fd = flushQueue_[i];
+        auto it = connections_.find(fd);
+        if (it == connections_.end() || !it->second->flushQueued) {
+            continue;   // Closed (or the socket number reused) since it was queued
+        }
+        ReaderConnection& connection = *it->second;
+        connection.flushQueued = false;
+        bool ok = connection.commands.flush(fd, config_.commandWindow, now, connection.counters.commandWrites,
+                                            [&](const PendingCommand& command) {
+            connection.counters.commandsSent++;
+            commandDeadlines_.push_back({deadline, fd, connection.id, command.sequence, false});
+        });
+        if (!ok) {
+            perror("Write failed");
+            closeConnection(fd, "Client connection closed");
+            continue;
+        }
+
+        bool blocked = connection.commands.writable(config_.commandWindow);
+        if (blocked != connection.waitingWritable) {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = (uring_ ? 0u : EPOLLIN | EPOLLRDHUP) | (blocked ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            event.data.fd = fd;
+            int operation = uring_ ? (blocked ? EPOLL_CTL_ADD : EPOLL_CTL_DEL) : EPOLL_CTL_MOD;
+            if (epoll_ctl(epollFd_, operation, fd, &event) < 0) {
+                perror("Epoll modify failed");
+            }
+            connection.waitingWritable = blocked;
+        }
+    }
+    flushQueue_.clear();
+    if (!commandTimerArmed_ && !commandDeadlines_.empty()) {
+        armCommandTimer();
+    }
+}
+
+// Create an interval timer (createIntervalTimer()) and add it to the epoll instance. Returns its fd, or -1.
+inline int ReaderServer::startIntervalTimer(int64_t intervalMs) {
+    int fd = createIntervalTimer(intervalMs);
+    if (fd < 0) {
+        return -1;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("Epoll add failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Arm the command timer for the oldest deadline
+inline void ReaderServer::armCommandTimer() {
+    int64_t deadline = commandDeadlines_.front().deadlineNs;
+    struct itimerspec at;
+    memset(&at, 0, sizeof(at));
+    at.it_value.tv_sec = deadline / 1000000000;
+    at.it_value.tv_nsec = deadline % 1000000000;
+    timerfd_settime(commandTimerFd_, TFD_TIMER_ABSTIME, &at, nullptr);
+    commandTimerArmed_ = true;
+}
+
+/* Time out the commands whose deadline passed
+
+A command that times out is reported and left in its channel as an abandoned placeholder for one more
+commandTimeoutMs, to take a late answer; then it is dropped. Both waits are commandTimeoutMs long, so
+commandDeadlines_ stays in deadline order. Entries of commands that were answered (or of connections
+that closed) are still in it and are skipped here.
+*/
+inline void ReaderServer::expireCommands() {
+    commandTimerArmed_ = false;
+    int64_t now = monotonicNs();
+    int64_t dropAt = now + static_cast<int64_t>(config_.commandTimeoutMs) * 1000000;
+    while (!commandDeadlines_.empty() && commandDeadlines_.front().deadlineNs <= now) {
+        CommandDeadline deadline = commandDeadlines_.front();
+        commandDeadlines_.pop_front();
+        auto it = connections_.find(deadline.fd);
+        if (it == connections_.end() || it->second->id != deadline.connectionId) {
+            continue;
+        }
+        ReaderConnection& connection = *it->second;
+        if (deadline.abandoned) {
+            if (connection.commands.drop(deadline.sequence)) {
+                scheduleFlush(connection);  // Its place in the window is free
+            }
+            continue;
+        }
+        connection.commands.expire(deadline.sequence, [&](const PendingCommand& command) {
+            finishCommand(connection, command, CommandStatus::TimedOut, ByteSpan());
+            commandDeadlines_.push_back({dropAt, deadline.fd, deadline.connectionId, command.sequence, true});
+        });
+    }
+    if (!commandDeadlines_.empty()) {
+        armCommandTimer();
+    }
+}
+
+/* Hand a frame that answers a command in flight to that command. Returns false if it answers none.
+
+A late answer to a command that timed out is taken (and dropped) by its placeholder.
+*/
+inline bool ReaderServer::answerCommand(ReaderConnection& connection, const FrameView& view) {
+    bool matched = connection.commands.match(view.type, [&](const PendingCommand& command) {
+        console() << "\033[1;32mCommand answered\033[0m" << std::endl;
+        finishCommand(connection, command, CommandStatus::Answered, view.data);
+    });
+    if (matched) {
+        scheduleFlush(connection);          // Its place in the window is free
+    }
+    return matched;
+}
+
+/* Report the result of a command
+
+The commands the server sent on connect (config.connectCommands) are counted on the connection,
+and one line is printed once all of them are done. The results of submitted commands go to the
+command handler.
+*/
+inline void ReaderServer::finishCommand(ReaderConnection& connection, const PendingCommand& command,
+                                        CommandStatus status, ByteSpan response) {
+    int64_t now = monotonicNs();
+    if (status == CommandStatus::Answered) {
+        connection.counters.commandsAnswered++;
+    } else if (status == CommandStatus::TimedOut) {
+        connection.counters.commandTimeouts++;
+    }
+
+    if (command.onConnect) {
+        if (status != CommandStatus::Answered) {
+            connection.configureFailures++;
+        }
+        if (--connection.configuring == 0 && status != CommandStatus::Closed) {
+            size_t commands = config_.connectCommands.size();
+            std::cout << "Configured " << connection.address << ": " << commands - connection.configureFailures
+                      << "/" << commands << " commands answered in "
+                      << (now - connection.configureStartNs) / 1000000.0 << " ms" << std::endl;
+        }
+        return;
+    }
+    if (!commandHandler_) {
+        return;
+    }
+    CommandResult result;
+    result.connectionId = connection.id;
+    result.address = connection.address.c_str();
+    result.type = command.frame[1];
+    result.tag = command.tag;
+    result.status = status;
+    result.response = response;
+    result.latencyNs = command.writtenNs ? now - command.writtenNs : 0;
+    commandHandler_(result);
+}
+
+/* Print one frame to the console
+
+Every field is printed as two-digit hexadecimal values. formatHex() writes the hex characters into a
+buffer on the stack, so nothing is allocated per byte.
+*/
+inline void ReaderServer::printFrame(std::ostream& out, const ReaderConnection& connection, const FrameView& view,
+                                     const uint8_t* frame, size_t size, bool checksumOk) {
+    char hex[3 * MAX_FRAME_SIZE];
+    uint8_t summed = frameChecksum(frame);
+
+    out << "Received client data (hex) from " << connection.address << ": ";
+    out.write(hex, formatHex(hex, frame, size, ' ') - hex) << "\n";
+    out << "Head (hex): ";
+    out.write(hex, formatHex(hex, &view.head, 1, ' ') - hex) << "\n";
+    out << "Type (hex): ";
+    out.write(hex, formatHex(hex, &view.type, 1, ' ') - hex) << "\n";
+    out << "Len (hex): ";
+    out.write(hex, formatHex(hex, &view.len, 1, ' ') - hex) << "\n";
+    out << "Data (hex): ";
+    out.write(hex, formatHex(hex, view.data.data, view.data.size, ' ') - hex) << "\n";
+    out << "CRC (hex): ";
+    out.write(hex, formatHex(hex, &view.crc, 1, 0) - hex) << "\n";
+    out << "Summed value (hex): ";
+    out.write(hex, formatHex(hex, &summed, 1, 0) - hex) << "\n";
+    // The reassembler compared the calculated checksum with the received checksum
+    if (checksumOk) {
+        out << "\033[32mValid data. (Checksums match)\033[0m" << std::endl;
+    } else {
+        out << "\033[31mInvalid data. (Checksums do not match)\033[0m" << std::endl;
+    }
+}
+
+/* Handle one complete frame
+
+parseFrame() reads the Head, Type, Len, Data and CRC fields straight from the received bytes in the
+connection's ring, so no per-byte strings are built. Hex text is only produced at the sinks that
+need text: the console (unless --quiet) and the csv log. The frame bytes are queued for the logger
+thread, which does the hex formatting and the disk writes.
+*/
+inline void ReaderServer::handleFrame(ReaderConnection& connection, const uint8_t* frame, size_t size, bool checksumOk,
+                                      int64_t receivedNs) {
+    FrameView view;
+    if (!parseFrame(frame, size, view)) {
+        return;
+    }
+    std::ostream& out = console();
+
+    // Save data to CSV file as hex values (on the logger thread)
+    if (logger_) {
+        logger_->log(frame, size, receivedNs, connection.id);
+    }
+
+    if (!config_.quiet) {
+        printFrame(out, connection, view, frame, size, checksumOk);
+    }
+
+    // Frames with a bad checksum are skipped up to their trailer and not handled
+    if (!checksumOk) {
+        return;
+    }
+
+    // An answer to a command in flight goes to the command, anything else to the handler of its TYPE
+    if (connection.commands.inFlight() && answerCommand(connection, view)) {
+        return;
+    }
+    FrameContext context{*this, connection, out, receivedNs};
+    FrameTypes::dispatch(context, view);
+}
+
+/* Frame handlers
+
+Called through the dispatch table (FrameTypes) with the decoded frame, for frames with a valid
+checksum. Antenna status changes and reader errors are printed in quiet mode too.
+*/
+inline void ReaderServer::onConnect(FrameContext& context, const ConnectFrame&) {
+    context.out << "\033[1;35mTCP connection with RFID reader successful\033[0m" << std::endl;
+    context.connection.counters.connects++;
+}
+
+inline void ReaderServer::onTagRead(FrameContext& context, const TagReadFrame& frame) {
+    ReaderServer& server = context.server;
+    context.out << "\033[1;36mTAG Read\033[0m" << std::endl;
+    context.connection.counters.tagReads++;
+    // Update EPC frequency table (keyed on the 12 raw EPC bytes)
+    TagEntry& entry = server.EPC_Tag_Counts.record(EpcKey::fromBytes(frame.epc), context.receivedNs);
+    // Only this tag is printed; the tag report and the full dump are printed from the event loop
+    server.tagReporter_.onRead(entry);
+    if (server.presence_) {
+        server.presence_->record(entry.epc, context.receivedNs);
+    }
+    if (server.query_) {
+        server.query_->onRead(entry);
+    }
+    if (!server.config_.quiet) {
+        printEpc(context.out, entry.epc) << ", Frequency: " << entry.count << std::endl;
+    }
+}
+
+inline void ReaderServer::onHeartbeat(FrameContext& context, const HeartbeatFrame&) {
+    context.out << "\033[1;33mHeartbeat\033[0m" << std::endl;
+    context.connection.counters.heartbeats++;
+}
+
+inline void ReaderServer::onInventoryEnd(FrameContext& context, const InventoryEndFrame& frame) {
+    context.out << "\033[1;34mInventory round ended (" << frame.tags << " tags)\033[0m" << std::endl;
+    context.connection.counters.inventoryEnds++;
+}
+
+inline void ReaderServer::onAntennaStatus(FrameContext& context, const AntennaStatusFrame& frame) {
+    std::cout << "Antenna " << static_cast<int>(frame.antenna) << (frame.connected ? " connected" : " disconnected")
+              << " (" << context.connection.address << ")" << std::endl;
+    context.connection.counters.antennaStatus++;
+}
+
+inline void ReaderServer::onReaderError(FrameContext& context, const ReaderErrorFrame& frame) {
+    char code[2];
+    formatHex(code, &frame.code, 1, 0);
+    std::cout << "\033[31mReader error 0x";
+    std::cout.write(code, sizeof(code)) << " (" << context.connection.address << ")\033[0m" << std::endl;
+    context.connection.counters.readerErrors++;
+}
+
+inline void ReaderServer::onUnknownFrame(FrameContext& context, const FrameView&) {
+    context.out << "\033[1;31mThe RFID type is not recognized\033[0m" << std::endl;
+    context.connection.counters.unknownTypes++;
+}
+
+inline void ReaderServer::onMalformedFrame(FrameContext& context, const FrameView&) {
+    context.out << "\033[1;31mThe Len of the frame does not fit its type\033[0m" << std::endl;
+    context.connection.counters.malformed++;
+}
@@ -0,0 +1,321 @@
+/**
+ * Sharded RFID reader server: one event loop thread per core on the same port.
+ *
+ * ShardedReaderServer starts N ReaderServer shards. Every shard creates its own listening socket
+ * bound to the same port with SO_REUSEPORT, so the kernel spreads the reader connections over the
+ * shards (by a hash of the connection's addresses and ports). A shard owns everything of its
+ * connections: the sockets, receive rings, parser state, counters, data log files
+ * (client_data_log_shard<N>_<datetime>.csv) and its own EPC_Tag_Counts table. The shards share no
+ * data and take no locks.
+ *
+ * Global EPC counts come from a merge step on the thread that called run():
+ *
+ *      shard thread:   every mergeIntervalMs, the tags read since the previous tick are pushed as
+ *                      TagDelta (EPC, reads, first/last seen) on the shard's lock-free SPSC queue
+ *      merge thread:   pops the deltas of every shard into the global EPC_Tag_Counts and its
+ *                      TagReporter, and prints the global tag report every reportIntervalMs
+ *
+ * The global counts therefore trail the shards by at most mergeIntervalMs (plus the time to drain
+ * a queue that was full). A shard only ever works on its own data and the merge thread only on the
+ * global table, so neither waits for the other.
+ *
+ * With a leave timeout set, tag presence (enter and leave events) is tracked on the merge thread from
+ * the merged deltas. The wheel is advanced to mergeIntervalMs in the past, so a read a shard has not
+ * sent yet can not make its tag leave.
+ *
+ * With a query socket set, the merge thread also feeds the tag query thread (tag_query.h), handing
+ * it the merged reads after every merge tick.
+ *
+ * With a tag file set, the global EPC_Tag_Counts lives in it (tag_table.h) and the merge thread
+ * writes its checkpoints; the shards' own tables stay in memory.
+ *
+ * Each shard thread is pinned to one core (shard i to core i modulo the number of cores).
+ *
+ * With metricsPort set, one metrics endpoint serves the counters of every shard (labelled shard="N").
+ *
+ * Usage:
+ *      ServerConfig config;
+ *      config.shards = 0;                  // One shard per core
+ *      ShardedReaderServer server(config);
+ *      if (!server.start()) return -1;
+ *      server.run();                       // Returns after stop() (async-signal-safe)
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "reader_server.h"
+#include "spsc_queue.h"
+#include "tag_presence.h"
+#include "tag_query.h"
+#include "tag_report.h"
+#include "tag_table.h"
+
+#define TAG_DELTA_QUEUE_SIZE 65536     // Tag deltas that can wait for the merge thread per shard
+
+class ShardedReaderServer {
+public:
+    explicit ShardedReaderServer(const ServerConfig& config) : config_(config) {
+        if (config_.shards <= 0) {
+            config_.shards = std::max(1u, std::thread::hardware_concurrency());
+        }
+    }
+    ~ShardedReaderServer() { shutdown(); }
+
+    ShardedReaderServer(const ShardedReaderServer&) = delete;
+    ShardedReaderServer& operator=(const ShardedReaderServer&) = delete;
+
+    // Start every shard on the same port and set up the merge step
+    bool start() {
+        for (int i = 0; i < config_.shards; i++) {
+            ServerConfig shardConfig = config_;
+            shardConfig.shards = 1;
+            shardConfig.reportIntervalMs = std::max(1, config_.mergeIntervalMs);
+            shardConfig.logger.baseName += "_shard" + std::to_string(i);
+            if (i > 0) {
+                shardConfig.port = shards_[0]->boundPort();    // Same port as shard 0, also when it was 0
+            }
+
+            auto deltas = std::make_unique<SpscQueue<TagDelta>>(TAG_DELTA_QUEUE_SIZE);
+            auto shard = std::make_unique<ReaderServer>(shardConfig);
+            shard->setShard(i, deltas.get());
+            if (!shard->start()) {
+                return false;
+            }
+            deltas_.push_back(std::move(deltas));
+            shards_.push_back(std::move(shard));
+        }
+
+        if ((wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            perror("Eventfd creation failed");
+            return false;
+        }
+        if ((mergeTimerFd_ = createIntervalTimer(config_.mergeIntervalMs)) < 0) {
+            return false;
+        }
+
+        if (!config_.tagFile.empty()) {
+            if (!EPC_Tag_Counts.open(config_.tagFile)) {
+                return false;
+            }
+            tagReporter_.loadTop();
+            std::cout << "Loaded " << EPC_Tag_Counts.size() << " tags from " << config_.tagFile << std::endl;
+        }
+
+        if (!config_.querySocket.empty()) {
+            query_ = std::make_unique<TagQueryServer>();
+            if (!query_->start(config_.querySocket)) {
+                query_.reset();
+                return false;
+            }
+            query_->load(EPC_Tag_Counts, wallClockNs());
+            std::cout << "Tag queries on " << config_.querySocket << std::endl;
+        }
+
+        if (config_.presence.leaveTimeoutMs > 0) {
+            presence_ = std::make_unique<TagPresence>(config_.presence, [](const PresenceEvent& event) {
+                printPresenceEvent(std::cout, event);
+            });
+        }
+
+        if (config_.metricsPort >= 0) {
+            metricsServer_ = std::make_unique<MetricsHttpServer>([this](std::ostream& out) {
+                std::vector<const ReaderServer*> servers;
+                for (const auto& shard : shards_) {
+                    servers.push_back(shard.get());
+                }
+                ReaderServer::writeMetrics(out, servers);
+            });
+            if (!metricsServer_->start(config_.metricsPort)) {
+                metricsServer_.reset();
+                return false;
+            }
+            std::cout << "Metrics on http://127.0.0.1:" << metricsServer_->port() << "/metrics" << std::endl;
+        }
+        return true;
+    }
+
+    // Run every shard on its own thread and merge the tag counts on this one until stop() is called
+    void run() {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < shards_.size(); i++) {
+            ReaderServer* shard = shards_[i].get();
+            threads_.emplace_back([shard]() { shard->run(); });
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpus), &cpus);
+        }
+
+        auto lastReport = std::chrono::steady_clock::now();
+        auto lastCheckpoint = lastReport;
+        struct pollfd fds[2] = {{wakeFd_, POLLIN, 0}, {mergeTimerFd_, POLLIN, 0}};
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Poll failed");
+                break;
+            }
+            uint64_t count;
+            if (fds[0].revents & POLLIN) {
+                ssize_t ignored = read(wakeFd_, &count, sizeof(count));
+                (void)ignored;
+                if (dumpRequested_.exchange(false)) {
+                    mergeDeltas();
+                    printEpcTagFrequencies(std::cout, EPC_Tag_Counts);
+                    if (presence_) {
+                        printPresentTags(std::cout, *presence_, wallClockNs());
+                    }
+                }
+                if (stopRequested_.load()) {
+                    break;
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                ssize_t ignored = read(mergeTimerFd_, &count, sizeof(count));
+                (void)ignored;
+                mergeDeltas();
+                if (query_) {
+                    query_->publish(EPC_Tag_Counts, wallClockNs());
+                }
+                if (presence_) {
+                    presence_->advance(wallClockNs() - static_cast<int64_t>(config_.mergeIntervalMs) * 1000000);
+                    std::cout << std::flush;
+                }
+                auto now = std::chrono::steady_clock::now();
+                if (config_.reportIntervalMs > 0 && now - lastReport >= std::chrono::milliseconds(config_.reportIntervalMs)) {
+                    if (tagReporter_.report(std::cout) && presence_) {
+                        std::cout << "Tags present: " << presence_->size() << std::endl;
+                    }
+                    lastReport = now;
+                }
+                if (EPC_Tag_Counts.isMapped() &&
+                    now - lastCheckpoint >= std::chrono::milliseconds(config_.checkpointIntervalMs)) {
+                    EPC_Tag_Counts.checkpoint(wallClockNs());
+                    lastCheckpoint = now;
+                }
+            }
+        }
+
+        // Stop the shards, then merge what they counted since their last tick
+        for (auto& shard : shards_) {
+            shard->stop();
+        }
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+        for (auto& shard : shards_) {
+            while (!shard->publishTagDeltas()) {
+                mergeDeltas();
+            }
+        }
+        mergeDeltas();
+    }
+
+    // Ask run() to return. Only write()s to an eventfd, so it is async-signal-safe.
+    void stop() {
+        stopRequested_.store(true);
+        wake();
+    }
+
+    // Ask run() to print the full global EPC_Tag_Counts table. Async-signal-safe like stop().
+    void requestTagDump() {
+        dumpRequested_.store(true);
+        wake();
+    }
+
+    // Close every shard's sockets and stop their loggers
+    void shutdown() {
+        metricsServer_.reset();
+        query_.reset();
+        for (auto& shard : shards_) {
+            shard->shutdown();
+        }
+        if (wakeFd_ >= 0) {
+            close(wakeFd_);
+            wakeFd_ = -1;
+        }
+        if (mergeTimerFd_ >= 0) {
+            close(mergeTimerFd_);
+            mergeTimerFd_ = -1;
+        }
+        if (EPC_Tag_Counts.isMapped()) {
+            std::cout << "Saved " << EPC_Tag_Counts.size() << " tags to " << config_.tagFile << std::endl;
+            EPC_Tag_Counts.close();
+        }
+    }
+
+    int boundPort() const { return shards_.empty() ? 0 : shards_[0]->boundPort(); }
+    int metricsPort() const { return metricsServer_ ? metricsServer_->port() : -1; }
+    size_t shardCount() const { return shards_.size(); }
+    const ReaderServer& shard(size_t i) const { return *shards_[i]; }
+
+    // Counters summed over every shard. Only call when run() is not running (the shards own their counters).
+    ConnectionCounters totals() const {
+        ConnectionCounters sum;
+        for (const auto& shard : shards_) {
+            sum.add(shard->totals());
+        }
+        return sum;
+    }
+
+    // Global tag counts (merge thread; complete once run() returned, empty after shutdown() with a tag file)
+    const TagTable& tagCounts() const { return EPC_Tag_Counts; }
+    const TopTags& topTags() const { return tagReporter_.top(); }
+    const TagPresence* presence() const { return presence_.get(); }
+
+private:
+    void wake() {
+        uint64_t one = 1;
+        if (wakeFd_ >= 0) {
+            ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    // Pop the queued deltas of every shard into the global table
+    void mergeDeltas() {
+        for (auto& queue : deltas_) {
+            while (TagDelta* delta = queue->front()) {
+                TagEntry& entry = EPC_Tag_Counts.merge(delta->epc, delta->count, delta->firstSeen, delta->lastSeen);
+                tagReporter_.onRead(entry, delta->count);
+                if (presence_) {
+                    presence_->record(delta->epc, delta->lastSeen, delta->count);
+                }
+                if (query_) {
+                    query_->onRead(entry, delta->count);
+                }
+                queue->pop();
+            }
+        }
+    }
+
+    ServerConfig config_;
+    std::vector<std::unique_ptr<ReaderServer>> shards_;
+    std::vector<std::unique_ptr<SpscQueue<TagDelta>>> deltas_;  // One queue per shard
+    std::vector<std::thread> threads_;
+    std::unique_ptr<MetricsHttpServer> metricsServer_;          // Loopback Prometheus endpoint for every shard
+    int wakeFd_ = -1;
+    int mergeTimerFd_ = -1;
+    std::atomic<bool> stopRequested_{false};
+    std::atomic<bool> dumpRequested_{false};
+    TagTable EPC_Tag_Counts;                                    // Global count of specific EPC tag
+    TagReporter tagReporter_{EPC_Tag_Counts, config_.topTags};  // Changes since the last global report
+    std::unique_ptr<TagPresence> presence_;                     // Global tag presence (merge thread)
+    std::unique_ptr<TagQueryServer> query_;                     // Tag queries, fed by the merge thread
+};
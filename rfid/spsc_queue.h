@@ -0,0 +1,94 @@
+/**
+ * Bounded lock-free single-producer single-consumer queue.
+ *
+ * One thread pushes, one other thread pops. The producer owns tail_ and the consumer owns head_;
+ * they are on separate cache lines so the two threads do not bounce one line between their cores.
+ * Each side also keeps a cached copy of the other side's index and only reloads the shared atomic
+ * when the cached value says the queue is full (producer) or empty (consumer).
+ *
+ * Elements are written and read in place:
+ *      Producer:   if (T* slot = queue.tryReserve()) { fill *slot; queue.publish(); }
+ *      Consumer:   while (T* slot = queue.front()) { use *slot; queue.pop(); }
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define CACHE_LINE_SIZE 64
+
+template <typename T>
+class SpscQueue {
+public:
+    // The capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer: free slot to fill, or nullptr if the queue is full
+    T* tryReserve() {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - headCache_ > mask_) {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail - headCache_ > mask_) {
+                return nullptr;
+            }
+        }
+        return &buffer_[tail & mask_];
+    }
+
+    // Producer: make the slot returned by tryReserve() visible to the consumer
+    void publish() { tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Producer: copy value into the queue. Returns false if the queue is full.
+    bool tryPush(const T& value) {
+        T* slot = tryReserve();
+        if (!slot) {
+            return false;
+        }
+        *slot = value;
+        publish();
+        return true;
+    }
+
+    // Consumer: oldest element, or nullptr if the queue is empty
+    T* front() {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_) {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_) {
+                return nullptr;
+            }
+        }
+        return &buffer_[head & mask_];
+    }
+
+    // Consumer: release the element returned by front()
+    void pop() { head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Number of queued elements (exact only when called from the producer or the consumer)
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    std::vector<T> buffer_;
+    uint64_t mask_ = 0;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head_{0};   // Written by the consumer
+    uint64_t tailCache_ = 0;                                    // Consumer's copy of tail_
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail_{0};   // Written by the producer
+    uint64_t headCache_ = 0;                                    // Producer's copy of head_
+};
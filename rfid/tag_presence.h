@@ -0,0 +1,283 @@
+/**
+ * Sliding-window tag presence: which tags are in front of the antennas now.
+ *
+ * EPC_Tag_Counts only ever grows, so it can not tell a tag that left an hour ago from one that is
+ * being read right now. TagPresence keeps only the tags read within the last leaveTimeoutMs:
+ *
+ *      enter:  the first read of a tag that is not present creates its entry and emits an Enter event
+ *      leave:  a tag that has not been read for leaveTimeoutMs emits a Leave event (with the reads
+ *              and the time it was present) and its entry is freed
+ *
+ * Every present tag also counts its reads over the last windowMs in PRESENCE_WINDOW_SLOTS buckets
+ * of windowMs / 16 (a ring indexed by time). windowReads() sums the buckets that are still inside
+ * the window, so the window slides in steps of one bucket.
+ *
+ * Expiry uses a hierarchical timing wheel (timing_wheel.h). A read does not touch the wheel: it
+ * only moves lastSeen forward. When a tag's timer fires, the tag leaves if lastSeen + leaveTimeoutMs
+ * has passed; otherwise the timer is set again for the new deadline. A read therefore costs one
+ * hash lookup and a bucket increment, and each expiry O(1), however many tags are present.
+ *
+ * Entries live in one array whose freed slots are reused, found through an open-addressing index
+ * with backward-shift deletion (no tombstones). Memory follows the number of tags present at the
+ * same time (its peak), not the number of tags ever seen.
+ *
+ * All times are ns since the epoch, as in TagEntry. Not thread-safe: the event loop (or the merge
+ * thread of the sharded server) owns it.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "tag_report.h"
+#include "tag_table.h"
+#include "timing_wheel.h"
+
+#define PRESENCE_WINDOW_SLOTS 16        // Buckets of the sliding read window
+
+struct PresenceConfig {
+    int64_t windowMs = 10000;       // Reads per tag are counted over this window
+    int64_t leaveTimeoutMs = 0;     // A tag not read for this long has left (0 = presence tracking off)
+    int64_t tickMs = 100;           // Resolution of the leave timers
+};
+
+enum class PresenceEventType { Enter, Leave };
+
+struct PresenceEvent {
+    PresenceEventType type;
+    EpcKey epc;
+    int64_t time;               // First read (Enter) or lastSeen + leave timeout (Leave)
+    int64_t firstSeen;          // First read since the tag entered
+    int64_t lastSeen;           // Latest read
+    uint32_t reads;             // Reads since the tag entered
+};
+
+// One present tag
+struct PresenceEntry {
+    EpcKey epc;
+    uint32_t reads = 0;                         // Reads since the tag entered
+    int64_t firstSeen = 0;
+    int64_t lastSeen = 0;
+    int64_t lastBucket = 0;                     // Window bucket (time / bucket length) of the latest read
+    uint32_t window[PRESENCE_WINDOW_SLOTS] = {}; // Reads per bucket, indexed by bucket % PRESENCE_WINDOW_SLOTS
+};
+
+// Print "Tag entered: EPC tag: ..." or "Tag left: EPC tag: ..., N reads in S s"
+inline void printPresenceEvent(std::ostream& out, const PresenceEvent& event) {
+    if (event.type == PresenceEventType::Enter) {
+        printEpc(out << "Tag entered: ", event.epc) << '\n';
+    } else {
+        printEpc(out << "Tag left: ", event.epc) << ", " << event.reads << " reads in "
+            << (event.lastSeen - event.firstSeen) / 1e9 << " s\n";
+    }
+}
+
+class TagPresence {
+public:
+    using Listener = std::function<void(const PresenceEvent&)>;
+
+    TagPresence(const PresenceConfig& config, Listener listener)
+        : windowNs_(std::max<int64_t>(config.windowMs, PRESENCE_WINDOW_SLOTS) * 1000000),
+          bucketNs_(windowNs_ / PRESENCE_WINDOW_SLOTS),
+          timeoutNs_(std::max<int64_t>(config.leaveTimeoutMs, 1) * 1000000),
+          tickNs_(std::max<int64_t>(config.tickMs, 1) * 1000000),
+          listener_(std::move(listener)),
+          index_(16, EMPTY) {}
+
+    TagPresence(const TagPresence&) = delete;
+    TagPresence& operator=(const TagPresence&) = delete;
+
+    // Count reads of a tag at time now. Emits Enter if the tag was not present.
+    void record(const EpcKey& epc, int64_t now, uint32_t reads = 1) {
+        if (wheel_.size() == 0) {
+            wheel_.setCurrent(tickOf(now));     // Nothing scheduled: start the wheel at this time
+        }
+        int64_t bucket = now / bucketNs_;
+        size_t slot = findSlot(epc);
+        PresenceEntry* entry;
+        if (index_[slot] == EMPTY) {
+            uint32_t id = allocate();
+            index_[slot] = id;
+            size_++;
+            entry = &entries_[id];
+            *entry = PresenceEntry();
+            entry->epc = epc;
+            entry->firstSeen = entry->lastSeen = now;
+            entry->lastBucket = bucket;
+            wheel_.schedule(id, deadlineTick(now));
+            if (listener_) {
+                listener_(PresenceEvent{PresenceEventType::Enter, epc, now, now, now, reads});
+            }
+            if ((size_ + 1) * 4 > index_.size() * 3) {
+                grow();
+            }
+        } else {
+            entry = &entries_[index_[slot]];
+        }
+
+        // Clear the buckets the window slid past since the latest read (at most all of them)
+        if (bucket > entry->lastBucket) {
+            int64_t stale = std::min<int64_t>(bucket - entry->lastBucket, PRESENCE_WINDOW_SLOTS);
+            for (int64_t b = bucket - stale + 1; b <= bucket; b++) {
+                entry->window[b % PRESENCE_WINDOW_SLOTS] = 0;
+            }
+            entry->lastBucket = bucket;
+        }
+        // A read older than the latest one (merged late from a shard) still counts if it is in the window
+        if (entry->lastBucket - bucket < PRESENCE_WINDOW_SLOTS) {
+            entry->window[bucket % PRESENCE_WINDOW_SLOTS] += reads;
+        }
+        entry->reads += reads;
+        entry->lastSeen = std::max(entry->lastSeen, now);
+    }
+
+    /* Emit Leave for every tag not read since now - leaveTimeoutMs and free their entries
+
+    Deadlines are rounded up to a whole tick, so a tag leaves at the first advance() whose tick is at
+    or after lastSeen + leaveTimeoutMs (at most tickMs late, plus the time between advance() calls).
+    */
+    void advance(int64_t now) {
+        uint64_t nowTick = tickOf(now);
+        wheel_.advance(nowTick, [this, nowTick](uint32_t id) {
+            PresenceEntry& entry = entries_[id];
+            uint64_t deadline = deadlineTick(entry.lastSeen);
+            if (deadline > nowTick) {
+                wheel_.schedule(id, deadline);      // Read since the timer was set
+                return;
+            }
+            if (listener_) {
+                listener_(PresenceEvent{PresenceEventType::Leave, entry.epc, entry.lastSeen + timeoutNs_,
+                                        entry.firstSeen, entry.lastSeen, entry.reads});
+            }
+            erase(entry.epc);
+            freeEntries_.push_back(id);
+        });
+    }
+
+    // Reads of a tag in the window ending at now (0 if it is not present)
+    uint32_t windowReads(const EpcKey& epc, int64_t now) const {
+        const PresenceEntry* entry = find(epc);
+        return entry ? windowReads(*entry, now) : 0;
+    }
+
+    uint32_t windowReads(const PresenceEntry& entry, int64_t now) const {
+        int64_t bucket = now / bucketNs_;
+        uint32_t sum = 0;
+        for (int64_t b = std::max(entry.lastBucket - PRESENCE_WINDOW_SLOTS + 1, bucket - PRESENCE_WINDOW_SLOTS + 1);
+             b <= entry.lastBucket; b++) {
+            sum += entry.window[b % PRESENCE_WINDOW_SLOTS];
+        }
+        return sum;
+    }
+
+    // The entry of a present tag, or nullptr
+    const PresenceEntry* find(const EpcKey& epc) const {
+        uint32_t id = index_[findSlot(epc)];
+        return id == EMPTY ? nullptr : &entries_[id];
+    }
+
+    // Call fn(const PresenceEntry&) for every present tag
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (uint32_t id : index_) {
+            if (id != EMPTY) {
+                fn(entries_[id]);
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    int64_t windowMs() const { return windowNs_ / 1000000; }
+    size_t memoryBytes() const {
+        return entries_.capacity() * sizeof(PresenceEntry) + wheel_.memoryBytes() +
+               (index_.capacity() + freeEntries_.capacity()) * sizeof(uint32_t);
+    }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    uint64_t tickOf(int64_t time) const { return static_cast<uint64_t>(time / tickNs_); }
+
+    // First tick that starts at or after lastSeen + leave timeout: the tag leaves when advance() handles it
+    uint64_t deadlineTick(int64_t lastSeen) const {
+        return static_cast<uint64_t>((lastSeen + timeoutNs_ + tickNs_ - 1) / tickNs_);
+    }
+
+    uint32_t allocate() {
+        if (!freeEntries_.empty()) {
+            uint32_t id = freeEntries_.back();
+            freeEntries_.pop_back();
+            return id;
+        }
+        entries_.emplace_back();
+        wheel_.resize(entries_.size());
+        return static_cast<uint32_t>(entries_.size() - 1);
+    }
+
+    // Index slot holding epc, or the empty slot where it should be inserted
+    size_t findSlot(const EpcKey& epc) const {
+        size_t mask = index_.size() - 1;
+        for (size_t i = hashEpc(epc) & mask;; i = (i + 1) & mask) {
+            if (index_[i] == EMPTY || entries_[index_[i]].epc == epc) {
+                return i;
+            }
+        }
+    }
+
+    /* Remove epc from the index
+
+    Backward-shift deletion: the entries after the hole that hash at or before it are moved back
+    into it, so lookups never need tombstones and the index stays as short as the present tags.
+    */
+    void erase(const EpcKey& epc) {
+        size_t mask = index_.size() - 1;
+        size_t hole = findSlot(epc);
+        if (index_[hole] == EMPTY) {
+            return;
+        }
+        for (size_t i = (hole + 1) & mask; index_[i] != EMPTY; i = (i + 1) & mask) {
+            size_t home = hashEpc(entries_[index_[i]].epc) & mask;
+            // Move back unless home lies cyclically in (hole, i]
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                index_[hole] = index_[i];
+                hole = i;
+            }
+        }
+        index_[hole] = EMPTY;
+        size_--;
+    }
+
+    void grow() {
+        std::vector<uint32_t> old(index_.size() * 2, EMPTY);
+        old.swap(index_);
+        for (uint32_t id : old) {
+            if (id != EMPTY) {
+                index_[findSlot(entries_[id].epc)] = id;
+            }
+        }
+    }
+
+    int64_t windowNs_;
+    int64_t bucketNs_;
+    int64_t timeoutNs_;
+    int64_t tickNs_;
+    Listener listener_;
+    std::vector<PresenceEntry> entries_;    // Present tags, and freed entries listed in freeEntries_
+    std::vector<uint32_t> freeEntries_;
+    std::vector<uint32_t> index_;           // Power of two open-addressing index into entries_
+    size_t size_ = 0;
+    TimingWheel wheel_;                     // Leave timer of every present tag (id = entry index)
+};
+
+// Print every present tag with its reads in the window ending at now (on demand, O(present tags))
+inline void printPresentTags(std::ostream& out, const TagPresence& presence, int64_t now) {
+    out << "Tags present: " << presence.size() << " (reads in the last " << presence.windowMs() << " ms)\n";
+    presence.forEach([&](const PresenceEntry& entry) {
+        printEpc(out, entry.epc) << ", Reads: " << presence.windowReads(entry, now) << '\n';
+    });
+    out << std::endl;
+}
@@ -0,0 +1,425 @@
+/**
+ * Query service for the live tag counts on a Unix-domain socket.
+ *
+ * Other programs (inventory software, scripts) ask for tag counts over a local socket instead of
+ * parsing the console output. One request per line:
+ *
+ *      GET <epc>           one tag (24 hex characters)
+ *      TOP <k>             the k most read tags, most read first (k <= TAG_QUERY_MAX_TOP)
+ *      SINCE <ns> [max]    tags read at or after <ns> (ns since the epoch), least recent first, at
+ *                          most max of them (default TAG_QUERY_SINCE_LIMIT)
+ *
+ * Every answer is a header line followed by one line per tag:
+ *
+ *      OK <version> <as of ns> <tags>
+ *      <epc> <count> <first seen ns> <last seen ns>
+ *
+ * or a single "ERR <message>" line. A client may send any number of requests on one connection.
+ *
+ *      echo "TOP 5" | nc -U /tmp/rfid_tags.sock
+ *
+ * The queries never touch EPC_Tag_Counts, which belongs to the event loop. The query thread keeps
+ * its own copy of the counts (the snapshot), fed the way the sharded server feeds its global table:
+ *
+ *      event loop:     remembers the tags read since the last tick (like TagReporter, through
+ *                      TagEntry::publishedCount), and every queryIntervalMs hands their new reads
+ *                      over as TagDelta on a lock-free SPSC queue, followed by an end-of-batch
+ *                      marker, then wakes the query thread (eventfd)
+ *      query thread:   merges whole batches into the snapshot before it answers the next request
+ *
+ * Every answer therefore comes from one consistent version of the snapshot (the number of batches
+ * merged, in the header with the time the batch was handed over), at most queryIntervalMs old. The
+ * only shared data is the queue: a tag read costs the event loop one compare (and one append for the
+ * first read of a tag in a tick), and it never waits for a query, however many there are or however slowly a client reads its answers
+ * (client sockets are non-blocking and answers are buffered per client).
+ *
+ * The snapshot also keeps the top tags (TopTags) and a list of tags ordered by their latest read
+ * (appended per batch, sorted when a SINCE query needs it, outdated entries dropped once the list
+ * is twice the table), so TOP and SINCE do not scan the table.
+ *
+ * Usage (event loop):
+ *      TagQueryServer query;
+ *      query.start("/tmp/rfid_tags.sock");
+ *      query.load(EPC_Tag_Counts);         // Tags already counted (a tag file)
+ *      query.onRead(entry);                // Every tag read, after EPC_Tag_Counts.record()
+ *      query.publish(EPC_Tag_Counts, now); // Every queryIntervalMs
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "spsc_queue.h"
+#include "tag_report.h"
+#include "tag_table.h"
+
+#define TAG_QUERY_QUEUE_SIZE 65536      // Tag deltas that can wait for the query thread
+#define TAG_QUERY_MAX_TOP 1000          // Largest k of TOP
+#define TAG_QUERY_SINCE_LIMIT 1000      // Tags returned by SINCE without a max
+#define TAG_QUERY_MAX_CLIENTS 64        // Connected clients (more are closed right away)
+#define TAG_QUERY_MAX_LINE 256          // Longest request line
+#define TAG_QUERY_MAX_OUTPUT (16 << 20) // Unread answer bytes after which a client is closed
+
+class TagQueryServer {
+public:
+    TagQueryServer() : feed_(TAG_QUERY_QUEUE_SIZE), top_(TAG_QUERY_MAX_TOP) {}
+    ~TagQueryServer() { stop(); }
+
+    TagQueryServer(const TagQueryServer&) = delete;
+    TagQueryServer& operator=(const TagQueryServer&) = delete;
+
+    // Listen on the Unix-domain socket path (an old socket file there is replaced) and start the thread
+    bool start(const std::string& path) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            fprintf(stderr, "Query socket path too long: %s\n", path.c_str());
+            return false;
+        }
+        memcpy(address.sun_path, path.c_str(), path.size());
+        if ((listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+            perror("Query socket creation failed");
+            return false;
+        }
+        unlink(path.c_str());
+        if (bind(listenFd_, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            perror("Query socket binding failed");
+            return false;
+        }
+        path_ = path;
+        if (listen(listenFd_, 16) < 0) {
+            perror("Query socket listen failed");
+            return false;
+        }
+        if ((wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            perror("Eventfd creation failed");
+            return false;
+        }
+        thread_ = std::thread(&TagQueryServer::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (thread_.joinable()) {
+            stopRequested_.store(true);
+            wake();
+            thread_.join();
+        }
+        for (Client& client : clients_) {
+            close(client.fd);
+        }
+        clients_.clear();
+        if (listenFd_ >= 0) {
+            close(listenFd_);
+            listenFd_ = -1;
+            if (!path_.empty()) {
+                unlink(path_.c_str());
+            }
+        }
+        if (wakeFd_ >= 0) {
+            close(wakeFd_);
+            wakeFd_ = -1;
+        }
+    }
+
+    /* Producer: hand every tag of the table to the query thread (at start, before any onRead())
+
+    Every entry must have publishedCount = count, as in a new table or one opened from a tag file.
+    */
+    void load(const TagTable& table, int64_t now) {
+        table.forEach([this](const TagEntry& entry) {
+            push(TagDelta{entry.epc, entry.count, entry.firstSeen, entry.lastSeen});
+        });
+        push(TagDelta{EpcKey(), 0, now, now});
+        wake();
+    }
+
+    // Producer: entry was just updated by TagTable::record() or merge() (added = reads counted by that update)
+    void onRead(const TagEntry& entry, uint32_t added = 1) {
+        if (entry.count - added == entry.publishedCount) {
+            changed_.push_back(entry.epc);  // First change since the last publish()
+        }
+    }
+
+    /* Producer: hand the reads since the last call to the query thread as one batch
+
+    Deltas that do not fit the queue wait in order in backlog_ for the next call, so a batch is
+    never split from its marker and nothing is lost while the query thread is busy.
+    */
+    void publish(TagTable& table, int64_t now) {
+        size_t sent = 0;
+        while (sent < backlog_.size() && feed_.tryPush(backlog_[sent])) {
+            sent++;
+        }
+        backlog_.erase(backlog_.begin(), backlog_.begin() + sent);
+        if (!changed_.empty()) {
+            for (const EpcKey& epc : changed_) {
+                TagEntry* entry = table.find(epc);
+                if (entry) {
+                    push(TagDelta{epc, entry->count - entry->publishedCount, entry->firstSeen, entry->lastSeen});
+                    entry->publishedCount = entry->count;
+                }
+            }
+            changed_.clear();
+            push(TagDelta{EpcKey(), 0, now, now});     // End of the batch
+        } else if (sent == 0) {
+            return;
+        }
+        wake();
+    }
+
+    // Batches merged into the snapshot and requests answered (readable from any thread)
+    uint64_t version() const { return version_.load(std::memory_order_relaxed); }
+    uint64_t queries() const { return queries_.load(std::memory_order_relaxed); }
+
+private:
+    struct Client {
+        int fd;
+        std::string in;             // Received bytes not yet forming a whole line
+        std::string out;            // Answer bytes not yet written
+    };
+
+    void push(const TagDelta& delta) {
+        if (!backlog_.empty() || !feed_.tryPush(delta)) {
+            backlog_.push_back(delta);
+        }
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        if (wakeFd_ >= 0) {
+            ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    void run() {
+        std::vector<struct pollfd> fds;
+        while (!stopRequested_.load()) {
+            fds.clear();
+            fds.push_back({wakeFd_, POLLIN, 0});
+            fds.push_back({listenFd_, POLLIN, 0});
+            for (const Client& client : clients_) {
+                fds.push_back({client.fd, static_cast<short>(client.out.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Query poll failed");
+                return;
+            }
+            if (fds[0].revents & POLLIN) {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd_, &count, sizeof(count));
+                (void)ignored;
+                mergeBatches();
+            }
+            // Clients first (fds[i + 2] is clients_[i]), then accept new ones
+            for (size_t i = clients_.size(); i-- > 0;) {
+                if (fds[i + 2].revents && !serve(clients_[i], fds[i + 2].revents)) {
+                    close(clients_[i].fd);
+                    clients_.erase(clients_.begin() + i);
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                int fd;
+                while ((fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    if (clients_.size() >= TAG_QUERY_MAX_CLIENTS) {
+                        close(fd);
+                    } else {
+                        clients_.push_back(Client{fd, std::string(), std::string()});
+                    }
+                }
+            }
+        }
+    }
+
+    // Read requests, answer them and write what the client takes. Returns false to close the client.
+    bool serve(Client& client, short revents) {
+        if (revents & POLLIN) {
+            char buffer[4096];
+            ssize_t n = read(client.fd, buffer, sizeof(buffer));
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                return false;
+            }
+            if (n > 0) {
+                client.in.append(buffer, n);
+            }
+            size_t start = 0, end;
+            while ((end = client.in.find('\n', start)) != std::string::npos) {
+                mergeBatches();     // Answer from the latest complete batch
+                answer(client.in.substr(start, end - start), client.out);
+                queries_.fetch_add(1, std::memory_order_relaxed);
+                start = end + 1;
+            }
+            client.in.erase(0, start);
+            if (client.in.size() > TAG_QUERY_MAX_LINE || client.out.size() > TAG_QUERY_MAX_OUTPUT) {
+                return false;
+            }
+        } else if (revents & (POLLERR | POLLHUP)) {
+            return false;
+        }
+        if (!client.out.empty()) {
+            ssize_t n = write(client.fd, client.out.data(), client.out.size());
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                return false;
+            }
+            if (n > 0) {
+                client.out.erase(0, n);
+            }
+        }
+        return true;
+    }
+
+    // Move every complete batch from the queue into the snapshot
+    void mergeBatches() {
+        while (TagDelta* delta = feed_.front()) {
+            if (delta->count != 0) {
+                staged_.push_back(*delta);
+                feed_.pop();
+                continue;
+            }
+            for (const TagDelta& staged : staged_) {
+                const TagEntry& entry = snapshot_.merge(staged.epc, staged.count, staged.firstSeen, staged.lastSeen);
+                top_.update(entry.epc, entry.count);
+                byLastSeen_.emplace_back(entry.lastSeen, entry.epc);
+            }
+            staged_.clear();
+            asOfNs_ = delta->lastSeen;
+            feed_.pop();
+            version_.fetch_add(1, std::memory_order_relaxed);
+
+            // Drop the entries of tags read again since (their snapshot lastSeen moved on)
+            if (byLastSeen_.size() > 2 * snapshot_.size() + 1024) {
+                sortByLastSeen();
+                byLastSeen_.erase(std::remove_if(byLastSeen_.begin(), byLastSeen_.end(),
+                    [this](const std::pair<int64_t, EpcKey>& item) { return !current(item); }), byLastSeen_.end());
+                sortedByLastSeen_ = byLastSeen_.size();
+            }
+        }
+    }
+
+    // Sort the entries appended since the last sort and merge them into the sorted part
+    void sortByLastSeen() {
+        auto byTime = [](const std::pair<int64_t, EpcKey>& a, const std::pair<int64_t, EpcKey>& b) {
+            return a.first < b.first;
+        };
+        auto middle = byLastSeen_.begin() + sortedByLastSeen_;
+        std::sort(middle, byLastSeen_.end(), byTime);
+        std::inplace_merge(byLastSeen_.begin(), middle, byLastSeen_.end(), byTime);
+        sortedByLastSeen_ = byLastSeen_.size();
+    }
+
+    // True if item is the latest read of its tag
+    bool current(const std::pair<int64_t, EpcKey>& item) const {
+        const TagEntry* entry = snapshot_.find(item.second);
+        return entry && entry->lastSeen == item.first;
+    }
+
+    void answer(const std::string& request, std::string& out) {
+        const char* line = request.c_str();
+        std::vector<const TagEntry*> tags;
+        if (strncmp(line, "GET ", 4) == 0) {
+            EpcKey epc;
+            if (!parseEpc(line + 4, epc)) {
+                out += "ERR EPC must be 24 hex characters\n";
+                return;
+            }
+            if (const TagEntry* entry = snapshot_.find(epc)) {
+                tags.push_back(entry);
+            }
+        } else if (strncmp(line, "TOP ", 4) == 0) {
+            long k = strtol(line + 4, nullptr, 10);
+            if (k <= 0 || k > TAG_QUERY_MAX_TOP) {
+                out += "ERR k must be 1 to " + std::to_string(TAG_QUERY_MAX_TOP) + "\n";
+                return;
+            }
+            for (const TopTag& top : top_.sorted()) {
+                if (tags.size() == static_cast<size_t>(k)) {
+                    break;
+                }
+                tags.push_back(snapshot_.find(top.epc));
+            }
+        } else if (strncmp(line, "SINCE ", 6) == 0) {
+            char* end;
+            long long since = strtoll(line + 6, &end, 10);
+            long long max = *end && *end != '\r' ? strtoll(end, nullptr, 10) : TAG_QUERY_SINCE_LIMIT;
+            if (end == line + 6 || max <= 0) {
+                out += "ERR SINCE needs a time in ns and a max of at least 1\n";
+                return;
+            }
+            sortByLastSeen();
+            auto first = std::lower_bound(byLastSeen_.begin(), byLastSeen_.end(), since,
+                [](const std::pair<int64_t, EpcKey>& item, long long t) { return item.first < t; });
+            for (auto it = first; it != byLastSeen_.end() && tags.size() < static_cast<size_t>(max); ++it) {
+                if (current(*it)) {
+                    tags.push_back(snapshot_.find(it->second));
+                }
+            }
+        } else {
+            out += "ERR unknown request (GET <epc>, TOP <k> or SINCE <ns> [max])\n";
+            return;
+        }
+
+        out += "OK " + std::to_string(version()) + ' ' + std::to_string(asOfNs_) + ' ' +
+               std::to_string(tags.size()) + '\n';
+        for (const TagEntry* entry : tags) {
+            char epc[2 * EPC_LEN];
+            formatHex(epc, entry->epc.bytes, EPC_LEN, 0);
+            out.append(epc, sizeof(epc));
+            out += ' ' + std::to_string(entry->count) + ' ' + std::to_string(entry->firstSeen) + ' ' +
+                   std::to_string(entry->lastSeen) + '\n';
+        }
+    }
+
+    static bool parseEpc(const char* text, EpcKey& epc) {
+        for (size_t i = 0; i < 2 * EPC_LEN; i++) {
+            char c = text[i];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                      : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            epc.bytes[i / 2] = static_cast<uint8_t>((epc.bytes[i / 2] << 4) | digit);
+        }
+        return text[2 * EPC_LEN] == '\0' || text[2 * EPC_LEN] == '\r';
+    }
+
+    // Producer side (event loop or merge thread)
+    std::vector<EpcKey> changed_;           // Tags read since the last publish()
+    std::vector<TagDelta> backlog_;         // Deltas that did not fit the queue, in order
+    SpscQueue<TagDelta> feed_;              // Batches of deltas, each ended by a count 0 marker
+
+    // Query thread
+    TagTable snapshot_;                     // Counts as of the last merged batch
+    TopTags top_;
+    std::vector<std::pair<int64_t, EpcKey>> byLastSeen_;   // (latest read, tag), sorted up to sortedByLastSeen_
+    size_t sortedByLastSeen_ = 0;
+    std::vector<TagDelta> staged_;          // Deltas of a batch whose marker has not arrived yet
+    int64_t asOfNs_ = 0;                    // Publish time of the last merged batch
+    std::vector<Client> clients_;
+
+    std::atomic<uint64_t> version_{0};
+    std::atomic<uint64_t> queries_{0};
+    std::atomic<bool> stopRequested_{false};
+    std::string path_;
+    int listenFd_ = -1;
+    int wakeFd_ = -1;
+    std::thread thread_;
+};
@@ -0,0 +1,287 @@
+/**
+ * Incremental tag frequency reporting.
+ *
+ * Printing the whole EPC_Tag_Counts table on every tag read costs O(distinct tags) work and console
+ * output per read. TagReporter instead only remembers what changed:
+ *
+ *      - The EPCs of the tags read since the last report (each tag once). A tag is added when its
+ *        count moves away from the count printed in the last report (TagEntry::reportedCount), so no
+ *        extra lookup is needed to find out whether it is already in the list.
+ *      - The K most read tags in a min-heap of K entries (TopTags). A read of a tag whose new count
+ *        does not beat the smallest count in the heap returns after one compare; otherwise the
+ *        entry is found (by a scan for a small K, through an index for a large one) and updated or
+ *        replaces the heap root, and sifts down in O(log K).
+ *
+ * report() is called every reportIntervalMs and prints the new tags, the tags whose count changed
+ * (with the number of reads since the last report) and the current top K. Its cost depends on the
+ * number of tags read in the interval, not on the number of tags seen so far. The full table is
+ * still available on demand from printEpcTagFrequencies() (SIGUSR1 in TCP_Server_Example).
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_parser.h"
+#include "tag_table.h"
+
+// Print "EPC tag: <24 hex characters>"
+inline std::ostream& printEpc(std::ostream& out, const EpcKey& epc) {
+    char epcTag[2 * EPC_LEN];
+    formatHex(epcTag, epc.bytes, EPC_LEN, 0);
+    out << "EPC tag: ";
+    return out.write(epcTag, sizeof(epcTag));
+}
+
+// Print the frequency of every EPC tag in the tag table (the full dump, O(distinct tags))
+inline void printEpcTagFrequencies(std::ostream& out, const TagTable& epcTagCounts) {
+    out << "EPC tag frequencies:\n";
+    epcTagCounts.forEach([&out](const TagEntry& entry) {
+        printEpc(out, entry.epc) << ", Frequency: " << entry.count << '\n';
+    });
+    out << std::endl;
+}
+
+struct TopTag {
+    EpcKey epc;
+    uint32_t count;
+};
+
+struct EpcKeyHash {
+    size_t operator()(const EpcKey& epc) const { return static_cast<size_t>(hashEpc(epc)); }
+};
+
+#define TOP_TAGS_SCAN_LIMIT 64          // Up to this K a tag in the heap is found by a linear scan
+
+/* The K most read tags
+
+A min-heap on count: heap_[0] is the least read of the top K. Counts only grow, so a tag outside the
+heap never has a higher count than heap_[0] and a tag enters the heap exactly when its count passes
+the root's. A tag already in the heap is found by a linear scan, which for the small K of a report
+(10 to 100) is faster than keeping a position index. Above TOP_TAGS_SCAN_LIMIT (the 1000 top tags of
+the query snapshot, tag_query.h) every read of a hot tag would scan the whole heap, so the position
+of every tag in the heap is kept in an index instead.
+*/
+class TopTags {
+public:
+    explicit TopTags(size_t k = 10) : k_(k) {
+        heap_.reserve(k);
+        if (indexed()) {
+            index_.reserve(k);
+        }
+    }
+
+    // A tag's count changed to count
+    void update(const EpcKey& epc, uint32_t count) {
+        if (k_ == 0) {
+            return;
+        }
+        if (heap_.size() == k_ && count <= heap_[0].count) {
+            return;     // Cheap path for almost every read of a large population
+        }
+        size_t i = find(epc);
+        if (i < heap_.size()) {
+            heap_[i].count = count;
+            siftDown(i);
+            return;
+        }
+        if (heap_.size() < k_) {
+            heap_.push_back({epc, count});
+            if (indexed()) {
+                index_[epc] = heap_.size() - 1;
+            }
+            siftUp(heap_.size() - 1);
+        } else {
+            if (indexed()) {
+                index_.erase(heap_[0].epc);
+                index_[epc] = 0;
+            }
+            heap_[0] = {epc, count};
+            siftDown(0);
+        }
+    }
+
+    // Most read first
+    std::vector<TopTag> sorted() const {
+        std::vector<TopTag> tags(heap_);
+        std::sort(tags.begin(), tags.end(), [](const TopTag& a, const TopTag& b) { return a.count > b.count; });
+        return tags;
+    }
+
+    size_t k() const { return k_; }
+    void clear() {
+        heap_.clear();
+        index_.clear();
+    }
+
+private:
+    bool indexed() const { return k_ > TOP_TAGS_SCAN_LIMIT; }
+
+    // Position of epc in the heap, or heap_.size() if it is not in it
+    size_t find(const EpcKey& epc) const {
+        if (indexed()) {
+            auto it = index_.find(epc);
+            return it == index_.end() ? heap_.size() : it->second;
+        }
+        for (size_t i = 0; i < heap_.size(); i++) {
+            if (heap_[i].epc == epc) {
+                return i;
+            }
+        }
+        return heap_.size();
+    }
+
+    void swapEntries(size_t a, size_t b) {
+        std::swap(heap_[a], heap_[b]);
+        if (indexed()) {
+            index_[heap_[a].epc] = a;
+            index_[heap_[b].epc] = b;
+        }
+    }
+
+    void siftUp(size_t i) {
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (heap_[parent].count <= heap_[i].count) {
+                break;
+            }
+            swapEntries(parent, i);
+            i = parent;
+        }
+    }
+
+    void siftDown(size_t i) {
+        while (true) {
+            size_t smallest = i;
+            size_t left = 2 * i + 1, right = left + 1;
+            if (left < heap_.size() && heap_[left].count < heap_[smallest].count) {
+                smallest = left;
+            }
+            if (right < heap_.size() && heap_[right].count < heap_[smallest].count) {
+                smallest = right;
+            }
+            if (smallest == i) {
+                return;
+            }
+            swapEntries(smallest, i);
+            i = smallest;
+        }
+    }
+
+    size_t k_;
+    std::vector<TopTag> heap_;
+    std::unordered_map<EpcKey, size_t, EpcKeyHash> index_;  // Heap position of every tag (only if indexed())
+};
+
+// Reads of one tag since the last report (what a shard sends to the merge step, sharded_server.h)
+struct TagDelta {
+    EpcKey epc;
+    uint32_t count;             // Reads since the last report
+    int64_t firstSeen;
+    int64_t lastSeen;
+};
+
+class TagReporter {
+public:
+    // maxLines limits the new/changed tags printed per report (the rest are only counted)
+    TagReporter(TagTable& table, size_t topK = 10, size_t maxLines = 20)
+        : table_(table), top_(topK), maxLines_(maxLines) {}
+
+    // entry was just updated by TagTable::record() (added = reads counted by that update)
+    void onRead(const TagEntry& entry, uint32_t added = 1) {
+        if (entry.count - added == entry.reportedCount) {
+            changed_.push_back(entry.epc);  // First change since the last report
+        }
+        top_.update(entry.epc, entry.count);
+    }
+
+    // Print the tags read since the last report and the top K. Returns false (printing nothing) if no tag was read.
+    bool report(std::ostream& out) {
+        if (changed_.empty()) {
+            return false;
+        }
+        size_t newTags = 0, printed = 0;
+        std::vector<TagEntry*> entries;
+        entries.reserve(changed_.size());
+        for (const EpcKey& epc : changed_) {
+            TagEntry* entry = table_.find(epc);
+            if (entry) {
+                entries.push_back(entry);
+                newTags += entry->reportedCount == 0;
+            }
+        }
+
+        out << "Tag report: " << newTags << " new, " << entries.size() - newTags << " changed, "
+            << table_.size() << " distinct tags\n";
+        for (const TagEntry* entry : entries) {
+            if (printed++ == maxLines_) {
+                out << "... and " << entries.size() - maxLines_ << " more\n";
+                break;
+            }
+            printEpc(out, entry->epc) << ", Frequency: " << entry->count;
+            if (entry->reportedCount == 0) {
+                out << " (new)\n";
+            } else {
+                out << " (+" << entry->count - entry->reportedCount << ")\n";
+            }
+        }
+        for (TagEntry* entry : entries) {
+            entry->reportedCount = entry->count;
+        }
+        changed_.clear();
+
+        std::vector<TopTag> top = top_.sorted();
+        out << "Top " << top.size() << " tags:\n";
+        for (size_t i = 0; i < top.size(); i++) {
+            out << i + 1 << ". ";
+            printEpc(out, top[i].epc) << ", Frequency: " << top[i].count << '\n';
+        }
+        out << std::flush;
+        return true;
+    }
+
+    /* Hand the reads since the last report to fn(const TagDelta&) instead of printing them
+
+    Used by the shards of the sharded server. fn returns false when it can not take more (its queue
+    is full); the remaining tags stay pending for the next call. Returns true if nothing is left.
+    */
+    template <typename Fn>
+    bool drainChanges(Fn&& fn) {
+        size_t done = 0;
+        for (; done < changed_.size(); done++) {
+            TagEntry* entry = table_.find(changed_[done]);
+            if (!entry) {
+                continue;
+            }
+            if (!fn(TagDelta{entry->epc, entry->count - entry->reportedCount, entry->firstSeen, entry->lastSeen})) {
+                break;
+            }
+            entry->reportedCount = entry->count;
+        }
+        changed_.erase(changed_.begin(), changed_.begin() + done);
+        return changed_.empty();
+    }
+
+    // Rank every tag already in the table (one pass, after it was loaded from a tag file)
+    void loadTop() {
+        table_.forEach([this](const TagEntry& entry) { top_.update(entry.epc, entry.count); });
+    }
+
+    const TopTags& top() const { return top_; }
+    size_t pending() const { return changed_.size(); }
+
+    // Forget everything (after TagTable::clear())
+    void clear() {
+        changed_.clear();
+        top_.clear();
+    }
+
+private:
+    TagTable& table_;
+    TopTags top_;
+    size_t maxLines_;
+    std::vector<EpcKey> changed_;   // Tags read since the last report
+};
@@ -0,0 +1,886 @@
+/**
+ * Fixed-width EPC keys and an open-addressing tag count table.
+ *
+ * EpcKey stores the 12 EPC bytes of a tag read as they arrive on the wire (no hex text). hashEpc()
+ * loads them as one 64-bit and one 32-bit word and mixes them, which is much cheaper than hashing a
+ * 24 character string.
+ *
+ * TagTable keeps one TagEntry (EPC, read count, first-seen and last-seen time) per tag in a single
+ * flat array. Lookups use linear probing from the hashed slot, so a lookup touches one or two cache
+ * lines and there is no per-entry allocation. When the table is 3/4 full it doubles and re-inserts
+ * every entry into the new array.
+ *
+ * The slots can also be kept in a tag file (open()), so the counts survive a restart:
+ *
+ *      | TagFileHeader (one page) | TagEntry slot 0 | TagEntry slot 1 | ... | slot capacity - 1 |
+ *
+ * The slots are exactly the in-memory layout, so opening a file is an mmap() and a header check:
+ * there is nothing to parse and the pages are faulted in as the tags are looked up. The mapping is
+ * private (copy-on-write): a read updates the process's copy of the page, never the file, so the file
+ * only changes at a checkpoint.
+ *
+ * checkpoint() does not write anything itself. It copies the slots changed since the last checkpoint
+ * (one dirty bit per slot) and hands them to the tag file writer thread, which
+ *      1. writes them with the new header fields as one checksummed record to the write-ahead log
+ *         (<tag file>.wal) and fdatasync()s it
+ *      2. copies them into its shared mapping of the tag file and msync()s it
+ * while the reads go on. A checkpoint that comes due while the last one is still being written is
+ * skipped; its slots stay marked and go with the next one.
+ *
+ * Growing the table is the same in-memory rehash as without a file. The next checkpoint rebuilds the
+ * file at the new capacity on the writer thread: the same rehash (rehashSlots() gives the same layout
+ * for the same input) into a new file, which is synced, renamed over the old one, and the directory
+ * fsync()ed.
+ *
+ * Crash consistency (process crash or power loss): a crash in step 2 can leave the file with some of
+ * the checkpoint's pages and not others, but then the log record is complete and open() replays it.
+ * A crash in step 1 leaves a record that fails its checksum; it is ignored, and the file is still the
+ * previous checkpoint. Either way open() restores the last complete checkpoint. The reads counted
+ * after it (up to checkpointIntervalMs of them, more if checkpoints were skipped) are lost.
+ *
+ * All integers are little-endian (the byte order of the Raspberry Pi and x86).
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "frame_parser.h"
+#include "capture_file.h"
+
+// The 12 byte EPC of a tag
+struct EpcKey {
+    uint8_t bytes[EPC_LEN] = {};
+
+    static EpcKey fromBytes(const uint8_t* epc) {
+        EpcKey key;
+        memcpy(key.bytes, epc, EPC_LEN);
+        return key;
+    }
+
+    bool operator==(const EpcKey& other) const { return memcmp(bytes, other.bytes, EPC_LEN) == 0; }
+    bool operator!=(const EpcKey& other) const { return !(*this == other); }
+};
+
+// Hash of an EPC (the 8 + 4 bytes are mixed with the finalizer of MurmurHash3)
+inline uint64_t hashEpc(const EpcKey& key) {
+    uint64_t low;
+    uint32_t high;
+    memcpy(&low, key.bytes, sizeof(low));
+    memcpy(&high, key.bytes + sizeof(low), sizeof(high));
+    uint64_t h = low ^ (static_cast<uint64_t>(high) * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// One tag. A count of 0 marks an empty slot.
+struct TagEntry {
+    EpcKey epc;
+    uint32_t count = 0;         // Number of times the tag was read
+    uint32_t reportedCount = 0; // Count printed in the last tag report (tag_report.h)
+    uint32_t publishedCount = 0; // Count handed to the tag query thread (tag_query.h)
+    int64_t firstSeen = 0;      // Time of the first read (ns since the epoch)
+    int64_t lastSeen = 0;       // Time of the latest read (ns since the epoch)
+};
+
+#define TAG_FILE_MAGIC "RFIDTAG"        // 8 bytes with the terminating 0
+#define TAG_FILE_VERSION 2              // 2: publishedCount took the former padding after reportedCount
+#define TAG_FILE_HEADER_SIZE 4096       // The slots start on the second page
+#define TAG_FILE_EXTENSION ".rfidtags"
+#define TAG_FILE_WAL_EXTENSION ".wal"   // Appended to the tag file name
+#define TAG_WAL_MAGIC 0x4C415754        // "TWAL"
+
+struct TagFileHeader {
+    char magic[8];                  // TAG_FILE_MAGIC
+    uint32_t version;               // TAG_FILE_VERSION
+    uint32_t entrySize;             // sizeof(TagEntry)
+    uint64_t headerSize;            // TAG_FILE_HEADER_SIZE
+    uint64_t capacity;              // Slots (a power of two)
+    uint64_t size;                  // Tags at the last checkpoint
+    uint64_t checkpoints;           // Checkpoints written since the file was created (its generation)
+    int64_t checkpointNs;           // Time of the last checkpoint (ns since the epoch)
+    uint32_t clean;                 // 1 if close() wrote the last checkpoint
+    uint32_t fileId;                // Random, set when the file is created; a log record must match it
+};
+
+// One slot written by a checkpoint. The file never holds report state: the entry is stored with
+// reportedCount = publishedCount = count, so every stored count counts as reported after a restart.
+struct TagFileUpdate {
+    uint64_t slot;
+    TagEntry entry;
+};
+
+// The record in the write-ahead log, followed by its updates
+struct TagWalHeader {
+    uint32_t magic;                 // TAG_WAL_MAGIC
+    uint32_t checksum;              // captureChecksum() of the rest of this header and the updates
+    uint32_t fileId;                // TagFileHeader::fileId
+    uint32_t clean;
+    uint64_t generation;            // TagFileHeader::checkpoints once the record is applied
+    uint64_t capacity;
+    uint64_t updates;               // TagFileUpdate records following
+    uint64_t size;
+    int64_t checkpointNs;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(TagEntry) == 40, "tag file entry layout");
+static_assert(sizeof(TagFileHeader) == 64, "tag file header layout");
+static_assert(sizeof(TagFileUpdate) == 48, "tag file update layout");
+static_assert(sizeof(TagWalHeader) == 64, "tag file log header layout");
+
+inline uint32_t tagWalChecksum(const TagWalHeader& header, const TagFileUpdate* updates) {
+    size_t skip = offsetof(TagWalHeader, fileId);
+    uint32_t hash = captureChecksum(reinterpret_cast<const uint8_t*>(&header) + skip, sizeof(header) - skip);
+    return captureChecksum(reinterpret_cast<const uint8_t*>(updates), header.updates * sizeof(TagFileUpdate), hash);
+}
+
+// Insert every tag of one slot array into an empty one (toCapacity a power of two), in slot order
+inline void rehashSlots(const TagEntry* from, size_t fromCapacity, TagEntry* to, size_t toCapacity) {
+    if (fromCapacity == toCapacity) {
+        memcpy(static_cast<void*>(to), from, toCapacity * sizeof(TagEntry));
+        return;
+    }
+    size_t mask = toCapacity - 1;
+    for (size_t i = 0; i < fromCapacity; i++) {
+        if (from[i].count == 0) {
+            continue;
+        }
+        size_t j = hashEpc(from[i].epc) & mask;
+        while (to[j].count != 0) {
+            j = (j + 1) & mask;
+        }
+        to[j] = from[i];
+    }
+}
+
+// fsync() the directory holding path, so a rename() into it is on disk
+inline bool syncDirectory(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string folder = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) < 0) {
+        perror("Tag file directory sync failed");
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    ::close(fd);
+    return true;
+}
+
+/* The slot array of a TagTable
+
+Heap memory, or the slots of a private mapping of a tag file (reads come from the file until a page
+is written, writes stay in this process). Owns the memory or the mapping; move-only.
+*/
+class TagSlots {
+public:
+    TagSlots() = default;
+    explicit TagSlots(size_t capacity) : memory_(capacity), slots_(memory_.data()), capacity_(capacity) {}
+    ~TagSlots() { reset(); }
+
+    TagSlots(TagSlots&& other) noexcept { *this = std::move(other); }
+    TagSlots& operator=(TagSlots&& other) noexcept {
+        if (this != &other) {
+            reset();
+            memory_.swap(other.memory_);
+            slots_ = other.slots_;
+            capacity_ = other.capacity_;
+            mapped_ = other.mapped_;
+            mappedBytes_ = other.mappedBytes_;
+            other.slots_ = nullptr;
+            other.capacity_ = 0;
+            other.mapped_ = nullptr;
+        }
+        return *this;
+    }
+
+    // Map the slots of the tag file fd (capacity slots) copy-on-write
+    bool mapPrivate(int fd, size_t capacity) {
+        size_t bytes = TAG_FILE_HEADER_SIZE + capacity * sizeof(TagEntry);
+        void* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("Tag file mmap failed");
+            return false;
+        }
+        reset();
+        mapped_ = data;
+        mappedBytes_ = bytes;
+        slots_ = reinterpret_cast<TagEntry*>(static_cast<uint8_t*>(data) + TAG_FILE_HEADER_SIZE);
+        capacity_ = capacity;
+        return true;
+    }
+
+    void reset() {
+        if (mapped_) {
+            munmap(mapped_, mappedBytes_);
+            mapped_ = nullptr;
+        }
+        std::vector<TagEntry>().swap(memory_);
+        slots_ = nullptr;
+        capacity_ = 0;
+    }
+
+    TagEntry* data() const { return slots_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return capacity_ == 0; }
+
+private:
+    std::vector<TagEntry> memory_;
+    TagEntry* slots_ = nullptr;
+    size_t capacity_ = 0;
+    void* mapped_ = nullptr;
+    size_t mappedBytes_ = 0;
+};
+
+// Counters of the tag file writer (read by the owner of the TagTable)
+struct TagFileStats {
+    uint64_t checkpoints = 0;       // Checkpoints written
+    uint64_t skipped = 0;           // checkpoint() calls while the last checkpoint was still being written
+    uint64_t updates = 0;           // Slots written
+    uint64_t rebuilds = 0;          // Files rebuilt at a new capacity
+    uint64_t lastWriteNs = 0;       // Time the writer took for the last checkpoint
+    uint64_t maxWriteNs = 0;
+};
+
+// A checkpoint handed to the writer thread
+struct TagFileJob {
+    std::vector<TagFileUpdate> updates; // Changed slots (of the capacity below)
+    TagSlots rebuildFrom;           // The slots before the table grew, if it grew since the last checkpoint
+    uint64_t capacity = 0;          // Slots of the table
+    uint64_t size = 0;              // Tags of the table
+    int64_t checkpointNs = 0;
+    uint32_t clean = 0;
+};
+
+/* Writes the checkpoints of a tag file on its own thread
+
+The owner (the thread of the TagTable) fills job() and submit()s it only while busy() is false; the
+writer thread owns the file, its shared mapping and the log from then until it is done.
+*/
+class TagFileWriter {
+public:
+    explicit TagFileWriter(const std::string& path) : path_(path), walPath_(path + TAG_FILE_WAL_EXTENSION) {}
+    ~TagFileWriter() {
+        stop();
+        unmap();
+        if (walFd_ >= 0) {
+            ::close(walFd_);
+        }
+    }
+
+    TagFileWriter(const TagFileWriter&) = delete;
+    TagFileWriter& operator=(const TagFileWriter&) = delete;
+
+    /* Use the tag file fd (bytes long, mapped shared at data, header already checked)
+
+    Redoes the checkpoint in the log if it is for this file and did not fully reach it. Returns false
+    if the log can not be opened or the redone checkpoint not written.
+    */
+    bool attach(int fd, void* data, size_t bytes) {
+        fd_ = fd;
+        header_ = static_cast<TagFileHeader*>(data);
+        mappedBytes_ = bytes;
+        if ((walFd_ = ::open(walPath_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+            perror("Tag file log open failed");
+            return false;
+        }
+        return replay();
+    }
+
+    // Create the tag file from the slots of a table (its log starts empty)
+    bool create(const TagEntry* slots, size_t capacity, size_t size) {
+        if ((walFd_ = ::open(walPath_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+            perror("Tag file log open failed");
+            return false;
+        }
+        job_.updates.clear();
+        job_.capacity = capacity;
+        job_.size = size;
+        job_.checkpointNs = 0;
+        job_.clean = 0;
+        return rebuild(slots, capacity, job_);
+    }
+
+    void start() {
+        stopping_ = false;
+        thread_ = std::thread(&TagFileWriter::run, this);
+    }
+
+    // Wait for the job being written, then join the thread
+    void stop() {
+        if (!thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    bool busy() const { return busy_.load(std::memory_order_acquire); }
+    bool failed() const { return failed_.load(std::memory_order_acquire); }
+    TagFileJob& job() { return job_; }
+
+    void submit() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_.store(true, std::memory_order_release);
+        }
+        wake_.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return !busy_.load(std::memory_order_relaxed); });
+    }
+
+    TagFileStats stats() const {
+        TagFileStats stats;
+        stats.checkpoints = checkpoints_.load(std::memory_order_relaxed);
+        stats.updates = updates_.load(std::memory_order_relaxed);
+        stats.rebuilds = rebuilds_.load(std::memory_order_relaxed);
+        stats.lastWriteNs = lastWriteNs_.load(std::memory_order_relaxed);
+        stats.maxWriteNs = maxWriteNs_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return busy_.load(std::memory_order_relaxed) || stopping_; });
+            if (!busy_.load(std::memory_order_relaxed)) {
+                return;
+            }
+            lock.unlock();
+            auto start = std::chrono::steady_clock::now();
+            bool ok = write(job_);
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            lock.lock();
+            lastWriteNs_.store(elapsed, std::memory_order_relaxed);
+            maxWriteNs_.store(std::max(maxWriteNs_.load(std::memory_order_relaxed), elapsed), std::memory_order_relaxed);
+            if (!ok) {
+                failed_.store(true, std::memory_order_release);
+            }
+            busy_.store(false, std::memory_order_release);
+            done_.notify_all();
+        }
+    }
+
+    bool write(TagFileJob& job) {
+        bool ok = job.rebuildFrom.empty() ? apply(job)
+                                          : rebuild(job.rebuildFrom.data(), job.rebuildFrom.capacity(), job);
+        job.rebuildFrom.reset();
+        if (ok && job.clean) {
+            // Closed: the file is complete, a log record would only be replayed for nothing at the next open()
+            ok = ftruncate(walFd_, 0) == 0;
+        }
+        return ok;
+    }
+
+    // Log the job, then copy it into the file
+    bool apply(TagFileJob& job) {
+        TagWalHeader wal;
+        memset(&wal, 0, sizeof(wal));
+        wal.magic = TAG_WAL_MAGIC;
+        wal.fileId = header_->fileId;
+        wal.clean = job.clean;
+        wal.generation = header_->checkpoints + 1;
+        wal.capacity = job.capacity;
+        wal.updates = job.updates.size();
+        wal.size = job.size;
+        wal.checkpointNs = job.checkpointNs;
+        wal.checksum = tagWalChecksum(wal, job.updates.data());
+
+        struct iovec parts[2] = {{&wal, sizeof(wal)},
+                                 {job.updates.data(), job.updates.size() * sizeof(TagFileUpdate)}};
+        ssize_t bytes = static_cast<ssize_t>(parts[0].iov_len + parts[1].iov_len);
+        if (pwritev(walFd_, parts, 2, 0) != bytes || fdatasync(walFd_) < 0) {
+            perror("Tag file log write failed");
+            return false;
+        }
+        return redo(wal, job.updates.data());
+    }
+
+    // Copy a logged checkpoint into the file and sync it
+    bool redo(const TagWalHeader& wal, const TagFileUpdate* updates) {
+        TagEntry* slots = reinterpret_cast<TagEntry*>(reinterpret_cast<uint8_t*>(header_) + TAG_FILE_HEADER_SIZE);
+        for (size_t i = 0; i < wal.updates; i++) {
+            slots[updates[i].slot] = updates[i].entry;
+        }
+        header_->size = wal.size;
+        header_->checkpoints = wal.generation;
+        header_->checkpointNs = wal.checkpointNs;
+        header_->clean = wal.clean;
+        if (msync(header_, mappedBytes_, MS_SYNC) < 0) {
+            perror("Tag file msync failed");
+            return false;
+        }
+        checkpoints_.store(checkpoints_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        updates_.store(updates_.load(std::memory_order_relaxed) + wal.updates, std::memory_order_relaxed);
+        return true;
+    }
+
+    /* Write the file anew with job.capacity slots: the slots in from, rehashed, plus the job's updates
+
+    The new file is written next to the old one, synced, and renamed over it, so a crash at any point
+    leaves either the old or the new file. The log needs no record: a record of the old file has a
+    lower generation (or another fileId for a created file) and is not replayed into the new one.
+    */
+    bool rebuild(const TagEntry* from, size_t fromCapacity, const TagFileJob& job) {
+        std::string tmpPath = path_ + ".tmp";
+        size_t bytes = TAG_FILE_HEADER_SIZE + job.capacity * sizeof(TagEntry);
+        int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            perror("Tag file open failed");
+            return false;
+        }
+        void* data = MAP_FAILED;
+        if (ftruncate(fd, bytes) < 0 ||
+            (data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            perror("Tag file resize failed");
+            ::close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+
+        TagFileHeader* header = static_cast<TagFileHeader*>(data);
+        memcpy(header->magic, TAG_FILE_MAGIC, sizeof(header->magic));
+        header->version = TAG_FILE_VERSION;
+        header->entrySize = sizeof(TagEntry);
+        header->headerSize = TAG_FILE_HEADER_SIZE;
+        header->capacity = job.capacity;
+        header->size = job.size;
+        header->checkpoints = header_ ? header_->checkpoints + 1 : 1;
+        header->checkpointNs = job.checkpointNs;
+        header->clean = job.clean;
+        header->fileId = header_ ? header_->fileId : newFileId();
+
+        // The new file is all zeros, so every slot starts empty
+        TagEntry* slots = reinterpret_cast<TagEntry*>(static_cast<uint8_t*>(data) + TAG_FILE_HEADER_SIZE);
+        rehashSlots(from, fromCapacity, slots, job.capacity);
+        for (size_t i = 0; i < job.capacity; i++) {
+            slots[i].reportedCount = slots[i].publishedCount = slots[i].count;
+        }
+        for (const TagFileUpdate& update : job.updates) {
+            slots[update.slot] = update.entry;
+        }
+
+        if (msync(data, bytes, MS_SYNC) < 0 || rename(tmpPath.c_str(), path_.c_str()) < 0) {
+            perror("Tag file replace failed");
+            munmap(data, bytes);
+            ::close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        unmap();
+        fd_ = fd;
+        header_ = header;
+        mappedBytes_ = bytes;
+        rebuilds_.store(rebuilds_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        checkpoints_.store(checkpoints_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        updates_.store(updates_.load(std::memory_order_relaxed) + job.updates.size(), std::memory_order_relaxed);
+        return syncDirectory(path_);
+    }
+
+    // Redo the record in the log if it belongs to this file and is not older than its last checkpoint
+    bool replay() {
+        TagWalHeader wal;
+        if (pread(walFd_, &wal, sizeof(wal), 0) != static_cast<ssize_t>(sizeof(wal)) || wal.magic != TAG_WAL_MAGIC ||
+            wal.fileId != header_->fileId || wal.capacity != header_->capacity ||
+            wal.generation < header_->checkpoints || wal.generation > header_->checkpoints + 1 ||
+            wal.updates > wal.capacity || wal.size > wal.capacity) {
+            return true;
+        }
+        std::vector<TagFileUpdate> updates(wal.updates);
+        ssize_t bytes = static_cast<ssize_t>(updates.size() * sizeof(TagFileUpdate));
+        if (pread(walFd_, updates.data(), bytes, sizeof(wal)) != bytes || tagWalChecksum(wal, updates.data()) != wal.checksum) {
+            fprintf(stderr, "%s: torn checkpoint record ignored\n", walPath_.c_str());
+            return true;
+        }
+        for (const TagFileUpdate& update : updates) {
+            if (update.slot >= wal.capacity) {
+                return true;
+            }
+        }
+        return redo(wal, updates.data());
+    }
+
+    static uint32_t newFileId() {
+        uint64_t id = std::chrono::system_clock::now().time_since_epoch().count() ^
+                      (static_cast<uint64_t>(getpid()) << 32);
+        id = (id ^ (id >> 33)) * 0xFF51AFD7ED558CCDULL;
+        return static_cast<uint32_t>(id ^ (id >> 33));
+    }
+
+    void unmap() {
+        if (header_) {
+            munmap(header_, mappedBytes_);
+            ::close(fd_);
+            header_ = nullptr;
+            fd_ = -1;
+        }
+    }
+
+    std::string path_;
+    std::string walPath_;
+    int fd_ = -1;
+    int walFd_ = -1;
+    TagFileHeader* header_ = nullptr;   // Shared mapping of the tag file
+    size_t mappedBytes_ = 0;
+
+    TagFileJob job_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;      // A job was submitted or stop() was called
+    std::condition_variable done_;      // The job was written
+    std::atomic<bool> busy_{false};
+    std::atomic<bool> failed_{false};
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> checkpoints_{0};
+    std::atomic<uint64_t> updates_{0};
+    std::atomic<uint64_t> rebuilds_{0};
+    std::atomic<uint64_t> lastWriteNs_{0};
+    std::atomic<uint64_t> maxWriteNs_{0};
+};
+
+class TagTable {
+public:
+    explicit TagTable(size_t initialCapacity = 1024) {
+        size_t capacity = 16;
+        while (capacity < initialCapacity) {
+            capacity <<= 1;
+        }
+        useSlots(TagSlots(capacity));
+    }
+    ~TagTable() { close(); }
+
+    TagTable(const TagTable&) = delete;
+    TagTable& operator=(const TagTable&) = delete;
+
+    // Count one read of a tag at time now (ns since the epoch). Returns the updated entry.
+    TagEntry& record(const EpcKey& epc, int64_t now) {
+        if ((size_ + 1) * 4 > capacity_ * 3) {
+            grow();
+        }
+        TagEntry& entry = slotFor(epc);
+        if (entry.count == 0) {
+            entry.epc = epc;
+            entry.firstSeen = now;
+            size_++;
+        }
+        entry.count++;
+        entry.lastSeen = now;
+        markDirty(entry);
+        return entry;
+    }
+
+    // Add count reads of a tag counted somewhere else (another shard's table). Returns the updated entry.
+    TagEntry& merge(const EpcKey& epc, uint32_t count, int64_t firstSeen, int64_t lastSeen) {
+        if ((size_ + 1) * 4 > capacity_ * 3) {
+            grow();
+        }
+        TagEntry& entry = slotFor(epc);
+        if (entry.count == 0) {
+            entry.epc = epc;
+            entry.firstSeen = firstSeen;
+            size_++;
+        }
+        entry.count += count;
+        entry.firstSeen = std::min(entry.firstSeen, firstSeen);
+        entry.lastSeen = std::max(entry.lastSeen, lastSeen);
+        markDirty(entry);
+        return entry;
+    }
+
+    // The entry of a tag, or nullptr if it was never read
+    TagEntry* find(const EpcKey& epc) {
+        return const_cast<TagEntry*>(static_cast<const TagTable*>(this)->find(epc));
+    }
+
+    const TagEntry* find(const EpcKey& epc) const {
+        size_t mask = capacity_ - 1;
+        for (size_t i = hashEpc(epc) & mask;; i = (i + 1) & mask) {
+            const TagEntry& entry = slots_[i];
+            if (entry.count == 0) {
+                return nullptr;
+            }
+            if (entry.epc == epc) {
+                return &entry;
+            }
+        }
+    }
+
+    // Call fn(const TagEntry&) for every tag
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t i = 0; i < capacity_; i++) {
+            if (slots_[i].count != 0) {
+                fn(slots_[i]);
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    size_t memoryBytes() const { return capacity_ * sizeof(TagEntry); }
+
+    void clear() {
+        std::fill(slots_, slots_ + capacity_, TagEntry());
+        size_ = 0;
+        for (size_t w = 0; w < dirty_.size(); w++) {
+            size_t bits = std::min<size_t>(64, capacity_ - w * 64);
+            dirty_[w] = bits == 64 ? ~0ULL : (1ULL << bits) - 1;
+        }
+    }
+
+    /* Keep the table in a tag file from now on
+
+    An existing file is checked, brought to its last complete checkpoint (the log is replayed if the
+    checkpoint was torn) and mapped; a missing one is created. Tags already counted in memory are added
+    to it. Returns false, leaving the table in memory, if the file can not be created or is not a
+    version TAG_FILE_VERSION tag file.
+    */
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            perror("Tag file open failed");
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            perror("Tag file stat failed");
+            ::close(fd);
+            return false;
+        }
+
+        std::unique_ptr<TagFileWriter> writer(new TagFileWriter(path));
+        if (st.st_size == 0) {
+            ::close(fd);
+            if (!writer->create(slots_, capacity_, size_)) {     // Takes the tags counted so far along
+                return false;
+            }
+        } else {
+            void* data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (data == MAP_FAILED) {
+                perror("Tag file mmap failed");
+                ::close(fd);
+                return false;
+            }
+            const TagFileHeader* header = static_cast<const TagFileHeader*>(data);
+            if (static_cast<size_t>(st.st_size) < TAG_FILE_HEADER_SIZE ||
+                memcmp(header->magic, TAG_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+                header->version != TAG_FILE_VERSION || header->entrySize != sizeof(TagEntry) ||
+                header->headerSize != TAG_FILE_HEADER_SIZE || header->capacity < 16 ||
+                (header->capacity & (header->capacity - 1)) != 0 || header->size > header->capacity ||
+                static_cast<uint64_t>(st.st_size) != TAG_FILE_HEADER_SIZE + header->capacity * sizeof(TagEntry)) {
+                fprintf(stderr, "%s: not a version %d tag file\n", path.c_str(), TAG_FILE_VERSION);
+                munmap(data, st.st_size);
+                ::close(fd);
+                return false;
+            }
+            TagSlots mapped;
+            if (!writer->attach(fd, data, st.st_size) || !mapped.mapPrivate(fd, header->capacity)) {
+                fprintf(stderr, "%s can not be opened for writing\n", path.c_str());
+                return false;
+            }
+            TagSlots counted = std::move(storage_);     // Tags counted before the file was opened
+            size_t countedCapacity = capacity_;
+            useSlots(std::move(mapped));
+            size_ = header->size;
+            dirty_.assign((capacity_ + 63) / 64, 0);
+            writer_ = std::move(writer);
+            for (size_t i = 0; i < countedCapacity; i++) {
+                const TagEntry& entry = counted.data()[i];
+                if (entry.count != 0) {
+                    merge(entry.epc, entry.count, entry.firstSeen, entry.lastSeen);
+                }
+            }
+        }
+        if (writer) {
+            writer_ = std::move(writer);
+            dirty_.assign((capacity_ + 63) / 64, 0);
+        }
+        path_ = path;
+        writer_->start();
+        return true;
+    }
+
+    /* Hand the slots changed since the last checkpoint to the writer thread
+
+    Takes a copy of the changed slots (a scan of one bit per slot) and returns: the writer thread logs
+    and writes them. Skipped if the last checkpoint is still being written. Returns false if the
+    writer failed; then the table stays in memory from now on.
+    */
+    bool checkpoint(int64_t nowNs) {
+        if (!writer_) {
+            return true;
+        }
+        if (writer_->busy()) {
+            skippedCheckpoints_++;
+            return true;
+        }
+        if (writer_->failed()) {
+            fprintf(stderr, "Tag file %s can not be written, counting in memory from now on\n", path_.c_str());
+            detach();
+            return false;
+        }
+        if (collect(nowNs, 0)) {
+            writer_->submit();
+        }
+        return true;
+    }
+
+    // Wait until the last checkpoint is written. Returns false if it could not be written.
+    bool waitForCheckpoint() {
+        if (!writer_) {
+            return true;
+        }
+        writer_->wait();
+        return !writer_->failed();
+    }
+
+    /* Write a final checkpoint (stamped with the time of the close), mark the file clean and go back
+    to an empty in-memory table
+
+    The stored counts all count as reported (see TagFileUpdate): a restarted server starts a new
+    series of reports.
+    */
+    void close() {
+        if (!writer_) {
+            return;
+        }
+        writer_->wait();
+        if (!writer_->failed()) {
+            int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            collect(nowNs, 1);
+            writer_->submit();
+            writer_->wait();
+        }
+        detach();
+        useSlots(TagSlots(16));
+        size_ = 0;
+    }
+
+    // True if the table lives in a tag file
+    bool isMapped() const { return writer_ != nullptr; }
+
+    TagFileStats fileStats() const {
+        TagFileStats stats = writer_ ? writer_->stats() : TagFileStats();
+        stats.skipped = skippedCheckpoints_;
+        return stats;
+    }
+
+private:
+    // Slot holding epc, or the empty slot where it should be inserted
+    TagEntry& slotFor(const EpcKey& epc) {
+        size_t mask = capacity_ - 1;
+        for (size_t i = hashEpc(epc) & mask;; i = (i + 1) & mask) {
+            TagEntry& entry = slots_[i];
+            if (entry.count == 0 || entry.epc == epc) {
+                return entry;
+            }
+        }
+    }
+
+    void markDirty(const TagEntry& entry) {
+        if (!dirty_.empty()) {
+            size_t i = &entry - slots_;
+            dirty_[i >> 6] |= 1ULL << (i & 63);
+        }
+    }
+
+    /* Double the slots
+
+    With a tag file, the old slots are kept for the next checkpoint: the writer rebuilds the file from
+    them with the same rehash, so only the slots changed after the grow need to be sent along.
+    */
+    void grow() {
+        TagSlots grown(capacity_ * 2);
+        rehashSlots(slots_, capacity_, grown.data(), grown.capacity());
+        if (writer_) {
+            pendingRebuild_ = std::move(storage_);
+            dirty_.assign((grown.capacity() + 63) / 64, 0);
+        }
+        useSlots(std::move(grown));
+    }
+
+    // Fill the writer's job with the changed slots. Returns false if there is nothing to write.
+    bool collect(int64_t nowNs, uint32_t clean) {
+        TagFileJob& job = writer_->job();
+        job.updates.clear();
+        for (size_t w = 0; w < dirty_.size(); w++) {
+            uint64_t bits = dirty_[w];
+            if (bits == 0) {
+                continue;
+            }
+            dirty_[w] = 0;
+            do {
+                size_t i = w * 64 + __builtin_ctzll(bits);
+                TagFileUpdate update{i, slots_[i]};
+                update.entry.reportedCount = update.entry.publishedCount = update.entry.count;
+                job.updates.push_back(update);
+                bits &= bits - 1;
+            } while (bits != 0);
+        }
+        job.rebuildFrom = std::move(pendingRebuild_);
+        job.capacity = capacity_;
+        job.size = size_;
+        job.checkpointNs = nowNs;
+        job.clean = clean;
+        return !job.updates.empty() || !job.rebuildFrom.empty() || clean;
+    }
+
+    // Stop the writer and keep counting in the slots as they are
+    void detach() {
+        writer_.reset();
+        pendingRebuild_.reset();
+        std::vector<uint64_t>().swap(dirty_);
+        path_.clear();
+    }
+
+    void useSlots(TagSlots slots) {
+        storage_ = std::move(slots);
+        slots_ = storage_.data();
+        capacity_ = storage_.capacity();
+    }
+
+    TagEntry* slots_ = nullptr;     // Power of two number of slots (storage_)
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    TagSlots storage_;              // Heap memory, or the private mapping of the tag file
+    std::string path_;              // Tag file
+    std::unique_ptr<TagFileWriter> writer_;
+    std::vector<uint64_t> dirty_;   // A bit per slot changed since the last checkpoint (with a tag file)
+    TagSlots pendingRebuild_;       // The slots before the last grow since the last checkpoint
+    uint64_t skippedCheckpoints_ = 0;
+};
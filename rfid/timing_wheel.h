@@ -0,0 +1,177 @@
+/**
+ * Hierarchical timing wheel.
+ *
+ * TimingWheel schedules timers identified by small integer ids (indexes into the owner's own array)
+ * at an absolute tick. It has TIMING_WHEEL_LEVELS levels of 64 slots:
+ *
+ *      level 0:    one slot per tick                   (the next 64 ticks)
+ *      level 1:    one slot per 64 ticks               (the next 4096 ticks)
+ *      level 2:    one slot per 4096 ticks             (the next 262144 ticks)
+ *      level 3:    one slot per 262144 ticks           (the next 16.7M ticks, 46 hours at 10 ms)
+ *
+ * A timer goes in the level whose range covers its distance from the current tick. Every slot is an
+ * intrusive doubly linked list threaded through the timer nodes, so schedule() and cancel() are
+ * O(1) and nothing is allocated. advance() walks the ticks: every 64 ticks the next slot of level 1
+ * is cascaded (its timers are re-inserted, most now landing in level 0), every 4096 ticks a slot of
+ * level 2, and so on. Each timer is moved at most once per level, so the cost per timer stays O(1)
+ * however many timers are scheduled.
+ *
+ * This is the layout of the classic Linux kernel timer wheel (kernel/timer.c before 4.8).
+ *
+ * Usage:
+ *      TimingWheel wheel;
+ *      wheel.resize(timers);
+ *      wheel.schedule(id, nowTick + 300);
+ *      wheel.advance(nowTick, [](uint32_t id) { ... });    // Expired timers, unlinked before the call
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define TIMING_WHEEL_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_BITS)     // Slots per level
+#define TIMING_WHEEL_LEVELS 4
+#define TIMING_WHEEL_RANGE (1ULL << (TIMING_WHEEL_BITS * TIMING_WHEEL_LEVELS))   // Farthest tick a timer can be set to
+
+class TimingWheel {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    TimingWheel() {
+        for (uint32_t& head : heads_) {
+            head = NONE;
+        }
+    }
+
+    // Make room for timer ids [0, timers)
+    void resize(size_t timers) { nodes_.resize(timers); }
+
+    // Tick that advance() will handle next. Set once before the first schedule().
+    void setCurrent(uint64_t tick) { current_ = tick; }
+    uint64_t current() const { return current_; }
+
+    /* Schedule timer id to expire at tick expires
+
+    A timer already scheduled is moved. An expiry in the past fires at the next tick advance()
+    handles; one farther away than TIMING_WHEEL_RANGE fires at the end of the range, so the owner has
+    to check whether it is really due.
+    */
+    void schedule(uint32_t id, uint64_t expires) {
+        cancel(id);
+        if (expires < current_) {
+            expires = current_;
+        } else if (expires - current_ >= TIMING_WHEEL_RANGE) {
+            expires = current_ + TIMING_WHEEL_RANGE - 1;
+        }
+        nodes_[id].expires = expires;
+        insert(id);
+    }
+
+    void cancel(uint32_t id) {
+        Node& node = nodes_[id];
+        if (node.slot < 0) {
+            return;
+        }
+        if (node.prev != NONE) {
+            nodes_[node.prev].next = node.next;
+        } else {
+            heads_[node.slot] = node.next;
+        }
+        if (node.next != NONE) {
+            nodes_[node.next].prev = node.prev;
+        }
+        node.slot = -1;
+        size_--;
+    }
+
+    bool scheduled(uint32_t id) const { return nodes_[id].slot >= 0; }
+    uint64_t expires(uint32_t id) const { return nodes_[id].expires; }
+    size_t size() const { return size_; }
+    size_t memoryBytes() const { return nodes_.capacity() * sizeof(Node); }
+
+    /* Handle every tick up to and including now and call expired(uint32_t id) for every timer due
+
+    A timer is unlinked before its callback runs, so the callback may schedule it again (or cancel or
+    schedule other timers). current() has already moved past the tick being handled, so a timer set
+    again for that tick fires on the next one.
+    */
+    template <typename Expired>
+    void advance(uint64_t now, Expired&& expired) {
+        if (size_ == 0 && current_ <= now) {
+            current_ = now + 1;     // Nothing can expire: skip the ticks instead of walking them
+            return;
+        }
+        while (current_ <= now) {
+            size_t index = current_ & (TIMING_WHEEL_SLOTS - 1);
+            for (int level = 1; index == 0 && level < TIMING_WHEEL_LEVELS; level++) {
+                index = (current_ >> (TIMING_WHEEL_BITS * level)) & (TIMING_WHEEL_SLOTS - 1);
+                cascade(level, index);
+            }
+            uint32_t id = detach(current_ & (TIMING_WHEEL_SLOTS - 1));
+            current_++;
+            while (id != NONE) {
+                uint32_t next = nodes_[id].next;
+                expired(id);
+                id = next;
+            }
+        }
+    }
+
+private:
+    struct Node {
+        uint32_t next = NONE;
+        uint32_t prev = NONE;
+        int32_t slot = -1;          // Index in heads_, -1 when not scheduled
+        uint64_t expires = 0;
+    };
+
+    // Link a node into the slot for its expiry (expires - current_ is in [0, TIMING_WHEEL_RANGE))
+    void insert(uint32_t id) {
+        Node& node = nodes_[id];
+        uint64_t delta = node.expires - current_;
+        int level = 0;
+        while (level + 1 < TIMING_WHEEL_LEVELS && delta >= (1ULL << (TIMING_WHEEL_BITS * (level + 1)))) {
+            level++;
+        }
+        node.slot = level * TIMING_WHEEL_SLOTS +
+                    static_cast<int32_t>((node.expires >> (TIMING_WHEEL_BITS * level)) & (TIMING_WHEEL_SLOTS - 1));
+        node.prev = NONE;
+        node.next = heads_[node.slot];
+        if (node.next != NONE) {
+            nodes_[node.next].prev = id;
+        }
+        heads_[node.slot] = id;
+        size_++;
+    }
+
+    // Unlink every node of a slot. Returns the first one (the rest follow through next).
+    uint32_t detach(size_t slot) {
+        uint32_t first = heads_[slot];
+        heads_[slot] = NONE;
+        for (uint32_t id = first; id != NONE; id = nodes_[id].next) {
+            nodes_[id].slot = -1;
+            size_--;
+        }
+        return first;
+    }
+
+    // Re-insert the timers of one slot of a higher level into the levels below
+    void cascade(int level, size_t index) {
+        uint32_t id = detach(level * TIMING_WHEEL_SLOTS + index);
+        while (id != NONE) {
+            uint32_t next = nodes_[id].next;
+            if (nodes_[id].expires < current_) {
+                nodes_[id].expires = current_;
+            }
+            insert(id);
+            id = next;
+        }
+    }
+
+    std::vector<Node> nodes_;
+    uint32_t heads_[TIMING_WHEEL_LEVELS * TIMING_WHEEL_SLOTS];
+    uint64_t current_ = 0;
+    size_t size_ = 0;
+};
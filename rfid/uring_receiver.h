@@ -0,0 +1,349 @@
+/**
+ * io_uring receive backend for the reader connections.
+ *
+ * With epoll every chunk of reader data costs the event loop an epoll_wait() and a read() per
+ * ready socket. Here the kernel receives for every connection on its own:
+ *
+ *      multishot recv:     one IORING_OP_RECV with IORING_RECV_MULTISHOT is queued per connection
+ *                          and stays armed, posting a completion (CQE) for every chunk that arrives
+ *                          until the connection closes
+ *      provided buffers:   the recv does not name a buffer (IOSQE_BUFFER_SELECT). The kernel takes
+ *                          one from a ring of buffers registered once (IORING_REGISTER_PBUF_RING)
+ *                          and puts its id in the CQE. The event loop hands the bytes to the
+ *                          connection's reassembler and gives the buffer back by writing its entry
+ *                          to the ring, which is shared memory: no syscall.
+ *
+ * The event loop waits in io_uring_enter() instead of epoll_wait(). The same call submits the
+ * requests queued since the last one (the recv of a new connection, the cancel of a closed one) and
+ * returns once there is a completion, and the completions are then read from the mapped completion
+ * queue without another syscall. The server's epoll instance (listening socket, timers, wake-up)
+ * is watched by a multishot poll on the ring, so epoll_wait() is only called when one of those is
+ * ready.
+ *
+ * The ring is set up with IORING_SETUP_DEFER_TASKRUN: the kernel's part of the receives runs when
+ * the event loop waits, in one batch, instead of interrupting the thread for every chunk (which
+ * would make a wait in epoll_wait() return with EINTR and cost a second syscall per wake-up). That
+ * needs IORING_SETUP_SINGLE_ISSUER, so the ring starts disabled and enable() is called by the
+ * thread that runs the loop.
+ *
+ * A recv ends without IORING_CQE_F_MORE when it fails, when the peer closed (res 0) or when the
+ * buffer ring ran empty (-ENOBUFS, the loop fell behind by URING_BUFFERS chunks); the caller queues it
+ * again in the last case.
+ *
+ * Only raw syscalls and <linux/io_uring.h> are used (no liburing). start() returns false when the
+ * kernel has no io_uring or it is disabled (kernel.io_uring_disabled), or the kernel is older than
+ * 6.1 (IORING_SETUP_DEFER_TASKRUN; multishot recv came in 6.0), and the server keeps receiving with
+ * epoll and read().
+ *
+ * Usage:
+ *      UringReceiver ring;
+ *      if (!ring.start()) ...;                 // Fall back to read()
+ *      ring.enable();                          // On the event loop thread
+ *      ring.poll(epollFd, userData);
+ *      ring.receive(fd, userData);             // For every new connection
+ *      ring.wait();                            // Submit and wait for completions
+ *      ring.reap([](uint64_t userData, const uint8_t* data, int32_t res, bool more) { ... });
+ *
+ * Additional documentation: https://man7.org/linux/man-pages/man7/io_uring.7.html
+*/
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256               // Submission queue size (requests queued per io_uring_enter())
+#define URING_BUFFERS 512               // Provided receive buffers (power of two)
+#define URING_BUFFER_SIZE 4096          // Bytes per provided buffer
+#define URING_BUFFER_GROUP 0            // Buffer group id of the provided buffer ring
+#define URING_CANCEL_DATA UINT64_MAX    // user_data of cancel requests (their completions are skipped)
+
+class UringReceiver {
+public:
+    UringReceiver() = default;
+    ~UringReceiver() { stop(); }
+
+    UringReceiver(const UringReceiver&) = delete;
+    UringReceiver& operator=(const UringReceiver&) = delete;
+
+    /* Set up the ring and register the provided buffers
+
+    The completion queue gets two entries per buffer: every data completion holds a buffer, so it
+    can not overflow while the buffers last.
+    */
+    bool start(unsigned buffers = URING_BUFFERS, unsigned bufferSize = URING_BUFFER_SIZE) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+                       IORING_SETUP_R_DISABLED;
+        params.cq_entries = 2 * buffers;
+        ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, URING_ENTRIES, &params));
+        if (ringFd_ < 0) {
+            perror("io_uring setup failed");    // EINVAL: no DEFER_TASKRUN, the kernel is older than 6.1
+            return false;
+        }
+
+        // The submission and completion queues are shared with the kernel through mmap()
+        sqRingBytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sqRingBytes_ = cqRingBytes_ = std::max(sqRingBytes_, cqRingBytes_);
+        }
+        sqRing_ = mapRing(sqRingBytes_, IORING_OFF_SQ_RING);
+        cqRing_ = params.features & IORING_FEAT_SINGLE_MMAP ? sqRing_ : mapRing(cqRingBytes_, IORING_OFF_CQ_RING);
+        sqesBytes_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqes = mapRing(sqesBytes_, IORING_OFF_SQES);
+        if (!sqRing_ || !cqRing_ || !sqes) {
+            stop();
+            return false;
+        }
+        sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+        sqHead_ = reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.tail);
+        sqArray_ = reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.array);
+        sqMask_ = *reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.ring_mask);
+        sqEntries_ = params.sq_entries;
+        cqHead_ = reinterpret_cast<unsigned*>(cqRing_ + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(cqRing_ + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(cqRing_ + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe*>(cqRing_ + params.cq_off.cqes);
+
+        /* Provided buffer ring
+
+        The ring of buffer entries (address, length, id) and the buffers themselves are plain memory
+        of this process. The kernel consumes entries from the head, the event loop adds the buffers it
+        is done with at the tail.
+        */
+        bufferCount_ = buffers;
+        bufferSize_ = bufferSize;
+        bufRingBytes_ = buffers * sizeof(struct io_uring_buf);
+        buffersBytes_ = static_cast<size_t>(buffers) * bufferSize;
+        void* bufRing = mmap(nullptr, bufRingBytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        void* memory = mmap(nullptr, buffersBytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        bufRing_ = bufRing == MAP_FAILED ? nullptr : static_cast<struct io_uring_buf_ring*>(bufRing);
+        bufEntries_ = static_cast<struct io_uring_buf*>(bufRing);
+        buffers_ = memory == MAP_FAILED ? nullptr : static_cast<uint8_t*>(memory);
+        if (!bufRing_ || !buffers_) {
+            perror("Buffer allocation failed");
+            stop();
+            return false;
+        }
+
+        struct io_uring_buf_reg registration;
+        memset(&registration, 0, sizeof(registration));
+        registration.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+        registration.ring_entries = buffers;
+        registration.bgid = URING_BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+            perror("io_uring buffer ring registration failed");
+            stop();
+            return false;
+        }
+        for (unsigned bid = 0; bid < buffers; bid++) {
+            recycle(static_cast<uint16_t>(bid));
+        }
+        __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Close the ring (the kernel cancels every queued recv) and free the buffers
+    void stop() {
+        if (ringFd_ >= 0) {
+            close(ringFd_);
+            ringFd_ = -1;
+        }
+        if (sqes_) {
+            munmap(sqes_, sqesBytes_);
+            sqes_ = nullptr;
+        }
+        if (cqRing_ && cqRing_ != sqRing_) {
+            munmap(cqRing_, cqRingBytes_);
+        }
+        if (sqRing_) {
+            munmap(sqRing_, sqRingBytes_);
+        }
+        sqRing_ = cqRing_ = nullptr;
+        if (bufRing_) {
+            munmap(bufRing_, bufRingBytes_);
+            bufRing_ = nullptr;
+            bufEntries_ = nullptr;
+        }
+        if (buffers_) {
+            munmap(buffers_, buffersBytes_);
+            buffers_ = nullptr;
+        }
+        pending_ = 0;
+    }
+
+    // Enable the ring. The calling thread becomes the only one that may submit and wait.
+    bool enable() {
+        if (syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0) {
+            perror("io_uring enable failed");
+            return false;
+        }
+        return true;
+    }
+
+    // Queue a multishot poll for input on fd (the server's epoll instance)
+    bool poll(int fd, uint64_t userData) {
+        struct io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = fd;
+        sqe.poll32_events = POLLIN;
+        sqe.len = IORING_POLL_ADD_MULTI;
+        sqe.user_data = userData;
+        return queue(sqe);
+    }
+
+    // Queue a multishot recv of socket fd. Every completion of it carries userData.
+    bool receive(int fd, uint64_t userData) {
+        struct io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_RECV;
+        sqe.fd = fd;
+        sqe.ioprio = IORING_RECV_MULTISHOT;
+        sqe.flags = IOSQE_BUFFER_SELECT;
+        sqe.buf_group = URING_BUFFER_GROUP;
+        sqe.user_data = userData;
+        return queue(sqe);
+    }
+
+    // Queue the cancel of the recv queued with userData (before its socket is closed)
+    bool cancel(uint64_t userData) {
+        struct io_uring_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.fd = -1;
+        sqe.addr = userData;
+        sqe.user_data = URING_CANCEL_DATA;
+        return queue(sqe);
+    }
+
+    // Submit the queued requests and wait until there is at least one completion (one io_uring_enter())
+    bool wait() {
+        return enter(IORING_ENTER_GETEVENTS, 1);
+    }
+
+    // Submit the queued requests without waiting
+    bool submit() {
+        return pending_ == 0 || enter(0, 0);
+    }
+
+    /* Handle every completion in the queue
+
+    handler(userData, data, res, more) is called per completion: res > 0 is the number of bytes at
+    data, 0 means the peer closed, < 0 is -errno. more is false when the recv has ended. The buffer
+    goes back to the kernel once the handler returns, so data must be copied out by then. Completions
+    of cancels are skipped. Returns the number of completions handled.
+    */
+    template <typename Handler>
+    size_t reap(Handler&& handler) {
+        unsigned head = *cqHead_;           // Only this thread moves the head
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        size_t handled = 0;
+        for (; head != tail; head++) {
+            const struct io_uring_cqe& cqe = cqes_[head & cqMask_];
+            bool hasBuffer = cqe.flags & IORING_CQE_F_BUFFER;
+            uint16_t bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.user_data != URING_CANCEL_DATA) {
+                handler(cqe.user_data, hasBuffer ? buffers_ + static_cast<size_t>(bid) * bufferSize_ : nullptr,
+                        cqe.res, (cqe.flags & IORING_CQE_F_MORE) != 0);
+                handled++;
+            }
+            if (hasBuffer) {
+                recycle(bid);
+            }
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+        return handled;
+    }
+
+    // io_uring_enter() calls made so far
+    uint64_t enters() const { return enters_; }
+
+private:
+    bool enter(unsigned flags, unsigned minComplete) {
+        int submitted = static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, pending_, minComplete, flags,
+                                                 nullptr, 0));
+        enters_++;
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                return true;    // A signal, or the completion queue is full: reap and come back
+            }
+            perror("io_uring enter failed");
+            return false;
+        }
+        pending_ -= std::min(pending_, static_cast<unsigned>(submitted));
+        return true;
+    }
+
+    uint8_t* mapRing(size_t bytes, off_t offset) {
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, offset);
+        if (memory == MAP_FAILED) {
+            perror("io_uring mmap failed");
+            return nullptr;
+        }
+        return static_cast<uint8_t*>(memory);
+    }
+
+    // Copy sqe into the next free submission queue entry (submitting first when the queue is full)
+    bool queue(const struct io_uring_sqe& sqe) {
+        unsigned tail = *sqTail_;
+        if (tail - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_ && !submit()) {
+            return false;
+        }
+        unsigned index = tail & sqMask_;
+        sqes_[index] = sqe;
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        pending_++;
+        return true;
+    }
+
+    // Add buffer bid at the tail of the buffer ring (published to the kernel at the end of reap())
+    void recycle(uint16_t bid) {
+        struct io_uring_buf& entry = bufEntries_[bufTail_ & (bufferCount_ - 1)];
+        entry.addr = reinterpret_cast<uint64_t>(buffers_ + static_cast<size_t>(bid) * bufferSize_);
+        entry.len = bufferSize_;
+        entry.bid = bid;
+        bufTail_++;
+    }
+
+    int ringFd_ = -1;
+    uint8_t* sqRing_ = nullptr;
+    uint8_t* cqRing_ = nullptr;
+    size_t sqRingBytes_ = 0;
+    size_t cqRingBytes_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqesBytes_ = 0;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+    unsigned pending_ = 0;                          // Queued requests not yet submitted
+
+    struct io_uring_buf_ring* bufRing_ = nullptr;   // Provided buffer ring (shared with the kernel)
+    struct io_uring_buf* bufEntries_ = nullptr;     // Its entries (bufRing_->bufs is misplaced by C++'s empty struct rule)
+    size_t bufRingBytes_ = 0;
+    uint8_t* buffers_ = nullptr;                    // bufferCount_ buffers of bufferSize_ bytes
+    size_t buffersBytes_ = 0;
+    unsigned bufferCount_ = 0;
+    unsigned bufferSize_ = 0;
+    uint16_t bufTail_ = 0;
+
+    uint64_t enters_ = 0;
+};
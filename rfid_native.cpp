@@ -0,0 +1,333 @@
+/**
+ * Python extension module with the C++ frame parser and tag table (import rfid_native).
+ *
+ * TCP_Server_Example.py and the scripts built on it parse the reader frames in Python, byte by byte.
+ * This module gives them the parser of the C++ server (rfid/frame_reassembler.h) and its tag table
+ * (rfid/tag_table.h). The received bytes are passed in as any object with the buffer protocol
+ * (bytes, bytearray, memoryview, ...) and are read where they are: nothing is copied and no Python
+ * object is made per byte.
+ *
+ * Functions:
+ *      parse_frames(buffer) -> (frames, consumed)
+ *          Every complete frame in buffer as a tuple (type, data_offset, data_len, checksum_ok). The
+ *          Data of a frame is memoryview(buffer)[data_offset:data_offset + data_len], no copy needed.
+ *          consumed is the number of bytes covered by the frames (and by skipped garbage); a frame
+ *          cut off at the end of buffer is not included and should be passed again with the rest of
+ *          it (keep buffer[consumed:]).
+ *      build_frame(type, data) -> bytes
+ *          A complete frame with the checksum the reader and the server use.
+ *
+ * class TagCounter:
+ *      feed(buffer) -> consumed            Count the frames in buffer and every tag read in the tag
+ *                                          table, all in C++ (consumed as for parse_frames())
+ *      count(epc) -> int                   Reads of a tag (epc: its 12 bytes)
+ *      top(k=10) -> [(epc, count), ...]    The k most read tags, most read first
+ *      stats() -> dict                     Frames by type, checksum errors, resyncs and discarded bytes
+ *      clear()                             Forget every tag and counter
+ *      len(counter)                        Distinct tags
+ *
+ * Frames are found with scanFrames() and their checksums validated in batches by the SIMD kernel of
+ * the server (rfid/frame_checksum.h). The kernels load up to CHECKSUM_READ_PADDING bytes past a frame,
+ * which the server's receive ring allows for but a Python buffer does not, so the frames near the end
+ * of the buffer are validated by the scalar kernel. The GIL is held throughout (a TagCounter must not
+ * be fed from two threads at once).
+ *
+ * Usage:
+ *      import rfid_native
+ *      counter = rfid_native.TagCounter()
+ *      pending = bytearray()
+ *      while data := client.recv(65536):
+ *          pending += data
+ *          del pending[:counter.feed(pending)]
+ *
+ * Compile: g++ -std=c++17 -O2 -pthread -shared -fPIC $(python3-config --includes) rfid_native.cpp -o rfid_native$(python3-config --extension-suffix)
+ * Execute: python3 -c "import rfid_native; print(rfid_native.build_frame(0x40, b'\x00\x01').hex())"
+*/
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include "rfid/command_channel.h"
+#include "rfid/frame_checksum.h"
+#include "rfid/frame_dispatch.h"
+#include "rfid/frame_reassembler.h"
+#include "rfid/tag_table.h"
+
+/* Hand every complete frame in bytes[0, size) to onFrame(const uint8_t* frame, bool checksumOk)
+
+Returns the number of bytes covered by the frames and the skipped bytes.
+*/
+template <typename OnFrame>
+static size_t forEachFrame(const uint8_t* bytes, size_t size, FrameStats& stats, OnFrame&& onFrame) {
+    const ChecksumKernel& kernel = checksumKernel();
+    const uint8_t* frames[FRAME_BATCH_SIZE];
+    bool ok[FRAME_BATCH_SIZE];
+    size_t consumed = 0;
+    while (true) {
+        size_t scanned = 0;
+        size_t count = scanFrames(bytes + consumed, size - consumed, stats, frames, FRAME_BATCH_SIZE, scanned);
+        if (count > 0) {
+            const uint8_t* last = frames[count - 1];
+            size_t lastEnd = (last - bytes) + last[2] + FRAME_OVERHEAD;
+            ChecksumBatchFn validate = lastEnd + CHECKSUM_READ_PADDING <= size ? kernel.validate : validateChecksumsScalar;
+            size_t valid = validate(frames, count, ok);
+            stats.frames += valid;
+            stats.checksumErrors += count - valid;
+            for (size_t i = 0; i < count; i++) {
+                onFrame(frames[i], ok[i]);
+            }
+        }
+        consumed += scanned;
+        if (count < FRAME_BATCH_SIZE) {
+            return consumed;
+        }
+    }
+}
+
+static PyObject* parseFrames(PyObject*, PyObject* args) {
+    Py_buffer buffer;
+    if (!PyArg_ParseTuple(args, "y*:parse_frames", &buffer)) {
+        return nullptr;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(buffer.buf);
+    PyObject* frames = PyList_New(0);
+    bool failed = frames == nullptr;
+    FrameStats stats;
+    size_t consumed = forEachFrame(bytes, buffer.len, stats, [&](const uint8_t* frame, bool checksumOk) {
+        if (failed) {
+            return;
+        }
+        PyObject* entry = Py_BuildValue("(BnnO)", frame[1], static_cast<Py_ssize_t>(frame + FRAME_HEADER_SIZE - bytes),
+                                        static_cast<Py_ssize_t>(frame[2]), checksumOk ? Py_True : Py_False);
+        failed = entry == nullptr || PyList_Append(frames, entry) < 0;
+        Py_XDECREF(entry);
+    });
+    PyBuffer_Release(&buffer);
+    if (failed) {
+        Py_XDECREF(frames);
+        return nullptr;
+    }
+    return Py_BuildValue("(Nn)", frames, static_cast<Py_ssize_t>(consumed));
+}
+
+static PyObject* buildFrameBytes(PyObject*, PyObject* args) {
+    unsigned char type;
+    Py_buffer data;
+    if (!PyArg_ParseTuple(args, "by*:build_frame", &type, &data)) {
+        return nullptr;
+    }
+    if (data.len > 255) {
+        PyBuffer_Release(&data);
+        PyErr_SetString(PyExc_ValueError, "frame data is longer than 255 bytes");
+        return nullptr;
+    }
+    PyObject* frame = PyBytes_FromStringAndSize(nullptr, data.len + FRAME_OVERHEAD);
+    if (frame) {
+        buildFrame(reinterpret_cast<uint8_t*>(PyBytes_AS_STRING(frame)), type, static_cast<const uint8_t*>(data.buf),
+                   static_cast<uint8_t>(data.len));
+    }
+    PyBuffer_Release(&data);
+    return frame;
+}
+
+/* TagCounter
+
+The Python object holds the tag table and the counters. feed() runs every valid frame through a
+dispatch table (frame_dispatch.h) like the server does.
+*/
+struct TagCounterObject {
+    PyObject_HEAD
+    TagTable* table;
+    FrameStats stats;
+    uint64_t tagReads;
+    uint64_t heartbeats;
+    uint64_t connects;
+    uint64_t otherTypes;        // Valid frames of any other TYPE
+    uint64_t malformed;         // Tag reads too short to hold an EPC
+    int64_t now;                // Time stamp of the reads of the current feed() (ns since the epoch)
+};
+
+static void countTagRead(TagCounterObject& counter, const TagReadFrame& frame) {
+    counter.table->record(EpcKey::fromBytes(frame.epc), counter.now);
+    counter.tagReads++;
+}
+
+static void countHeartbeat(TagCounterObject& counter, const HeartbeatFrame&) {
+    counter.heartbeats++;
+}
+
+static void countConnect(TagCounterObject& counter, const ConnectFrame&) {
+    counter.connects++;
+}
+
+static void countOther(TagCounterObject& counter, const FrameView&) {
+    counter.otherTypes++;
+}
+
+static void countMalformed(TagCounterObject& counter, const FrameView&) {
+    counter.malformed++;
+}
+
+using CounterFrameTypes = FrameDispatcher<TagCounterObject, countOther, countMalformed,
+                                          FrameHandler<TagReadFrame, countTagRead>,
+                                          FrameHandler<HeartbeatFrame, countHeartbeat>,
+                                          FrameHandler<ConnectFrame, countConnect>>;
+
+static PyObject* tagCounterNew(PyTypeObject* type, PyObject*, PyObject*) {
+    TagCounterObject* self = reinterpret_cast<TagCounterObject*>(type->tp_alloc(type, 0));
+    if (!self) {
+        return nullptr;
+    }
+    self->table = new (std::nothrow) TagTable();
+    if (!self->table) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return reinterpret_cast<PyObject*>(self);
+}
+
+static void tagCounterDealloc(PyObject* object) {
+    TagCounterObject* self = reinterpret_cast<TagCounterObject*>(object);
+    PyTypeObject* type = Py_TYPE(object);
+    delete self->table;
+    type->tp_free(object);
+    Py_DECREF(type);
+}
+
+static PyObject* tagCounterFeed(PyObject* object, PyObject* args) {
+    TagCounterObject& self = *reinterpret_cast<TagCounterObject*>(object);
+    Py_buffer buffer;
+    if (!PyArg_ParseTuple(args, "y*:feed", &buffer)) {
+        return nullptr;
+    }
+    self.now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    size_t consumed = forEachFrame(static_cast<const uint8_t*>(buffer.buf), buffer.len, self.stats,
+                                   [&self](const uint8_t* frame, bool checksumOk) {
+        FrameView view;
+        if (checksumOk && parseFrame(frame, frame[2] + FRAME_OVERHEAD, view)) {
+            CounterFrameTypes::dispatch(self, view);
+        }
+    });
+    PyBuffer_Release(&buffer);
+    return PyLong_FromSize_t(consumed);
+}
+
+static PyObject* tagCounterCount(PyObject* object, PyObject* args) {
+    TagCounterObject& self = *reinterpret_cast<TagCounterObject*>(object);
+    Py_buffer epc;
+    if (!PyArg_ParseTuple(args, "y*:count", &epc)) {
+        return nullptr;
+    }
+    if (epc.len != EPC_LEN) {
+        PyBuffer_Release(&epc);
+        PyErr_SetString(PyExc_ValueError, "an EPC is 12 bytes");
+        return nullptr;
+    }
+    const TagEntry* entry = self.table->find(EpcKey::fromBytes(static_cast<const uint8_t*>(epc.buf)));
+    PyBuffer_Release(&epc);
+    return PyLong_FromUnsignedLong(entry ? entry->count : 0);
+}
+
+static PyObject* tagCounterTop(PyObject* object, PyObject* args) {
+    TagCounterObject& self = *reinterpret_cast<TagCounterObject*>(object);
+    Py_ssize_t k = 10;
+    if (!PyArg_ParseTuple(args, "|n:top", &k)) {
+        return nullptr;
+    }
+    std::vector<const TagEntry*> entries;
+    entries.reserve(self.table->size());
+    self.table->forEach([&entries](const TagEntry& entry) { entries.push_back(&entry); });
+    size_t count = std::min(entries.size(), static_cast<size_t>(std::max<Py_ssize_t>(k, 0)));
+    std::partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+                      [](const TagEntry* a, const TagEntry* b) { return a->count > b->count; });
+
+    PyObject* top = PyList_New(count);
+    if (!top) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < count; i++) {
+        PyObject* item = Py_BuildValue("(y#k)", reinterpret_cast<const char*>(entries[i]->epc.bytes),
+                                       static_cast<Py_ssize_t>(EPC_LEN), static_cast<unsigned long>(entries[i]->count));
+        if (!item) {
+            Py_DECREF(top);
+            return nullptr;
+        }
+        PyList_SET_ITEM(top, i, item);
+    }
+    return top;
+}
+
+static PyObject* tagCounterStats(PyObject* object, PyObject*) {
+    TagCounterObject& self = *reinterpret_cast<TagCounterObject*>(object);
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:K,s:n}",
+                         "frames", self.stats.frames, "tag_reads", self.tagReads, "heartbeats", self.heartbeats,
+                         "connects", self.connects, "other_types", self.otherTypes, "malformed", self.malformed,
+                         "checksum_errors", self.stats.checksumErrors, "resyncs", self.stats.resyncs,
+                         "discarded_bytes", self.stats.discardedBytes,
+                         "distinct_tags", static_cast<Py_ssize_t>(self.table->size()));
+}
+
+static PyObject* tagCounterClear(PyObject* object, PyObject*) {
+    TagCounterObject& self = *reinterpret_cast<TagCounterObject*>(object);
+    self.table->clear();
+    self.stats = FrameStats();
+    self.tagReads = self.heartbeats = self.connects = self.otherTypes = self.malformed = 0;
+    Py_RETURN_NONE;
+}
+
+static Py_ssize_t tagCounterLength(PyObject* object) {
+    return reinterpret_cast<TagCounterObject*>(object)->table->size();
+}
+
+static PyMethodDef tagCounterMethods[] = {
+    {"feed", tagCounterFeed, METH_VARARGS, "feed(buffer) -> consumed: count the frames and tag reads in buffer"},
+    {"count", tagCounterCount, METH_VARARGS, "count(epc) -> reads of the tag with these 12 bytes"},
+    {"top", tagCounterTop, METH_VARARGS, "top(k=10) -> the k most read tags as (epc, count)"},
+    {"stats", tagCounterStats, METH_NOARGS, "stats() -> frame, checksum and resync counters"},
+    {"clear", tagCounterClear, METH_NOARGS, "clear() -> forget every tag and counter"},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyType_Slot tagCounterSlots[] = {
+    {Py_tp_new, reinterpret_cast<void*>(tagCounterNew)},
+    {Py_tp_dealloc, reinterpret_cast<void*>(tagCounterDealloc)},
+    {Py_tp_methods, tagCounterMethods},
+    {Py_mp_length, reinterpret_cast<void*>(tagCounterLength)},
+    {Py_tp_doc, const_cast<char*>("Counts the frames and tag reads of a reader stream in the C++ tag table.")},
+    {0, nullptr},
+};
+
+static PyType_Spec tagCounterSpec = {
+    "rfid_native.TagCounter", sizeof(TagCounterObject), 0, Py_TPFLAGS_DEFAULT, tagCounterSlots,
+};
+
+static PyMethodDef moduleMethods[] = {
+    {"parse_frames", parseFrames, METH_VARARGS,
+     "parse_frames(buffer) -> ([(type, data_offset, data_len, checksum_ok), ...], consumed)"},
+    {"build_frame", buildFrameBytes, METH_VARARGS, "build_frame(type, data) -> bytes of a complete frame"},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+static PyModuleDef moduleDefinition = {
+    PyModuleDef_HEAD_INIT, "rfid_native", "C++ RFID frame parser and tag table.", -1, moduleMethods,
+    nullptr, nullptr, nullptr, nullptr,
+};
+
+PyMODINIT_FUNC PyInit_rfid_native() {
+    PyObject* module = PyModule_Create(&moduleDefinition);
+    if (!module) {
+        return nullptr;
+    }
+    PyObject* tagCounterType = PyType_FromSpec(&tagCounterSpec);
+    if (!tagCounterType || PyModule_AddObject(module, "TagCounter", tagCounterType) < 0) {
+        Py_XDECREF(tagCounterType);
+        Py_DECREF(module);
+        return nullptr;
+    }
+    return module;
+}